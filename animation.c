@@ -0,0 +1,479 @@
+/**
+    Simple wallpaper program.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "wallpaper.h"
+
+#include <FreeImage.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <SDL2/SDL_error.h>
+#include <SDL2/SDL_events.h>
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_timer.h>
+
+/*	Disposal methods.	*/
+#define SWP_DISPOSAL_BACKGROUND 2
+#define SWP_DISPOSAL_PREVIOUS   3
+
+static unsigned int swpGetAnimationTag(FIBITMAP *bitmap, const char *key, unsigned int def) {
+
+	FITAG* tag = NULL;
+	const void* value;
+
+	if (!FreeImage_GetMetadata(FIMD_ANIMATION, bitmap, key, &tag) || tag == NULL)
+		return def;
+	value = FreeImage_GetTagValue(tag);
+	if (value == NULL)
+		return def;
+
+	switch (FreeImage_GetTagType(tag)) {
+		case FIDT_BYTE:
+			return *(const BYTE *) value;
+		case FIDT_SHORT:
+			return *(const WORD *) value;
+		case FIDT_LONG:
+			return *(const DWORD *) value;
+		default:
+			return def;
+	}
+}
+
+static void swpUnionRect(swpFrameInfo *info, const unsigned int *rect) {
+
+	unsigned int x1, y1;
+
+	if (rect[2] == 0 || rect[3] == 0)
+		return;
+	if (info->width == 0 || info->height == 0) {
+		info->x = rect[0];
+		info->y = rect[1];
+		info->width = rect[2];
+		info->height = rect[3];
+		return;
+	}
+
+	x1 = SDL_max(info->x + info->width, rect[0] + rect[2]);
+	y1 = SDL_max(info->y + info->height, rect[1] + rect[3]);
+	info->x = SDL_min(info->x, rect[0]);
+	info->y = SDL_min(info->y, rect[1]);
+	info->width = x1 - info->x;
+	info->height = y1 - info->y;
+}
+
+static void swpCopyRect(unsigned char *__restrict__ dst, const unsigned char *__restrict__ src,
+                        unsigned int pitch, const unsigned int *rect) {
+
+	unsigned int y;
+
+	for (y = rect[1]; y < rect[1] + rect[3]; y++) {
+		memcpy(&dst[y * pitch + rect[0] * 4], &src[y * pitch + rect[0] * 4], rect[2] * 4);
+	}
+}
+
+static void swpCopyFrameRect(unsigned char *__restrict__ dst, const unsigned char *__restrict__ src,
+                             unsigned int pitch, const swpFrameInfo *info) {
+
+	const unsigned int rect[4] = {info->x, info->y, info->width, info->height};
+	swpCopyRect(dst, src, pitch, rect);
+}
+
+void swpFreeAnimation(swpAnimation *anim) {
+
+	if (anim->multibitmap != NULL)
+		FreeImage_CloseMultiBitmap(anim->multibitmap, 0);
+	if (anim->memory != NULL)
+		FreeImage_CloseMemory(anim->memory);
+	if (!anim->resident)
+		swpReleaseFrameQueue(&anim->queue);
+	free(anim->frames);
+	free(anim->info);
+	free(anim->canvas);
+	free(anim->restore);
+	free(anim);
+}
+
+/**
+ *	Composite page onto the canvas and compute
+ *	the sub-rectangle that changed.
+ */
+static int swpDecodeAnimationPage(swpAnimation *anim, unsigned int page, swpFrameInfo *info) {
+
+	const unsigned int pitch = anim->width * 4;
+	FIBITMAP* raw;
+	FIBITMAP* bitmap;
+	unsigned int left, top, time, disposal;
+	unsigned int rect[4];
+	unsigned int x, y;
+
+	raw = FreeImage_LockPage(anim->multibitmap, page);
+	if (raw == NULL) {
+		fprintf(stderr, "Failed to decode animation frame %d.\n", page);
+		return 0;
+	}
+
+	left = swpGetAnimationTag(raw, "FrameLeft", 0);
+	top = swpGetAnimationTag(raw, "FrameTop", 0);
+	time = swpGetAnimationTag(raw, "FrameTime", 100);
+	disposal = swpGetAnimationTag(raw, "DisposalMethod", 0);
+	bitmap = FreeImage_ConvertTo32Bits(raw);
+	FreeImage_UnlockPage(anim->multibitmap, raw, FALSE);
+	if (bitmap == NULL) {
+		fprintf(stderr, "Failed to convert animation frame %d.\n", page);
+		return 0;
+	}
+
+	memset(info, 0, sizeof(*info));
+
+	/*	Animation restarts from a cleared canvas.	*/
+	if (page == 0) {
+		memset(anim->canvas, 0, anim->framesize);
+		anim->prevdisposal = 0;
+		info->width = anim->width;
+		info->height = anim->height;
+	}
+
+	/*	Dispose the previous frame.	*/
+	if (anim->prevdisposal == SWP_DISPOSAL_BACKGROUND) {
+		for (y = anim->prevrect[1]; y < anim->prevrect[1] + anim->prevrect[3]; y++)
+			memset(&anim->canvas[y * pitch + anim->prevrect[0] * 4], 0, anim->prevrect[2] * 4);
+		swpUnionRect(info, anim->prevrect);
+	} else if (anim->prevdisposal == SWP_DISPOSAL_PREVIOUS) {
+		swpCopyRect(anim->canvas, anim->restore, pitch, anim->prevrect);
+		swpUnionRect(info, anim->prevrect);
+	}
+
+	/*	Frame rectangle in canvas memory, rows are stored bottom up.	*/
+	left = SDL_min(left, anim->width);
+	top = SDL_min(top, anim->height);
+	rect[0] = left;
+	rect[2] = SDL_min(FreeImage_GetWidth(bitmap), anim->width - left);
+	rect[3] = SDL_min(FreeImage_GetHeight(bitmap), anim->height - top);
+	rect[1] = anim->height - top - rect[3];
+
+	if (disposal == SWP_DISPOSAL_PREVIOUS)
+		swpCopyRect(anim->restore, anim->canvas, pitch, rect);
+
+	/*	Blend frame over the canvas.	*/
+	for (y = 0; y < rect[3]; y++) {
+		const unsigned char* src = FreeImage_GetScanLine(bitmap, FreeImage_GetHeight(bitmap) - rect[3] + y);
+		unsigned char* dst = &anim->canvas[(rect[1] + y) * pitch + rect[0] * 4];
+		for (x = 0; x < rect[2]; x++, src += 4, dst += 4) {
+			const unsigned int a = src[3];
+			if (a == 255) {
+				memcpy(dst, src, 4);
+			} else if (a != 0) {
+				dst[0] = (unsigned char) ((src[0] * a + dst[0] * (255 - a)) / 255);
+				dst[1] = (unsigned char) ((src[1] * a + dst[1] * (255 - a)) / 255);
+				dst[2] = (unsigned char) ((src[2] * a + dst[2] * (255 - a)) / 255);
+				dst[3] = (unsigned char) (a + (dst[3] * (255 - a)) / 255);
+			}
+		}
+	}
+	swpUnionRect(info, rect);
+	FreeImage_Unload(bitmap);
+
+	memcpy(anim->prevrect, rect, sizeof(rect));
+	anim->prevdisposal = disposal;
+
+	/*	Same minimum delay as common browsers.	*/
+	info->delay = time <= 10 ? 0.1f : (float) time / 1000.0f;
+
+	return 1;
+}
+
+static int swpAnimationThread(void *userdata) {
+
+	swpAnimation* anim = (swpAnimation *) userdata;
+	const unsigned int pitch = anim->width * 4;
+	swpFrameInfo info;
+	unsigned char* slot;
+	unsigned int x, y;
+
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_LOW);
+
+	while (SDL_AtomicGet(&anim->alive)) {
+
+		const unsigned int page = anim->nextpage;
+
+		/*	Resident frames are decoded once and played back in a loop.	*/
+		if (anim->resident) {
+			if (!swpDecodeAnimationPage(anim, page, &anim->info[page]))
+				break;
+			slot = &anim->frames[(size_t) page * anim->framesize];
+			swpCopyFrameRect(slot, anim->canvas, pitch, &anim->info[page]);
+
+			/*	Change from the last frame to the first, when looping.	*/
+			if (page == anim->numframes - 1) {
+				const unsigned int* first = (const unsigned int *) anim->frames;
+				const unsigned int* last = (const unsigned int *) anim->canvas;
+				unsigned int rect[4] = {anim->width, anim->height, 0, 0};
+				for (y = 0; y < anim->height; y++) {
+					for (x = 0; x < anim->width; x++) {
+						if (first[y * anim->width + x] != last[y * anim->width + x]) {
+							rect[0] = SDL_min(rect[0], x);
+							rect[1] = SDL_min(rect[1], y);
+							rect[2] = SDL_max(rect[2], x + 1);
+							rect[3] = SDL_max(rect[3], y + 1);
+						}
+					}
+				}
+				anim->loopinfo = anim->info[0];
+				anim->loopinfo.x = rect[2] > 0 ? rect[0] : 0;
+				anim->loopinfo.y = rect[2] > 0 ? rect[1] : 0;
+				anim->loopinfo.width = rect[2] > 0 ? rect[2] - rect[0] : 0;
+				anim->loopinfo.height = rect[2] > 0 ? rect[3] - rect[1] : 0;
+			}
+
+			SDL_AtomicSet(&anim->decoded, page + 1);
+			if (page == anim->numframes - 1)
+				break;
+			anim->nextpage++;
+			continue;
+		}
+
+		/*	Streaming, decode ahead until the ring is full.	*/
+		slot = swpFrameQueueBeginWrite(&anim->queue);
+		if (slot == NULL)
+			break;
+		if (!swpDecodeAnimationPage(anim, page, &info))
+			break;
+		swpCopyFrameRect(slot, anim->canvas, pitch, &info);
+		swpFrameQueueEndWrite(&anim->queue, &info);
+		anim->nextpage = (page + 1) % anim->numframes;
+	}
+
+	/*	Encoded data is no longer needed once all frames are resident.	*/
+	if (anim->resident) {
+		FreeImage_CloseMultiBitmap(anim->multibitmap, 0);
+		FreeImage_CloseMemory(anim->memory);
+		anim->multibitmap = NULL;
+		anim->memory = NULL;
+	}
+
+	return 0;
+}
+
+swpAnimation *swpCreateAnimation(int fif, FIMEMORY *__restrict__ memory, swpTextureDesc *__restrict__ desc) {
+
+	swpAnimation* anim;
+	FIMULTIBITMAP* multibitmap;
+	FIBITMAP* first;
+	swpFrameInfo info;
+	int numframes;
+	size_t total;
+
+	/*	Only formats with multiple frames.	*/
+	if (fif != FIF_GIF && fif != FIF_WEBP)
+		return NULL;
+
+	FreeImage_SeekMemory(memory, 0, SEEK_SET);
+	multibitmap = FreeImage_LoadMultiBitmapFromMemory((FREE_IMAGE_FORMAT) fif, memory, 0);
+	if (multibitmap == NULL)
+		return NULL;
+	numframes = FreeImage_GetPageCount(multibitmap);
+	if (numframes <= 1) {
+		FreeImage_CloseMultiBitmap(multibitmap, 0);
+		FreeImage_SeekMemory(memory, 0, SEEK_SET);
+		return NULL;
+	}
+
+	anim = calloc(1, sizeof(swpAnimation));
+	assert(anim);
+	anim->multibitmap = multibitmap;
+	anim->memory = memory;
+	anim->numframes = numframes;
+	anim->timer = 0;
+
+	/*	Canvas size is stored in the first page.	*/
+	first = FreeImage_LockPage(multibitmap, 0);
+	if (first == NULL) {
+		FreeImage_CloseMultiBitmap(multibitmap, 0);
+		free(anim);
+		return NULL;
+	}
+	anim->width = swpGetAnimationTag(first, "LogicalWidth", FreeImage_GetWidth(first));
+	anim->height = swpGetAnimationTag(first, "LogicalHeight", FreeImage_GetHeight(first));
+	FreeImage_UnlockPage(multibitmap, first, FALSE);
+	anim->framesize = anim->width * anim->height * 4;
+	if (anim->width > g_maxtexsize || anim->height > g_maxtexsize || anim->framesize == 0) {
+		FreeImage_CloseMultiBitmap(multibitmap, 0);
+		FreeImage_SeekMemory(memory, 0, SEEK_SET);
+		free(anim);
+		return NULL;
+	}
+
+	/*	Decode everything once if it fits the frame budget.	*/
+	total = (size_t) anim->framesize * numframes;
+	anim->resident = total <= g_framebudget;
+	anim->canvas = calloc(1, anim->framesize);
+	anim->restore = calloc(1, anim->framesize);
+	if (anim->resident) {
+		anim->frames = malloc(total);
+		anim->info = calloc(numframes, sizeof(swpFrameInfo));
+	} else {
+		swpCreateFrameQueue(&anim->queue,
+		                    SDL_max(2, SDL_min((unsigned int) (g_framebudget / anim->framesize), numframes)),
+		                    anim->framesize);
+	}
+	if (anim->canvas == NULL || anim->restore == NULL ||
+	    (anim->resident ? anim->frames == NULL || anim->info == NULL : anim->queue.data == NULL)) {
+		fprintf(stderr, "Failed to allocate animation frames, %s.\n", strerror(errno));
+		anim->memory = NULL;
+		swpFreeAnimation(anim);
+		return NULL;
+	}
+	swpVerbosePrintf("Animation %dx%d, %d frames, %s.\n", anim->width, anim->height, numframes,
+	                 anim->resident ? "resident" : "streamed");
+
+	/*	First frame is displayed as a regular picture.	*/
+	if (!swpDecodeAnimationPage(anim, 0, anim->resident ? &anim->info[0] : &info)) {
+		anim->memory = NULL;
+		swpFreeAnimation(anim);
+		return NULL;
+	}
+	if (anim->resident) {
+		memcpy(anim->frames, anim->canvas, anim->framesize);
+		SDL_AtomicSet(&anim->decoded, 1);
+	} else {
+		anim->loopinfo = info;
+	}
+
+	desc->pixel = malloc(anim->framesize);
+	assert(desc->pixel);
+	memcpy(desc->pixel, anim->canvas, anim->framesize);
+	desc->width = anim->width;
+	desc->height = anim->height;
+	desc->bpp = 4;
+	desc->size = anim->framesize;
+	desc->intfor = GL_RGBA;
+	desc->format = GL_BGRA;
+	desc->imgdatatype = GL_UNSIGNED_BYTE;
+	desc->animation = anim;
+
+	/*	Decode the remaining frames ahead of display.	*/
+	anim->nextpage = 1;
+	SDL_AtomicSet(&anim->alive, 1);
+	anim->thread = SDL_CreateThread(swpAnimationThread, "animation", anim);
+	if (anim->thread == NULL) {
+		fprintf(stderr, "Failed to create thread, %s.\n", SDL_GetError());
+	}
+
+	return anim;
+}
+
+static Uint32 swpAnimationTimer(Uint32 interval, void *param) {
+
+	SDL_Event event = {0};
+
+	event.type = SDL_USEREVENT;
+	event.user.code = SWP_EVENT_ANIMATION_FRAME;
+	event.user.data1 = param;
+	SDL_PushEvent(&event);
+
+	/*	One shot, the next frame is scheduled by the main thread.	*/
+	return 0;
+}
+
+void swpBeginAnimation(swpRenderingState *__restrict__ state, swpAnimation *__restrict__ anim, GLuint tex) {
+
+	const float delay = anim->resident ? anim->info[0].delay : anim->loopinfo.delay;
+
+	if (state->animation != NULL && state->animation != anim)
+		swpReleaseAnimation(state);
+
+	anim->tex = tex;
+	anim->current = 0;
+	state->animation = anim;
+	anim->timer = SDL_AddTimer((Uint32) (delay * 1000.0f), swpAnimationTimer, anim);
+}
+
+int swpUpdateAnimation(swpRenderingState *state) {
+
+	swpAnimation* anim = state->animation;
+	const unsigned char* frame;
+	swpFrameInfo info;
+	unsigned int next;
+
+	if (anim == NULL)
+		return 0;
+
+	/*	Get next frame.	*/
+	if (anim->resident) {
+		next = (anim->current + 1) % anim->numframes;
+		if (next >= (unsigned int) SDL_AtomicGet(&anim->decoded)) {
+			/*	Decoder has not caught up, try again shortly.	*/
+			anim->timer = SDL_AddTimer(10, swpAnimationTimer, anim);
+			return 0;
+		}
+		frame = &anim->frames[(size_t) next * anim->framesize];
+		info = next == 0 ? anim->loopinfo : anim->info[next];
+		anim->current = next;
+	} else {
+		frame = swpFrameQueuePeek(&anim->queue, &info);
+		if (frame == NULL) {
+			anim->timer = SDL_AddTimer(10, swpAnimationTimer, anim);
+			return 0;
+		}
+	}
+
+	/*	Upload only the changed sub-rectangle.	*/
+	if (info.width > 0 && info.height > 0) {
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, anim->tex);
+
+		/*	Animations are never compressed, frames only hold the changed rectangle.	*/
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, anim->width);
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS, info.x);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS, info.y);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, info.x, info.y, info.width, info.height, GL_BGRA,
+		                GL_UNSIGNED_BYTE, frame);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+	}
+
+	if (!anim->resident)
+		swpFrameQueuePop(&anim->queue);
+
+	anim->timer = SDL_AddTimer((Uint32) (info.delay * 1000.0f), swpAnimationTimer, anim);
+	return 1;
+}
+
+void swpReleaseAnimation(swpRenderingState *state) {
+
+	swpAnimation* anim = state->animation;
+
+	if (anim == NULL)
+		return;
+	state->animation = NULL;
+
+	if (anim->timer != 0)
+		SDL_RemoveTimer(anim->timer);
+
+	/*	Stop the worker.	*/
+	SDL_AtomicSet(&anim->alive, 0);
+	if (!anim->resident)
+		swpFrameQueueClose(&anim->queue);
+	if (anim->thread != NULL)
+		SDL_WaitThread(anim->thread, NULL);
+
+	swpFreeAnimation(anim);
+}
@@ -0,0 +1,403 @@
+/**
+    Simple wallpaper program.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "swpk.h"
+
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*	Channel offsets of BGRA pixels.	*/
+#define SWP_B 0
+#define SWP_G 1
+#define SWP_R 2
+#define SWP_A 3
+
+#define SWP_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define SWP_MAX(a, b) ((a) > (b) ? (a) : (b))
+
+size_t swpGetBCSize(unsigned int width, unsigned int height, unsigned int format) {
+	const size_t blocks = (size_t) ((width + 3) / 4) * ((height + 3) / 4);
+	return blocks * (format == SWPK_FORMAT_BC1 ? 8 : 16);
+}
+
+static void swpFetchBlock(const unsigned char *bgra, unsigned int width, unsigned int height,
+                          unsigned int bx, unsigned int by, unsigned char block[64]) {
+
+	unsigned int x, y;
+
+	/*	Pixels outside the picture repeat the edge.	*/
+	for (y = 0; y < 4; y++) {
+		const unsigned int sy = by * 4 + y < height ? by * 4 + y : height - 1;
+		for (x = 0; x < 4; x++) {
+			const unsigned int sx = bx * 4 + x < width ? bx * 4 + x : width - 1;
+			memcpy(&block[(y * 4 + x) * 4], &bgra[((size_t) sy * width + sx) * 4], 4);
+		}
+	}
+}
+
+#if defined(__SSE2__)
+/**
+ *	Per channel minimum and maximum of the 16 pixels.
+ */
+static void swpBlockBounds(const unsigned char block[64], unsigned char minc[4], unsigned char maxc[4]) {
+
+	const __m128i p0 = _mm_loadu_si128((const __m128i *) &block[0]);
+	const __m128i p1 = _mm_loadu_si128((const __m128i *) &block[16]);
+	const __m128i p2 = _mm_loadu_si128((const __m128i *) &block[32]);
+	const __m128i p3 = _mm_loadu_si128((const __m128i *) &block[48]);
+	__m128i mn = _mm_min_epu8(_mm_min_epu8(p0, p1), _mm_min_epu8(p2, p3));
+	__m128i mx = _mm_max_epu8(_mm_max_epu8(p0, p1), _mm_max_epu8(p2, p3));
+	int v;
+
+	mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 8));
+	mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 4));
+	mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 8));
+	mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 4));
+	v = _mm_cvtsi128_si32(mn);
+	memcpy(minc, &v, 4);
+	v = _mm_cvtsi128_si32(mx);
+	memcpy(maxc, &v, 4);
+}
+
+/**
+ *	Nearest of the four palette colors of each pixel, four
+ *	pixels at the time. Ties resolve to the first color as
+ *	in the scalar search, so the blocks are identical.
+ */
+static uint32_t swpBlockIndices(const unsigned char block[64], int palette[4][4]) {
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rgbmask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+	__m128i px[8], best[4], bestidx[4];
+	int idx[16];
+	uint32_t indices = 0;
+	unsigned int i, j, k;
+
+	for (k = 0; k < 4; k++) {
+		const __m128i v = _mm_loadu_si128((const __m128i *) &block[k * 16]);
+		px[k * 2] = _mm_unpacklo_epi8(v, zero);
+		px[k * 2 + 1] = _mm_unpackhi_epi8(v, zero);
+	}
+
+	for (j = 0; j < 4; j++) {
+		const __m128i pal = _mm_set_epi16(0, (short) palette[j][SWP_R], (short) palette[j][SWP_G],
+		                                  (short) palette[j][SWP_B], 0, (short) palette[j][SWP_R],
+		                                  (short) palette[j][SWP_G], (short) palette[j][SWP_B]);
+		for (k = 0; k < 4; k++) {
+			const __m128i d0 = _mm_and_si128(_mm_sub_epi16(px[k * 2], pal), rgbmask);
+			const __m128i d1 = _mm_and_si128(_mm_sub_epi16(px[k * 2 + 1], pal), rgbmask);
+			__m128i s0 = _mm_madd_epi16(d0, d0);
+			__m128i s1 = _mm_madd_epi16(d1, d1);
+			__m128i dist;
+
+			/*	Sum the channel pairs of each pixel.	*/
+			s0 = _mm_add_epi32(s0, _mm_srli_epi64(s0, 32));
+			s1 = _mm_add_epi32(s1, _mm_srli_epi64(s1, 32));
+			dist = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(s0), _mm_castsi128_ps(s1),
+			                                       _MM_SHUFFLE(2, 0, 2, 0)));
+			if (j == 0) {
+				best[k] = dist;
+				bestidx[k] = zero;
+			} else {
+				const __m128i lt = _mm_cmplt_epi32(dist, best[k]);
+				best[k] = _mm_or_si128(_mm_and_si128(lt, dist), _mm_andnot_si128(lt, best[k]));
+				bestidx[k] = _mm_or_si128(_mm_and_si128(lt, _mm_set1_epi32((int) j)),
+				                          _mm_andnot_si128(lt, bestidx[k]));
+			}
+		}
+	}
+
+	for (k = 0; k < 4; k++)
+		_mm_storeu_si128((__m128i *) &idx[k * 4], bestidx[k]);
+	for (i = 0; i < 16; i++)
+		indices |= (uint32_t) idx[i] << (i * 2);
+	return indices;
+}
+#endif
+
+static uint16_t swpPackRGB565(const unsigned char *c) {
+	return (uint16_t) (((c[SWP_R] >> 3) << 11) | ((c[SWP_G] >> 2) << 5) | (c[SWP_B] >> 3));
+}
+
+static void swpUnpackRGB565(uint16_t v, int *c) {
+	c[SWP_R] = ((v >> 11) & 0x1f) * 255 / 31;
+	c[SWP_G] = ((v >> 5) & 0x3f) * 255 / 63;
+	c[SWP_B] = (v & 0x1f) * 255 / 31;
+}
+
+static void swpEncodeColorBlock(const unsigned char block[64], unsigned char out[8]) {
+
+	unsigned char minc[4] = {255, 255, 255, 255};
+	unsigned char maxc[4] = {0, 0, 0, 0};
+	int palette[4][4];
+	uint16_t c0, c1;
+	uint32_t indices = 0;
+	unsigned int c;
+#if !defined(__SSE2__)
+	unsigned int i;
+#endif
+
+	/*	Bounding box of the colors, inset by 1/16 to reduce the error.	*/
+#if defined(__SSE2__)
+	swpBlockBounds(block, minc, maxc);
+#else
+	for (i = 0; i < 16; i++) {
+		for (c = 0; c < 3; c++) {
+			if (block[i * 4 + c] < minc[c])
+				minc[c] = block[i * 4 + c];
+			if (block[i * 4 + c] > maxc[c])
+				maxc[c] = block[i * 4 + c];
+		}
+	}
+#endif
+	for (c = 0; c < 3; c++) {
+		const int inset = (maxc[c] - minc[c]) >> 4;
+		minc[c] = (unsigned char) (minc[c] + inset);
+		maxc[c] = (unsigned char) (maxc[c] - inset);
+	}
+
+	c0 = swpPackRGB565(maxc);
+	c1 = swpPackRGB565(minc);
+
+	/*	Four color mode requires c0 > c1.	*/
+	if (c0 < c1) {
+		uint16_t t = c0;
+		c0 = c1;
+		c1 = t;
+	}
+
+	if (c0 != c1) {
+		swpUnpackRGB565(c0, palette[0]);
+		swpUnpackRGB565(c1, palette[1]);
+		for (c = 0; c < 3; c++) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		/*	Nearest palette color of each pixel.	*/
+#if defined(__SSE2__)
+		indices = swpBlockIndices(block, palette);
+#else
+		for (i = 0; i < 16; i++) {
+			unsigned int best = 0, j;
+			int bestdist = 0x7fffffff;
+			for (j = 0; j < 4; j++) {
+				int dist = 0;
+				for (c = 0; c < 3; c++) {
+					const int d = (int) block[i * 4 + c] - palette[j][c];
+					dist += d * d;
+				}
+				if (dist < bestdist) {
+					bestdist = dist;
+					best = j;
+				}
+			}
+			indices |= (uint32_t) best << (i * 2);
+		}
+#endif
+	}
+
+	out[0] = (unsigned char) (c0 & 0xff);
+	out[1] = (unsigned char) (c0 >> 8);
+	out[2] = (unsigned char) (c1 & 0xff);
+	out[3] = (unsigned char) (c1 >> 8);
+	out[4] = (unsigned char) (indices & 0xff);
+	out[5] = (unsigned char) ((indices >> 8) & 0xff);
+	out[6] = (unsigned char) ((indices >> 16) & 0xff);
+	out[7] = (unsigned char) (indices >> 24);
+}
+
+static void swpEncodeAlphaBlock(const unsigned char block[64], unsigned char out[8]) {
+
+	unsigned char a0 = 0, a1 = 255;
+	int palette[8];
+	uint64_t indices = 0;
+	unsigned int i, j;
+
+	for (i = 0; i < 16; i++) {
+		if (block[i * 4 + SWP_A] > a0)
+			a0 = block[i * 4 + SWP_A];
+		if (block[i * 4 + SWP_A] < a1)
+			a1 = block[i * 4 + SWP_A];
+	}
+
+	/*	Eight alpha mode, a0 > a1. Constant alpha uses index 0.	*/
+	if (a0 != a1) {
+		palette[0] = a0;
+		palette[1] = a1;
+		for (j = 1; j < 7; j++)
+			palette[j + 1] = ((7 - j) * a0 + j * a1) / 7;
+
+		for (i = 0; i < 16; i++) {
+			unsigned int best = 0;
+			int bestdist = 256;
+			for (j = 0; j < 8; j++) {
+				const int d = (int) block[i * 4 + SWP_A] - palette[j];
+				if ((d < 0 ? -d : d) < bestdist) {
+					bestdist = d < 0 ? -d : d;
+					best = j;
+				}
+			}
+			indices |= (uint64_t) best << (i * 3);
+		}
+	}
+
+	out[0] = a0;
+	out[1] = a1;
+	for (i = 0; i < 6; i++)
+		out[2 + i] = (unsigned char) ((indices >> (i * 8)) & 0xff);
+}
+
+static void swpWriteBits(unsigned char out[16], unsigned int *pos, unsigned int value, unsigned int count) {
+
+	unsigned int i;
+
+	for (i = 0; i < count; i++, (*pos)++) {
+		if ((value >> i) & 1)
+			out[*pos >> 3] |= (unsigned char) (1 << (*pos & 7));
+	}
+}
+
+/**
+ *	Quantize endpoint to 7 bits per channel and a shared
+ *	p-bit, choosing the p-bit with the smallest error.
+ */
+static void swpQuantizeBC7Endpoint(const int *color, int *quant, int *pbit, int *recon) {
+
+	int err[2] = {0, 0};
+	int p, c;
+
+	for (p = 0; p < 2; p++) {
+		for (c = 0; c < 4; c++) {
+			const int q = SWP_MIN(127, SWP_MAX(0, (color[c] - p + 1) >> 1));
+			const int d = ((q << 1) | p) - color[c];
+			err[p] += d * d;
+		}
+	}
+	*pbit = err[1] < err[0];
+	for (c = 0; c < 4; c++) {
+		quant[c] = SWP_MIN(127, SWP_MAX(0, (color[c] - *pbit + 1) >> 1));
+		recon[c] = (quant[c] << 1) | *pbit;
+	}
+}
+
+/**
+ *	Encode BC7 mode 6 block, a single subset of RGBA
+ *	endpoints with sixteen interpolated colors.
+ */
+static void swpEncodeBC7Block(const unsigned char block[64], unsigned char out[16]) {
+
+	static const int weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+	static const unsigned int order[4] = {SWP_R, SWP_G, SWP_B, SWP_A};
+	int lo[4] = {255, 255, 255, 255}, hi[4] = {0, 0, 0, 0};
+	int q0[4], q1[4], e0[4], e1[4], p0, p1;
+	int palette[16][4];
+	unsigned int index[16];
+	unsigned int i, j, c, pos = 0;
+
+	/*	Bounding box in RGBA order, inset by 1/32.	*/
+	for (i = 0; i < 16; i++) {
+		for (c = 0; c < 4; c++) {
+			lo[c] = SWP_MIN(lo[c], block[i * 4 + order[c]]);
+			hi[c] = SWP_MAX(hi[c], block[i * 4 + order[c]]);
+		}
+	}
+	for (c = 0; c < 4; c++) {
+		const int inset = (hi[c] - lo[c]) >> 5;
+		lo[c] += inset;
+		hi[c] -= inset;
+	}
+	swpQuantizeBC7Endpoint(lo, q0, &p0, e0);
+	swpQuantizeBC7Endpoint(hi, q1, &p1, e1);
+
+	for (j = 0; j < 16; j++) {
+		for (c = 0; c < 4; c++)
+			palette[j][c] = ((64 - weights[j]) * e0[c] + weights[j] * e1[c] + 32) >> 6;
+	}
+
+	/*	Nearest interpolated color of each pixel.	*/
+	for (i = 0; i < 16; i++) {
+		int bestdist = 0x7fffffff;
+		index[i] = 0;
+		for (j = 0; j < 16; j++) {
+			int dist = 0;
+			for (c = 0; c < 4; c++) {
+				const int d = (int) block[i * 4 + order[c]] - palette[j][c];
+				dist += d * d;
+			}
+			if (dist < bestdist) {
+				bestdist = dist;
+				index[i] = j;
+			}
+		}
+	}
+
+	/*	The most significant bit of the first index is implied zero.	*/
+	if (index[0] & 8) {
+		for (c = 0; c < 4; c++) {
+			const int t = q0[c];
+			q0[c] = q1[c];
+			q1[c] = t;
+		}
+		c = (unsigned int) p0;
+		p0 = p1;
+		p1 = (int) c;
+		for (i = 0; i < 16; i++)
+			index[i] = 15 - index[i];
+	}
+
+	memset(out, 0, 16);
+	swpWriteBits(out, &pos, 1 << 6, 7);
+	for (c = 0; c < 4; c++) {
+		swpWriteBits(out, &pos, (unsigned int) q0[c], 7);
+		swpWriteBits(out, &pos, (unsigned int) q1[c], 7);
+	}
+	swpWriteBits(out, &pos, (unsigned int) p0, 1);
+	swpWriteBits(out, &pos, (unsigned int) p1, 1);
+	swpWriteBits(out, &pos, index[0], 3);
+	for (i = 1; i < 16; i++)
+		swpWriteBits(out, &pos, index[i], 4);
+}
+
+void swpEncodeBC(const void *bgra, unsigned int width, unsigned int height,
+                 unsigned int rowbegin, unsigned int rowend, unsigned int format, void *blocks) {
+
+	const unsigned int numblockx = (width + 3) / 4;
+	const unsigned int blocksize = format == SWPK_FORMAT_BC1 ? 8 : 16;
+	unsigned char* out = (unsigned char *) blocks;
+	unsigned char block[64];
+	unsigned int bx, by;
+
+	for (by = rowbegin; by < rowend; by++) {
+		for (bx = 0; bx < numblockx; bx++) {
+			unsigned char* dst = &out[((size_t) by * numblockx + bx) * blocksize];
+
+			swpFetchBlock((const unsigned char *) bgra, width, height, bx, by, block);
+			if (format == SWPK_FORMAT_BC1) {
+				swpEncodeColorBlock(block, dst);
+			} else if (format == SWPK_FORMAT_BC7) {
+				swpEncodeBC7Block(block, dst);
+			} else {
+				swpEncodeAlphaBlock(block, dst);
+				swpEncodeColorBlock(block, dst + 8);
+			}
+		}
+	}
+}
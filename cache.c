@@ -0,0 +1,372 @@
+/**
+    Simple wallpaper program.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "wallpaper.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_atomic.h>
+
+/**
+ *	Decoded picture and its texture, addressed
+ *	by the hash of the picture file content.
+ */
+typedef struct swp_cache_entry_t{
+	Uint64 hash;                    /*	Content hash.	*/
+	swpTextureDesc desc;            /*	Full resolution picture, pixel is NULL if not resident.	*/
+	unsigned int hostrefs;          /*	Number of readers copying the pixel data.	*/
+	GLuint tex;                     /*	Texture, 0 if not resident.	*/
+	unsigned int texwidth;          /*	Texture width.	*/
+	unsigned int texheight;         /*	Texture height.	*/
+	size_t texsize;                 /*	Texture size in bytes.	*/
+	unsigned int refcount;          /*	Number of display slots and pending pictures using the texture.	*/
+	Uint32 lastuse;                 /*	LRU clock of last use.	*/
+}swpCacheEntry;
+
+size_t g_cachehost = 256 * 1024 * 1024;
+size_t g_cachegpu = 256 * 1024 * 1024;
+
+static SDL_SpinLock g_cacheinit = 0;
+static SDL_mutex* g_cachelock = NULL;
+static swpCacheEntry* g_cacheentries = NULL;
+static unsigned int g_numcacheentries = 0;
+static size_t g_cachehostused = 0;
+static size_t g_cachegpuused = 0;
+static Uint32 g_cacheclock = 0;
+
+static void swpLockCache(void) {
+
+	/*	Create the lock on first use.	*/
+	SDL_AtomicLock(&g_cacheinit);
+	if (g_cachelock == NULL)
+		g_cachelock = SDL_CreateMutex();
+	SDL_AtomicUnlock(&g_cacheinit);
+
+	SDL_LockMutex(g_cachelock);
+}
+
+static swpCacheEntry *swpFindCacheEntry(Uint64 hash) {
+
+	unsigned int i;
+
+	for (i = 0; i < g_numcacheentries; i++) {
+		if (g_cacheentries[i].hash == hash)
+			return &g_cacheentries[i];
+	}
+	return NULL;
+}
+
+static swpCacheEntry *swpAddCacheEntry(Uint64 hash) {
+
+	swpCacheEntry* entries;
+	swpCacheEntry* entry;
+
+	entries = realloc(g_cacheentries, (g_numcacheentries + 1) * sizeof(swpCacheEntry));
+	if (entries == NULL)
+		return NULL;
+	g_cacheentries = entries;
+
+	entry = &g_cacheentries[g_numcacheentries++];
+	memset(entry, 0, sizeof(*entry));
+	entry->hash = hash;
+	entry->lastuse = ++g_cacheclock;
+	return entry;
+}
+
+static void swpRemoveEmptyCacheEntry(swpCacheEntry *entry) {
+
+	/*	Remove the entry when neither the picture nor texture is resident.	*/
+	if (entry->desc.pixel == NULL && entry->tex == 0 && entry->hostrefs == 0) {
+		*entry = g_cacheentries[g_numcacheentries - 1];
+		g_numcacheentries--;
+	}
+}
+
+static void swpEvictCachePixels(size_t size) {
+
+	while (g_cachehostused + size > g_cachehost) {
+		swpCacheEntry* victim = NULL;
+		unsigned int i;
+
+		for (i = 0; i < g_numcacheentries; i++) {
+			swpCacheEntry* entry = &g_cacheentries[i];
+			if (entry->desc.pixel != NULL && entry->hostrefs == 0 &&
+			    (victim == NULL || entry->lastuse < victim->lastuse))
+				victim = entry;
+		}
+		if (victim == NULL)
+			break;
+
+		free(victim->desc.pixel);
+		victim->desc.pixel = NULL;
+		g_cachehostused -= victim->desc.size;
+		swpRemoveEmptyCacheEntry(victim);
+	}
+}
+
+static void swpEvictCacheTextures(void) {
+
+	while (g_cachegpuused > g_cachegpu) {
+		swpCacheEntry* victim = NULL;
+		unsigned int i;
+
+		for (i = 0; i < g_numcacheentries; i++) {
+			swpCacheEntry* entry = &g_cacheentries[i];
+			if (entry->tex != 0 && entry->refcount == 0 && (victim == NULL || entry->lastuse < victim->lastuse))
+				victim = entry;
+		}
+		if (victim == NULL)
+			break;
+
+		swpTrackVRAM(SWP_VRAM_TEXTURE, victim->tex, 0);
+		glDeleteTextures(1, &victim->tex);
+		victim->tex = 0;
+		g_cachegpuused -= victim->texsize;
+		swpRemoveEmptyCacheEntry(victim);
+	}
+}
+
+int swpCacheLookup(Uint64 hash, swpTextureDesc *desc) {
+
+	swpCacheEntry* entry;
+	const void* pixel;
+	void* copy;
+	size_t size;
+	unsigned int width, height, srcwidth, srcheight, full;
+	int status = 0;
+
+	swpLockCache();
+	entry = swpFindCacheEntry(hash);
+	if (entry == NULL) {
+		SDL_UnlockMutex(g_cachelock);
+		return 0;
+	}
+	entry->lastuse = ++g_cacheclock;
+
+	/*	Size the texture would have been uploaded with now.	*/
+	width = entry->desc.width;
+	height = entry->desc.height;
+	if (g_prescale != SWP_FILTER_NONE && entry->desc.bpp == 4 && entry->desc.imgdatatype == GL_UNSIGNED_BYTE)
+		swpGetPrescaleSize(entry->desc.width, entry->desc.height, &width, &height);
+	full = width == entry->desc.width && height == entry->desc.height;
+
+	if (entry->tex != 0 && entry->texwidth == width && entry->texheight == height) {
+
+		/*	Resident texture is displayed without upload, pinned until consumed.	*/
+		entry->refcount++;
+		*desc = entry->desc;
+		desc->pixel = NULL;
+		desc->width = width;
+		desc->height = height;
+		desc->size = width * height * entry->desc.bpp;
+		desc->hash = hash;
+		status = 1;
+
+		/*	Prescaled picture needs the full resolution picture to rescale.	*/
+		if (full || entry->desc.pixel == NULL) {
+			SDL_UnlockMutex(g_cachelock);
+			return status;
+		}
+	} else if (entry->desc.pixel != NULL) {
+		*desc = entry->desc;
+		desc->hash = hash;
+		status = 2;
+	} else {
+		SDL_UnlockMutex(g_cachelock);
+		return 0;
+	}
+
+	/*	Copy the pixel data without holding the lock, the reference prevents eviction.	*/
+	pixel = entry->desc.pixel;
+	size = entry->desc.size;
+	srcwidth = entry->desc.width;
+	srcheight = entry->desc.height;
+	entry->hostrefs++;
+	SDL_UnlockMutex(g_cachelock);
+
+	copy = malloc(size);
+	if (copy != NULL)
+		memcpy(copy, pixel, size);
+
+	swpLockCache();
+	entry = swpFindCacheEntry(hash);
+	entry->hostrefs--;
+	SDL_UnlockMutex(g_cachelock);
+
+	if (status == 1) {
+		desc->source = copy;
+		desc->srcwidth = srcwidth;
+		desc->srcheight = srcheight;
+	} else {
+		desc->pixel = copy;
+		status = copy != NULL ? 2 : 0;
+	}
+
+	return status;
+}
+
+void swpCacheInsert(Uint64 hash, const swpTextureDesc *desc) {
+
+	swpCacheEntry* entry;
+	swpTextureDesc full = *desc;
+	void* copy;
+
+	/*	Keep the full resolution picture of prescaled pictures.	*/
+	if (desc->source != NULL) {
+		full.pixel = desc->source;
+		full.width = desc->srcwidth;
+		full.height = desc->srcheight;
+		full.size = desc->srcwidth * desc->srcheight * desc->bpp;
+	}
+	if (full.size > g_cachehost)
+		return;
+
+	copy = malloc(full.size);
+	if (copy == NULL)
+		return;
+	memcpy(copy, full.pixel, full.size);
+	full.pixel = copy;
+	full.source = NULL;
+	full.animation = NULL;
+	full.tiled = NULL;
+
+	swpLockCache();
+	entry = swpFindCacheEntry(hash);
+	if (entry != NULL && entry->desc.pixel != NULL) {
+		SDL_UnlockMutex(g_cachelock);
+		free(copy);
+		return;
+	}
+
+	swpEvictCachePixels(full.size);
+	entry = swpFindCacheEntry(hash);
+	if (entry == NULL)
+		entry = swpAddCacheEntry(hash);
+	if (entry == NULL) {
+		SDL_UnlockMutex(g_cachelock);
+		free(copy);
+		return;
+	}
+	entry->desc = full;
+	entry->desc.hash = hash;
+	g_cachehostused += full.size;
+	SDL_UnlockMutex(g_cachelock);
+}
+
+int swpCacheSetTexture(Uint64 hash, GLuint tex, const swpTextureDesc *desc) {
+
+	swpCacheEntry* entry;
+	unsigned int numlevels;
+
+	if (g_cachegpu == 0)
+		return 0;
+
+	swpLockCache();
+	entry = swpFindCacheEntry(hash);
+	if (entry == NULL) {
+		entry = swpAddCacheEntry(hash);
+		if (entry == NULL) {
+			SDL_UnlockMutex(g_cachelock);
+			return 0;
+		}
+		entry->desc = *desc;
+		entry->desc.pixel = NULL;
+		entry->desc.source = NULL;
+		entry->desc.animation = NULL;
+		entry->desc.tiled = NULL;
+		if (desc->source != NULL) {
+			entry->desc.width = desc->srcwidth;
+			entry->desc.height = desc->srcheight;
+			entry->desc.size = desc->srcwidth * desc->srcheight * desc->bpp;
+		}
+	}
+
+	/*	Texture still displayed, the new texture is not shared.	*/
+	if (entry->tex != 0 && entry->refcount > 0) {
+		SDL_UnlockMutex(g_cachelock);
+		return 0;
+	}
+	if (entry->tex != 0) {
+		swpTrackVRAM(SWP_VRAM_TEXTURE, entry->tex, 0);
+		glDeleteTextures(1, &entry->tex);
+		g_cachegpuused -= entry->texsize;
+	}
+
+	/*	Size from the internal format, compressed pictures have no bpp.	*/
+	entry->tex = tex;
+	entry->texwidth = desc->width;
+	entry->texheight = desc->height;
+	numlevels = desc->numlevels > 0 ? desc->numlevels
+	          : desc->animation != NULL ? 1 : swpGetMipLevelCount(desc->width, desc->height);
+	entry->texsize = swpGetVRAMSize(desc->intfor, desc->width, desc->height, numlevels);
+	entry->refcount = 1;
+	entry->lastuse = ++g_cacheclock;
+	g_cachegpuused += entry->texsize;
+
+	swpEvictCacheTextures();
+	SDL_UnlockMutex(g_cachelock);
+
+	return 1;
+}
+
+GLuint swpCacheGetTexture(Uint64 hash) {
+
+	swpCacheEntry* entry;
+	GLuint tex = 0;
+
+	swpLockCache();
+	entry = swpFindCacheEntry(hash);
+	if (entry != NULL)
+		tex = entry->tex;
+	SDL_UnlockMutex(g_cachelock);
+
+	return tex;
+}
+
+void swpCacheReleaseTexture(Uint64 hash) {
+
+	swpCacheEntry* entry;
+
+	swpLockCache();
+	entry = swpFindCacheEntry(hash);
+	if (entry != NULL && entry->refcount > 0)
+		entry->refcount--;
+	swpEvictCacheTextures();
+	SDL_UnlockMutex(g_cachelock);
+}
+
+void swpReleaseCache(void) {
+
+	unsigned int i;
+
+	swpLockCache();
+	for (i = 0; i < g_numcacheentries; i++) {
+		if (g_cacheentries[i].tex != 0) {
+			swpTrackVRAM(SWP_VRAM_TEXTURE, g_cacheentries[i].tex, 0);
+			glDeleteTextures(1, &g_cacheentries[i].tex);
+		}
+		free(g_cacheentries[i].desc.pixel);
+	}
+	free(g_cacheentries);
+	g_cacheentries = NULL;
+	g_numcacheentries = 0;
+	g_cachehostused = 0;
+	g_cachegpuused = 0;
+	SDL_UnlockMutex(g_cachelock);
+}
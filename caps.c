@@ -0,0 +1,218 @@
+/**
+    Simple wallpaper application.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "wallpaper.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ *	Extension name in the open addressing set,
+ *	an empty slot has a NULL name.
+ */
+typedef struct swp_extension_slot_t{
+	Uint64 hash;                    /*	Hash of the name.	*/
+	char* name;                     /*	*/
+}swpExtensionSlot;
+
+int g_support_buffer_storage = 0;
+int g_support_texture_storage = 0;
+int g_support_dsa = 0;
+int g_support_timer_query = 0;
+int g_support_sync = 0;
+int g_support_bptc = 0;
+int g_glversion = 0;
+
+static swpExtensionSlot* g_extensions = NULL;
+static unsigned int g_extensionmask = 0;        /*	Number of slots minus one, power of two.	*/
+static unsigned int g_numextensions = 0;
+
+static Uint64 swpHashExtension(const char *name, size_t len) {
+
+	swpHashState state;
+
+	swpHashInit(&state);
+	swpHashUpdate(&state, name, len);
+	return swpHashDigest(&state);
+}
+
+static void swpAddExtension(const char *name, size_t len) {
+
+	const Uint64 hash = swpHashExtension(name, len);
+	unsigned int i = (unsigned int) hash & g_extensionmask;
+
+	/*	Linear probing, the set is never more than half full.	*/
+	while (g_extensions[i].name != NULL) {
+		if (g_extensions[i].hash == hash && strncmp(g_extensions[i].name, name, len) == 0 &&
+		    g_extensions[i].name[len] == '\0')
+			return;
+		i = (i + 1) & g_extensionmask;
+	}
+	g_extensions[i].hash = hash;
+	g_extensions[i].name = malloc(len + 1);
+	if (g_extensions[i].name == NULL)
+		return;
+	memcpy(g_extensions[i].name, name, len);
+	g_extensions[i].name[len] = '\0';
+	g_numextensions++;
+}
+
+static void swpEnumerateExtensions(void) {
+
+	PFNGLGETSTRINGIPROC glGetStringi;
+	const char* extensions = NULL;
+	const char* end;
+	GLint count = 0;
+	unsigned int size = 16;
+	int i;
+
+	/*	Indexed extension strings, the only way in the core profile.	*/
+	glGetStringi = (PFNGLGETSTRINGIPROC) SDL_GL_GetProcAddress("glGetStringi");
+	if (glGetStringi != NULL)
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	glGetError();
+	if (count <= 0) {
+		glGetStringi = NULL;
+		extensions = (const char *) glGetString(GL_EXTENSIONS);
+		for (end = extensions; end != NULL && *end != '\0'; end++)
+			count += *end == ' ';
+		count++;
+	}
+
+	while (size < (unsigned int) count * 2)
+		size *= 2;
+	g_extensions = calloc(size, sizeof(swpExtensionSlot));
+	if (g_extensions == NULL)
+		return;
+	g_extensionmask = size - 1;
+
+	if (glGetStringi != NULL) {
+		for (i = 0; i < count; i++) {
+			const char* name = (const char *) glGetStringi(GL_EXTENSIONS, (GLuint) i);
+			if (name != NULL)
+				swpAddExtension(name, strlen(name));
+		}
+	} else if (extensions != NULL) {
+
+		/*	Space separated legacy extension string.	*/
+		while (*extensions != '\0') {
+			end = strchr(extensions, ' ');
+			if (end == NULL)
+				end = extensions + strlen(extensions);
+			if (end > extensions)
+				swpAddExtension(extensions, (size_t) (end - extensions));
+			extensions = *end == ' ' ? end + 1 : end;
+		}
+	}
+}
+
+unsigned int swpCheckExtensionSupported(const char *extension) {
+
+	const size_t len = strlen(extension);
+	const Uint64 hash = swpHashExtension(extension, len);
+	unsigned int i;
+
+	if (g_extensions == NULL)
+		swpEnumerateExtensions();
+	if (g_extensions == NULL)
+		return 0;
+
+	/*	Exact match, a prefix of another extension name is not supported.	*/
+	for (i = (unsigned int) hash & g_extensionmask; g_extensions[i].name != NULL; i = (i + 1) & g_extensionmask) {
+		if (g_extensions[i].hash == hash && strcmp(g_extensions[i].name, extension) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+void swpProbeCapabilities(void) {
+
+	GLint major = 0, minor = 0;
+	GLint profile = 0;
+	const char* version;
+
+	/*	Function pointers, extensions and limits are queried once per context.	*/
+	swpLoadGLFunc();
+	if (g_extensions == NULL)
+		swpEnumerateExtensions();
+
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	if (glGetError() != GL_NO_ERROR || major == 0) {
+		version = (const char *) glGetString(GL_VERSION);
+		if (version != NULL)
+			sscanf(version, "%d.%d", &major, &minor);
+	}
+	g_glversion = major * 10 + minor;
+
+	glGetIntegerv(GL_CONTEXT_PROFILE_MASK, &profile);
+	glGetError();
+	g_core_profile = (profile & GL_CONTEXT_CORE_PROFILE_BIT) != 0;
+
+	/*	Limits.	*/
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &g_maxtexsize);
+
+	/*	Fast paths, either core in the context version or provided as extension.	*/
+	g_support_pbo = g_glversion >= 21 || swpCheckExtensionSupported("GL_ARB_pixel_buffer_object");
+	g_support_s3tc = swpCheckExtensionSupported("GL_EXT_texture_compression_s3tc") &&
+	                 glCompressedTexImage2DARB != NULL;
+	g_support_bptc = (g_glversion >= 42 || swpCheckExtensionSupported("GL_ARB_texture_compression_bptc")) &&
+	                 glCompressedTexImage2DARB != NULL;
+	g_support_sync = (g_glversion >= 32 || swpCheckExtensionSupported("GL_ARB_sync")) &&
+	                 glFenceSync != NULL && glClientWaitSync != NULL && glDeleteSync != NULL;
+	g_support_timer_query = g_glversion >= 33 || swpCheckExtensionSupported("GL_ARB_timer_query");
+	g_support_texture_storage = (g_glversion >= 42 || swpCheckExtensionSupported("GL_ARB_texture_storage")) &&
+	                            glTexStorage2D != NULL && glCompressedTexSubImage2DARB != NULL;
+	g_support_buffer_storage = (g_glversion >= 44 || swpCheckExtensionSupported("GL_ARB_buffer_storage")) &&
+	                           glBufferStorage != NULL && glMapBufferRange != NULL;
+	g_support_dsa = (g_glversion >= 45 || swpCheckExtensionSupported("GL_ARB_direct_state_access")) &&
+	                g_support_texture_storage && glCreateTextures != NULL && glTextureStorage2D != NULL &&
+	                glTextureSubImage2D != NULL && glCompressedTextureSubImage2D != NULL &&
+	                glTextureParameteri != NULL && glGenerateTextureMipmap != NULL &&
+	                glGetTextureParameteriv != NULL && glGetTextureLevelParameteriv != NULL;
+
+	/*	Cache linked programs, if the driver supports at least one binary format.	*/
+	if ((g_glversion >= 41 || swpCheckExtensionSupported("GL_ARB_get_program_binary")) &&
+	    glGetProgramBinary != NULL && glProgramBinary != NULL && glProgramParameteri != NULL) {
+		GLint numformats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numformats);
+		g_support_progbinary = numformats > 0;
+	}
+	g_support_parallel_compile = (swpCheckExtensionSupported("GL_KHR_parallel_shader_compile") ||
+	                              swpCheckExtensionSupported("GL_ARB_parallel_shader_compile")) &&
+	                             glMaxShaderCompilerThreadsKHR != NULL;
+
+	swpVerbosePrintf("OpenGL %d.%d %s profile, %d extensions, max texture size %d.\n", major, minor,
+	                 g_core_profile ? "core" : "compatibility", g_numextensions, g_maxtexsize);
+	swpVerbosePrintf("pbo %d, s3tc %d, bptc %d, sync %d, timer query %d, texture storage %d, buffer storage %d, "
+	                 "dsa %d, program binary %d, parallel compile %d.\n", g_support_pbo, g_support_s3tc, g_support_bptc,
+	                 g_support_sync, g_support_timer_query, g_support_texture_storage, g_support_buffer_storage,
+	                 g_support_dsa, g_support_progbinary, g_support_parallel_compile);
+}
+
+void swpReleaseCapabilities(void) {
+
+	unsigned int i;
+
+	for (i = 0; g_extensions != NULL && i <= g_extensionmask; i++)
+		free(g_extensions[i].name);
+	free(g_extensions);
+	g_extensions = NULL;
+	g_extensionmask = 0;
+	g_numextensions = 0;
+}
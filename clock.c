@@ -0,0 +1,132 @@
+/**
+    Simple wallpaper application.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "wallpaper.h"
+
+#include <string.h>
+
+unsigned int g_fpscap = 0;
+
+void swpInitFrameClock(swpFrameClock *clock, SDL_Window *window) {
+
+	const Uint64 freq = SDL_GetPerformanceFrequency();
+	SDL_DisplayMode mode;
+	unsigned int periods;
+
+	memset(clock, 0, sizeof(*clock));
+	if (SDL_GetCurrentDisplayMode(SDL_max(SDL_GetWindowDisplayIndex(window), 0), &mode) == 0 && mode.refresh_rate > 0)
+		clock->vsync = freq / (Uint64) mode.refresh_rate;
+
+	/*	Capped frames are a whole number of refreshes, the swap then presents them evenly.	*/
+	if (g_fpscap > 0) {
+		if (clock->vsync > 0) {
+			periods = SDL_max(((unsigned int) mode.refresh_rate + g_fpscap / 2) / g_fpscap, 1);
+			clock->interval = clock->vsync * periods;
+		} else
+			clock->interval = freq / g_fpscap;
+	}
+	swpVerbosePrintf("Frame clock, %d Hz refresh, %.2f ms frame interval.\n", clock->vsync > 0 ? mode.refresh_rate : 0,
+	                 (double) clock->interval * 1000.0 / (double) freq);
+}
+
+void swpStartFrameClock(swpFrameClock *clock) {
+
+	const Uint64 now = SDL_GetPerformanceCounter();
+
+	clock->start = now;
+	clock->last = now;
+	clock->next = now + clock->interval;
+	memset(&clock->transition, 0, sizeof(clock->transition));
+}
+
+/**
+ *	@Return counter from which the next frame is rendered, half a
+ *	refresh early so the swap presents it on the due refresh.
+ */
+static Uint64 swpGetFrameDue(const swpFrameClock *clock) {
+
+	if (clock->interval == 0)
+		return 0;
+	return clock->next - SDL_min(clock->vsync / 2, clock->next);
+}
+
+int swpIsFrameDue(const swpFrameClock *clock) {
+
+	return SDL_GetPerformanceCounter() >= swpGetFrameDue(clock);
+}
+
+unsigned int swpGetFrameTimeout(const swpFrameClock *clock) {
+
+	const Uint64 now = SDL_GetPerformanceCounter();
+	const Uint64 due = swpGetFrameDue(clock);
+	const Uint64 freq = SDL_GetPerformanceFrequency();
+
+	/*	Rounded up, waking up early would spin until the frame is due.	*/
+	if (now >= due)
+		return 0;
+	return (unsigned int) (((due - now) * 1000 + freq - 1) / freq);
+}
+
+/**
+ *	Add the frame time to the statistics.
+ */
+static void swpAddFrameStats(swpFrameStats *stats, Uint64 delta, Uint64 target) {
+
+	stats->numframes++;
+	stats->sum += delta;
+	stats->max = SDL_max(stats->max, delta);
+	if (target > 0 && delta > target + target / 2)
+		stats->numlate++;
+}
+
+float swpTickFrameClock(swpFrameClock *clock) {
+
+	const Uint64 now = SDL_GetPerformanceCounter();
+	const Uint64 delta = now - clock->last;
+	const Uint64 target = clock->interval > 0 ? clock->interval : clock->vsync;
+
+	swpAddFrameStats(&clock->transition, delta, target);
+	swpAddFrameStats(&clock->total, delta, target);
+	clock->last = now;
+
+	/*	Missed frames are dropped rather than rendered in a burst.	*/
+	clock->next += clock->interval;
+	if (clock->next <= now)
+		clock->next = now + clock->interval;
+
+	/*	Elapsed from the start, not accumulated from the frame times.	*/
+	return (float) ((double) (now - clock->start) / (double) SDL_GetPerformanceFrequency());
+}
+
+/**
+ *	Print the statistics of the frames.
+ */
+static void swpPrintFrameStatsOf(const char *name, const swpFrameStats *stats) {
+
+	const double freq = (double) SDL_GetPerformanceFrequency();
+	const double mean = stats->numframes > 0 ? (double) stats->sum * 1000.0 / freq / stats->numframes : 0.0;
+
+	fprintf(stderr, "%s %d frames, mean %.2f ms, max %.2f ms, %d late.\n", name, stats->numframes, mean,
+	        (double) stats->max * 1000.0 / freq, stats->numlate);
+}
+
+void swpPrintFrameStats(const swpFrameClock *clock) {
+
+	swpPrintFrameStatsOf("Last transition", &clock->transition);
+	swpPrintFrameStatsOf("All transitions", &clock->total);
+}
@@ -0,0 +1,139 @@
+/**
+    Simple wallpaper application.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "wallpaper.h"
+#include "swpk.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define SWP_COMPRESS_BAND 8     /*	Block rows encoded by each task.	*/
+#define SWP_COMPRESS_ALIGNMENT 16
+
+/**
+ *	Level encode job shared by the tasks.
+ */
+typedef struct swp_compress_job_t{
+	const unsigned char* pixel;     /*	BGRA level.	*/
+	unsigned char* blocks;          /*	*/
+	unsigned int width;             /*	*/
+	unsigned int height;            /*	*/
+	unsigned int format;            /*	SWPK_FORMAT_*.	*/
+}swpCompressJob;
+
+static void swpCompressTask(void *userdata, unsigned int index) {
+
+	const swpCompressJob* job = (const swpCompressJob *) userdata;
+	const unsigned int numblocky = (job->height + 3) / 4;
+
+	swpEncodeBC(job->pixel, job->width, job->height, index * SWP_COMPRESS_BAND,
+	            SDL_min((index + 1) * SWP_COMPRESS_BAND, numblocky), job->format, job->blocks);
+}
+
+static int swpHasAlpha(const unsigned char *pixel, size_t numpixels) {
+
+	size_t i;
+
+	for (i = 0; i < numpixels; i++) {
+		if (pixel[i * 4 + 3] != 255)
+			return 1;
+	}
+	return 0;
+}
+
+int swpCompressTexture(swpTextureDesc *desc) {
+
+	swpTextureLevel levels[SWP_MAX_TEXTURE_LEVELS];
+	const unsigned char* pixel = (const unsigned char *) desc->pixel;
+	unsigned char* blocks;
+	swpCompressJob job;
+	unsigned int format, numlevels, i;
+	size_t size = 0;
+
+	if (g_compression == SWP_COMPRESSION_NONE || !g_support_s3tc || pixel == NULL || desc->compressed ||
+	    desc->animation != NULL || desc->tiled != NULL || desc->bpp != 4 ||
+	    desc->imgdatatype != GL_UNSIGNED_BYTE || desc->format != GL_BGRA)
+		return 0;
+
+	/*	Levels built by swpBuildMipmaps, otherwise only the base level.	*/
+	numlevels = SDL_max(desc->numlevels, 1);
+	if (desc->numlevels == 0) {
+		desc->levels[0].width = desc->width;
+		desc->levels[0].height = desc->height;
+		desc->levels[0].offset = 0;
+	}
+
+	/*	BC1 for opaque pictures, BC7 or BC3 if the alpha channel is used.	*/
+	if (!swpHasAlpha(&pixel[desc->levels[0].offset], (size_t) desc->width * desc->height))
+		format = SWPK_FORMAT_BC1;
+	else if (g_support_bptc && g_compression != SWP_COMPRESSION_BC3)
+		format = SWPK_FORMAT_BC7;
+	else
+		format = SWPK_FORMAT_BC3;
+
+	for (i = 0; i < numlevels; i++) {
+		levels[i].width = desc->levels[i].width;
+		levels[i].height = desc->levels[i].height;
+		levels[i].offset = size;
+		levels[i].size = swpGetBCSize(levels[i].width, levels[i].height, format);
+		size += (levels[i].size + SWP_COMPRESS_ALIGNMENT - 1) & ~((size_t) SWP_COMPRESS_ALIGNMENT - 1);
+	}
+
+	blocks = malloc(size);
+	if (blocks == NULL) {
+		fprintf(stderr, "Failed to allocate %zu bytes, %s.\n", size, strerror(errno));
+		return 0;
+	}
+
+	/*	Encode each level on the task pool.	*/
+	for (i = 0; i < numlevels; i++) {
+		job.pixel = &pixel[desc->levels[i].offset];
+		job.blocks = &blocks[levels[i].offset];
+		job.width = levels[i].width;
+		job.height = levels[i].height;
+		job.format = format;
+		swpParallelFor(((levels[i].height + 3) / 4 + SWP_COMPRESS_BAND - 1) / SWP_COMPRESS_BAND, swpCompressTask, &job);
+	}
+
+	swpVerbosePrintf("Compressed %dx%d to %s, %d levels, %zu bytes.\n", desc->width, desc->height,
+	                 format == SWPK_FORMAT_BC1 ? "BC1" : format == SWPK_FORMAT_BC7 ? "BC7" : "BC3", numlevels, size);
+
+	/*	Texture description of the compressed levels.	*/
+	swpReleasePixel(desc->pixel);
+	memcpy(desc->levels, levels, sizeof(levels[0]) * numlevels);
+	desc->pixel = blocks;
+	desc->size = (unsigned int) size;
+	desc->numlevels = numlevels;
+	desc->compressed = 1;
+	desc->alignment = 4;
+	desc->bpp = 0;
+	switch (format) {
+		case SWPK_FORMAT_BC1:
+			desc->intfor = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+			break;
+		case SWPK_FORMAT_BC7:
+			desc->intfor = GL_COMPRESSED_RGBA_BPTC_UNORM;
+			break;
+		default:
+			desc->intfor = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+			break;
+	}
+
+	return 1;
+}
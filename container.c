@@ -0,0 +1,541 @@
+/**
+    Simple wallpaper application.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#define _POSIX_C_SOURCE 200809L
+#include "wallpaper.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SWP_DDS_HEADER_SIZE 128     /*	Magic and DDS_HEADER.	*/
+#define SWP_DDS_DX10_SIZE 20        /*	DDS_HEADER_DXT10.	*/
+#define SWP_KTX_HEADER_SIZE 64      /*	*/
+#define SWP_KTX2_HEADER_SIZE 80     /*	Header and section index, followed by the level index.	*/
+
+static const unsigned char gc_ktx_magic[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+static const unsigned char gc_ktx2_magic[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+/**
+ *	Texel format of a container.
+ */
+typedef struct swp_container_format_t{
+	GLenum intfor;              /*	Internal format.	*/
+	GLenum format;              /*	Input format of uncompressed texels, 0 if block compressed.	*/
+	unsigned int blocksize;     /*	Bytes per 4x4 block, or per texel if uncompressed.	*/
+	const char* name;           /*	*/
+}swpContainerFormat;
+
+static const swpContainerFormat gc_format_bc1 = {GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 0, 8, "BC1"};
+static const swpContainerFormat gc_format_bc1a = {GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, 0, 8, "BC1"};
+static const swpContainerFormat gc_format_bc2 = {GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, 0, 16, "BC2"};
+static const swpContainerFormat gc_format_bc3 = {GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 0, 16, "BC3"};
+static const swpContainerFormat gc_format_bc7 = {GL_COMPRESSED_RGBA_BPTC_UNORM, 0, 16, "BC7"};
+static const swpContainerFormat gc_format_rgba = {GL_RGBA, GL_RGBA, 4, "RGBA8"};
+static const swpContainerFormat gc_format_bgra = {GL_RGBA, GL_BGRA, 4, "BGRA8"};
+static const swpContainerFormat gc_format_bgrx = {GL_RGB, GL_BGRA, 4, "BGRX8"};
+
+static Uint32 swpReadU32(const unsigned char *p) {
+
+	Uint32 v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static Uint64 swpReadU64(const unsigned char *p) {
+
+	Uint64 v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+int swpIsTextureContainer(const void *prefix, size_t len) {
+
+	return (len >= 4 && memcmp(prefix, "DDS ", 4) == 0) ||
+	       (len >= sizeof(gc_ktx_magic) && memcmp(prefix, gc_ktx_magic, sizeof(gc_ktx_magic)) == 0) ||
+	       (len >= sizeof(gc_ktx2_magic) && memcmp(prefix, gc_ktx2_magic, sizeof(gc_ktx2_magic)) == 0);
+}
+
+static size_t swpGetLevelSize(unsigned int width, unsigned int height, const swpContainerFormat *format) {
+
+	if (format->format != 0)
+		return (size_t) width * height * format->blocksize;
+	return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * format->blocksize;
+}
+
+/**
+ *	Read the whole container, regular files are mapped
+ *	copy-on-write so the levels can be flipped in place.
+ */
+static unsigned char *swpReadContainer(int fd, const void *prefix, size_t prefixlen, size_t *size, int *mapped) {
+
+	unsigned char* data;
+	unsigned char* tmp;
+	struct stat st;
+	size_t capacity;
+	ssize_t n;
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (size_t) st.st_size >= prefixlen) {
+		*size = (size_t) st.st_size;
+		*mapped = 1;
+		data = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			fprintf(stderr, "Failed to map texture container, %s.\n", strerror(errno));
+			return NULL;
+		}
+		return data;
+	}
+
+	/*	Pipes are read until the end of the stream.	*/
+	*mapped = 0;
+	*size = prefixlen;
+	capacity = SDL_max(prefixlen, (size_t) 1024 * 1024);
+	data = malloc(capacity);
+	if (data == NULL) {
+		fprintf(stderr, "Failed to allocate %zu bytes, %s.\n", capacity, strerror(errno));
+		return NULL;
+	}
+	memcpy(data, prefix, prefixlen);
+	for (;;) {
+		if (*size == capacity) {
+			if (capacity >= UINT_MAX / 2) {
+				fprintf(stderr, "Texture container exceeds %u bytes.\n", UINT_MAX / 2);
+				free(data);
+				return NULL;
+			}
+			tmp = realloc(data, capacity * 2);
+			if (tmp == NULL) {
+				fprintf(stderr, "Failed to allocate %zu bytes, %s.\n", capacity * 2, strerror(errno));
+				free(data);
+				return NULL;
+			}
+			data = tmp;
+			capacity *= 2;
+		}
+		n = read(fd, &data[*size], capacity - *size);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			fprintf(stderr, "Error reading texture container, %s.\n", strerror(errno));
+			free(data);
+			return NULL;
+		}
+		if (n == 0)
+			break;
+		*size += (size_t) n;
+	}
+	return data;
+}
+
+/**
+ *	Check the orientation key of the key/value data,
+ *	KTX writes "S=r,T=u" and KTX2 "ru" for bottom-up rows.
+ *
+ *	@Return non-zero if the rows are top-down, the default.
+ */
+static int swpIsKTXTopDown(const unsigned char *kvd, size_t len) {
+
+	size_t offset = 0;
+	Uint32 entrylen;
+
+	while (offset + 4 <= len) {
+		entrylen = swpReadU32(&kvd[offset]);
+		offset += 4;
+		if (entrylen > len - offset)
+			break;
+		if (entrylen > 15 && memcmp(&kvd[offset], "KTXorientation", 15) == 0) {
+			const char* value = (const char *) &kvd[offset + 15];
+			const size_t valuelen = entrylen - 15;
+			return !(memchr(value, 'u', valuelen) != NULL);
+		}
+		offset += (entrylen + 3) & ~(size_t) 3;
+	}
+	return 1;
+}
+
+static const swpContainerFormat *swpGetDXGIFormat(Uint32 dxgi) {
+
+	switch (dxgi) {
+		case 71:    /*	DXGI_FORMAT_BC1_UNORM.	*/
+		case 72:    /*	DXGI_FORMAT_BC1_UNORM_SRGB.	*/
+			return &gc_format_bc1a;
+		case 74:    /*	DXGI_FORMAT_BC2_UNORM.	*/
+		case 75:
+			return &gc_format_bc2;
+		case 77:    /*	DXGI_FORMAT_BC3_UNORM.	*/
+		case 78:
+			return &gc_format_bc3;
+		case 98:    /*	DXGI_FORMAT_BC7_UNORM.	*/
+		case 99:
+			return &gc_format_bc7;
+		case 28:    /*	DXGI_FORMAT_R8G8B8A8_UNORM.	*/
+		case 29:
+			return &gc_format_rgba;
+		case 87:    /*	DXGI_FORMAT_B8G8R8A8_UNORM.	*/
+		case 91:
+			return &gc_format_bgra;
+		case 88:    /*	DXGI_FORMAT_B8G8R8X8_UNORM.	*/
+		case 93:
+			return &gc_format_bgrx;
+		default:
+			return NULL;
+	}
+}
+
+/**
+ *	Parse DirectDraw surface, levels follow the
+ *	header in order, rows are always top-down.
+ *
+ *	@Return offset of the first level, 0 on failure.
+ */
+static size_t swpParseDDS(const unsigned char *data, size_t size, swpTextureDesc *desc,
+                          const swpContainerFormat **format, unsigned int *numlevels) {
+
+	const unsigned char* header = &data[4];
+	Uint32 pfflags, fourcc, rmask, bmask, amask;
+	size_t offset = SWP_DDS_HEADER_SIZE;
+
+	if (size < SWP_DDS_HEADER_SIZE || swpReadU32(&header[0]) != 124) {
+		fprintf(stderr, "Invalid DDS header.\n");
+		return 0;
+	}
+	desc->height = swpReadU32(&header[8]);
+	desc->width = swpReadU32(&header[12]);
+	*numlevels = swpReadU32(&header[4]) & 0x20000 ? swpReadU32(&header[24]) : 1;
+	if (swpReadU32(&header[108]) & (0x200 | 0x200000)) {
+		fprintf(stderr, "DDS cube maps and volume textures are not supported.\n");
+		return 0;
+	}
+
+	pfflags = swpReadU32(&header[76]);
+	fourcc = swpReadU32(&header[80]);
+	rmask = swpReadU32(&header[88]);
+	bmask = swpReadU32(&header[96]);
+	amask = swpReadU32(&header[100]);
+	*format = NULL;
+	if ((pfflags & 0x4) && memcmp(&header[80], "DX10", 4) == 0) {
+		if (size < SWP_DDS_HEADER_SIZE + SWP_DDS_DX10_SIZE || swpReadU32(&data[132]) != 3 ||
+		    (swpReadU32(&data[136]) & 0x4) || swpReadU32(&data[140]) > 1) {
+			fprintf(stderr, "Only single 2D DDS textures are supported.\n");
+			return 0;
+		}
+		*format = swpGetDXGIFormat(swpReadU32(&data[128]));
+		offset += SWP_DDS_DX10_SIZE;
+	} else if (pfflags & 0x4) {
+		if (memcmp(&fourcc, "DXT1", 4) == 0)
+			*format = pfflags & 0x1 ? &gc_format_bc1a : &gc_format_bc1;
+		else if (memcmp(&fourcc, "DXT2", 4) == 0 || memcmp(&fourcc, "DXT3", 4) == 0)
+			*format = &gc_format_bc2;
+		else if (memcmp(&fourcc, "DXT4", 4) == 0 || memcmp(&fourcc, "DXT5", 4) == 0)
+			*format = &gc_format_bc3;
+	} else if ((pfflags & 0x40) && swpReadU32(&header[84]) == 32) {
+		const int alpha = (pfflags & 0x1) && amask == 0xFF000000;
+		if (rmask == 0x00FF0000 && bmask == 0x000000FF)
+			*format = alpha ? &gc_format_bgra : &gc_format_bgrx;
+		else if (rmask == 0x000000FF && bmask == 0x00FF0000 && alpha)
+			*format = &gc_format_rgba;
+	}
+	if (*format == NULL) {
+		fprintf(stderr, "Unsupported DDS pixel format.\n");
+		return 0;
+	}
+	return offset;
+}
+
+/**
+ *	Parse KTX 1, each level is prefixed with its size
+ *	and padded to 4 bytes.
+ *
+ *	@Return non-zero if successfully.
+ */
+static int swpParseKTX(const unsigned char *data, size_t size, swpTextureDesc *desc,
+                       const swpContainerFormat **format, unsigned int *numlevels, int *topdown) {
+
+	Uint32 gltype, glformat, glintfor, kvdlen;
+	size_t offset;
+	unsigned int i;
+
+	if (size < SWP_KTX_HEADER_SIZE || swpReadU32(&data[12]) != 0x04030201) {
+		fprintf(stderr, "Invalid or big endian KTX header.\n");
+		return 0;
+	}
+	gltype = swpReadU32(&data[16]);
+	glformat = swpReadU32(&data[24]);
+	glintfor = swpReadU32(&data[28]);
+	desc->width = swpReadU32(&data[36]);
+	desc->height = swpReadU32(&data[40]);
+	if (swpReadU32(&data[44]) > 0 || swpReadU32(&data[48]) > 0 || swpReadU32(&data[52]) != 1) {
+		fprintf(stderr, "Only single 2D KTX textures are supported.\n");
+		return 0;
+	}
+	*numlevels = SDL_max(swpReadU32(&data[56]), 1);
+	kvdlen = swpReadU32(&data[60]);
+	if (kvdlen > size - SWP_KTX_HEADER_SIZE) {
+		fprintf(stderr, "Invalid KTX key/value data.\n");
+		return 0;
+	}
+	*topdown = swpIsKTXTopDown(&data[SWP_KTX_HEADER_SIZE], kvdlen);
+
+	*format = NULL;
+	switch (glintfor) {
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+			*format = &gc_format_bc1;
+			break;
+		case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+			*format = &gc_format_bc1a;
+			break;
+		case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+			*format = &gc_format_bc2;
+			break;
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+			*format = &gc_format_bc3;
+			break;
+		case GL_COMPRESSED_RGBA_BPTC_UNORM:
+		case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+			*format = &gc_format_bc7;
+			break;
+		case GL_RGBA8:
+		case GL_SRGB8_ALPHA8:
+		case GL_RGBA:
+			if (gltype == GL_UNSIGNED_BYTE && glformat == GL_RGBA)
+				*format = &gc_format_rgba;
+			else if (gltype == GL_UNSIGNED_BYTE && glformat == GL_BGRA)
+				*format = &gc_format_bgra;
+			break;
+		default:
+			break;
+	}
+	if (*format == NULL) {
+		fprintf(stderr, "Unsupported KTX internal format 0x%x.\n", glintfor);
+		return 0;
+	}
+
+	/*	Walk the size prefixed levels.	*/
+	offset = SWP_KTX_HEADER_SIZE + kvdlen;
+	*numlevels = SDL_min(*numlevels, SWP_MAX_TEXTURE_LEVELS);
+	for (i = 0; i < *numlevels; i++) {
+		if (offset + 4 > size) {
+			fprintf(stderr, "KTX level %d exceeds the file size.\n", i);
+			return 0;
+		}
+		desc->levels[i].size = swpReadU32(&data[offset]);
+		desc->levels[i].offset = offset + 4;
+		offset += 4 + ((desc->levels[i].size + 3) & ~(size_t) 3);
+	}
+	return 1;
+}
+
+static const swpContainerFormat *swpGetVkFormat(Uint32 vkformat) {
+
+	switch (vkformat) {
+		case 131:   /*	VK_FORMAT_BC1_RGB_UNORM_BLOCK.	*/
+		case 132:
+			return &gc_format_bc1;
+		case 133:   /*	VK_FORMAT_BC1_RGBA_UNORM_BLOCK.	*/
+		case 134:
+			return &gc_format_bc1a;
+		case 135:   /*	VK_FORMAT_BC2_UNORM_BLOCK.	*/
+		case 136:
+			return &gc_format_bc2;
+		case 137:   /*	VK_FORMAT_BC3_UNORM_BLOCK.	*/
+		case 138:
+			return &gc_format_bc3;
+		case 145:   /*	VK_FORMAT_BC7_UNORM_BLOCK.	*/
+		case 146:
+			return &gc_format_bc7;
+		case 37:    /*	VK_FORMAT_R8G8B8A8_UNORM.	*/
+		case 43:
+			return &gc_format_rgba;
+		case 44:    /*	VK_FORMAT_B8G8R8A8_UNORM.	*/
+		case 50:
+			return &gc_format_bgra;
+		default:
+			return NULL;
+	}
+}
+
+/**
+ *	Parse KTX 2, levels are located by the
+ *	level index. Supercompression is not supported.
+ *
+ *	@Return non-zero if successfully.
+ */
+static int swpParseKTX2(const unsigned char *data, size_t size, swpTextureDesc *desc,
+                        const swpContainerFormat **format, unsigned int *numlevels, int *topdown) {
+
+	Uint32 kvdoffset, kvdlen;
+	unsigned int i;
+
+	if (size < SWP_KTX2_HEADER_SIZE) {
+		fprintf(stderr, "Invalid KTX2 header.\n");
+		return 0;
+	}
+	*format = swpGetVkFormat(swpReadU32(&data[12]));
+	if (*format == NULL) {
+		fprintf(stderr, "Unsupported KTX2 format %d.\n", swpReadU32(&data[12]));
+		return 0;
+	}
+	desc->width = swpReadU32(&data[20]);
+	desc->height = swpReadU32(&data[24]);
+	if (swpReadU32(&data[28]) > 0 || swpReadU32(&data[32]) > 1 || swpReadU32(&data[36]) != 1) {
+		fprintf(stderr, "Only single 2D KTX2 textures are supported.\n");
+		return 0;
+	}
+	if (swpReadU32(&data[44]) != 0) {
+		fprintf(stderr, "KTX2 supercompression is not supported.\n");
+		return 0;
+	}
+	*numlevels = SDL_max(swpReadU32(&data[40]), 1);
+	if (SWP_KTX2_HEADER_SIZE + (size_t) *numlevels * 24 > size) {
+		fprintf(stderr, "Invalid KTX2 level index.\n");
+		return 0;
+	}
+
+	kvdoffset = swpReadU32(&data[56]);
+	kvdlen = swpReadU32(&data[60]);
+	*topdown = kvdoffset <= size && kvdlen <= size - kvdoffset ? swpIsKTXTopDown(&data[kvdoffset], kvdlen) : 1;
+
+	*numlevels = SDL_min(*numlevels, SWP_MAX_TEXTURE_LEVELS);
+	for (i = 0; i < *numlevels; i++) {
+		const unsigned char* entry = &data[SWP_KTX2_HEADER_SIZE + i * 24];
+		desc->levels[i].offset = (size_t) swpReadU64(&entry[0]);
+		desc->levels[i].size = (size_t) swpReadU64(&entry[8]);
+	}
+	return 1;
+}
+
+/**
+ *	Flip top-down uncompressed level to the
+ *	bottom-up order of OpenGL.
+ *
+ *	@Return non-zero if successfully.
+ */
+static int swpFlipLevel(unsigned char *pixel, const swpTextureLevel *level, const swpContainerFormat *format) {
+
+	const size_t rowpitch = (size_t) level->width * format->blocksize;
+	unsigned char* row;
+	unsigned int y;
+
+	row = malloc(rowpitch);
+	if (row == NULL)
+		return 0;
+	for (y = 0; y < level->height / 2; y++) {
+		memcpy(row, &pixel[y * rowpitch], rowpitch);
+		memcpy(&pixel[y * rowpitch], &pixel[(level->height - 1 - y) * rowpitch], rowpitch);
+		memcpy(&pixel[(level->height - 1 - y) * rowpitch], row, rowpitch);
+	}
+	free(row);
+	return 1;
+}
+
+ssize_t swpReadContainerFromfd(int fd, const void *prefix, size_t prefixlen, swpTextureDesc *desc) {
+
+	const swpContainerFormat* format = NULL;
+	unsigned char* data;
+	size_t size, offset = 0;
+	unsigned int numlevels = 0, i;
+	int mapped = 0, topdown = 1, status;
+
+	data = swpReadContainer(fd, prefix, prefixlen, &size, &mapped);
+	if (data == NULL)
+		return -1;
+
+	/*	Level layout of the container.	*/
+	if (memcmp(data, "DDS ", 4) == 0) {
+		offset = swpParseDDS(data, size, desc, &format, &numlevels);
+		status = offset > 0;
+		numlevels = SDL_min(numlevels, SWP_MAX_TEXTURE_LEVELS);
+		for (i = 0; status && i < numlevels; i++) {
+			desc->levels[i].offset = offset;
+			desc->levels[i].size = swpGetLevelSize(SDL_max(desc->width >> i, 1), SDL_max(desc->height >> i, 1), format);
+			offset += desc->levels[i].size;
+		}
+	} else if (memcmp(data, gc_ktx2_magic, sizeof(gc_ktx2_magic)) == 0) {
+		status = swpParseKTX2(data, size, desc, &format, &numlevels, &topdown);
+	} else {
+		status = swpParseKTX(data, size, desc, &format, &numlevels, &topdown);
+	}
+
+	/*	Validate the levels against the texel format.	*/
+	if (status && (desc->width == 0 || desc->height == 0 || desc->width > g_maxtexsize ||
+	               desc->height > g_maxtexsize || size > UINT_MAX)) {
+		fprintf(stderr, "Texture to big(limit %d), %dx%d.\n", g_maxtexsize, desc->width, desc->height);
+		status = 0;
+	}
+	for (i = 0; status && i < numlevels; i++) {
+		swpTextureLevel* level = &desc->levels[i];
+		level->width = SDL_max(desc->width >> i, 1);
+		level->height = SDL_max(desc->height >> i, 1);
+		if (level->size < swpGetLevelSize(level->width, level->height, format) || level->offset > size ||
+		    level->size > size - level->offset) {
+			fprintf(stderr, "Texture container level %d is truncated.\n", i);
+			status = 0;
+		}
+		level->size = swpGetLevelSize(level->width, level->height, format);
+	}
+	if (status && format->format == 0 && format->intfor == GL_COMPRESSED_RGBA_BPTC_UNORM && !g_support_bptc) {
+		fprintf(stderr, "Texture is BC7 compressed, GL_ARB_texture_compression_bptc is not supported.\n");
+		status = 0;
+	} else if (status && format->format == 0 && format->intfor != GL_COMPRESSED_RGBA_BPTC_UNORM && !g_support_s3tc) {
+		fprintf(stderr, "Texture is block compressed, GL_EXT_texture_compression_s3tc is not supported.\n");
+		status = 0;
+	}
+
+	/*	OpenGL expects bottom-up rows, block compressed levels are
+	 *	kept as they are and the picture is flipped when drawn.	*/
+	for (i = 0; status && topdown && format->format != 0 && i < numlevels; i++) {
+		if (!swpFlipLevel(&data[desc->levels[i].offset], &desc->levels[i], format)) {
+			fprintf(stderr, "Failed to flip the top-down texture.\n");
+			status = 0;
+		}
+	}
+
+	if (!status || (mapped && !swpAddPixelMapping(data, size))) {
+		if (mapped)
+			munmap(data, size);
+		else
+			free(data);
+		return -1;
+	}
+
+	/*	Texture description of the pre-built levels.	*/
+	desc->size = (unsigned int) size;
+	desc->pixel = data;
+	desc->format = format->format != 0 ? format->format : GL_BGRA;
+	desc->imgdatatype = GL_UNSIGNED_BYTE;
+	desc->intfor = format->intfor;
+	desc->alignment = 4;
+	desc->numlevels = numlevels;
+	desc->compressed = format->format == 0;
+	desc->bpp = desc->compressed ? 0 : 4;
+	desc->topdown = topdown && desc->compressed;
+	swpVerbosePrintf("Texture container %dx%d, %s, %d levels%s.\n", desc->width, desc->height, format->name,
+	                 numlevels, !topdown ? "" : desc->compressed ? ", top-down" : ", flipped");
+
+	return (ssize_t) size;
+}
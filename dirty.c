@@ -0,0 +1,292 @@
+/**
+    Simple wallpaper application.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#define _POSIX_C_SOURCE 200809L
+#include "wallpaper.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <SDL2/SDL_events.h>
+
+#define SWP_DIRTY_MAGIC "SWPD"
+#define SWP_DIRTY_VERSION 1
+#define SWP_DIRTY_MAX_RECTS 4096
+
+/**
+ *	Dirty update message header, followed by \numrects
+ *	rectangles, each followed by its top-down BGRA pixels.
+ */
+typedef struct swp_dirty_header_t{
+	char magic[4];                  /*	SWP_DIRTY_MAGIC.	*/
+	Uint32 version;                 /*	SWP_DIRTY_VERSION.	*/
+	Uint64 frameid;                 /*	XXH64 of the picture file the update applies to, 0 for the displayed picture.	*/
+	Uint32 numrects;                /*	*/
+	Uint32 reserved;                /*	*/
+}swpDirtyHeader;
+
+/**
+ *	Rectangle in picture coordinates, origin at the top left.
+ */
+typedef struct swp_dirty_rect_header_t{
+	Uint32 x;                       /*	*/
+	Uint32 y;                       /*	*/
+	Uint32 width;                   /*	*/
+	Uint32 height;                  /*	*/
+}swpDirtyRectHeader;
+
+/**
+ *	Read \len bytes, consuming the bytes already read first.
+ */
+static int swpReadDirty(int fd, const unsigned char **prefix, size_t *prefixlen, void *dst, size_t len) {
+
+	unsigned char* buf = (unsigned char *) dst;
+	const size_t n = SDL_min(*prefixlen, len);
+	ssize_t r;
+
+	memcpy(buf, *prefix, n);
+	*prefix += n;
+	*prefixlen -= n;
+	buf += n;
+	len -= n;
+	while (len > 0) {
+		r = read(fd, buf, len);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return 0;
+		buf += r;
+		len -= (size_t) r;
+	}
+	return 1;
+}
+
+static void swpFreeDirtyUpdate(swpDirtyUpdate *update) {
+
+	unsigned int i;
+
+	for (i = 0; i < update->numrects; i++)
+		free(update->rects[i].pixel);
+	free(update->rects);
+	free(update);
+}
+
+ssize_t swpReadDirtyFromfd(int fd, const void *prefix, size_t prefixlen) {
+
+	const unsigned char* pre = (const unsigned char *) prefix;
+	swpDirtyHeader header;
+	swpDirtyRectHeader rect;
+	swpDirtyUpdate* update;
+	SDL_Event event = {0};
+	ssize_t total = sizeof(header);
+	unsigned int i, row;
+
+	if (!swpReadDirty(fd, &pre, &prefixlen, &header, sizeof(header)) || header.version != SWP_DIRTY_VERSION ||
+	    header.numrects == 0 || header.numrects > SWP_DIRTY_MAX_RECTS) {
+		fprintf(stderr, "Invalid dirty update header.\n");
+		return -1;
+	}
+
+	update = calloc(1, sizeof(*update));
+	if (update == NULL)
+		return -1;
+	update->frameid = header.frameid;
+	update->rects = calloc(header.numrects, sizeof(swpDirtyRect));
+	if (update->rects == NULL) {
+		free(update);
+		return -1;
+	}
+
+	for (i = 0; i < header.numrects; i++) {
+		swpDirtyRect* dirty = &update->rects[i];
+		size_t pitch;
+
+		if (!swpReadDirty(fd, &pre, &prefixlen, &rect, sizeof(rect)) || rect.width == 0 || rect.height == 0 ||
+		    rect.width > (Uint32) g_maxtexsize || rect.height > (Uint32) g_maxtexsize) {
+			fprintf(stderr, "Invalid dirty rectangle %d.\n", i);
+			swpFreeDirtyUpdate(update);
+			return -1;
+		}
+		pitch = (size_t) rect.width * 4;
+		dirty->pixel = malloc(pitch * rect.height);
+		if (dirty->pixel == NULL) {
+			fprintf(stderr, "Failed to allocate %zu bytes, %s.\n", pitch * rect.height, strerror(errno));
+			swpFreeDirtyUpdate(update);
+			return -1;
+		}
+		update->numrects++;
+		dirty->x = rect.x;
+		dirty->y = rect.y;
+		dirty->width = rect.width;
+		dirty->height = rect.height;
+
+		/*	Textures are bottom-up, the rows are stored in reverse order.	*/
+		for (row = 0; row < rect.height; row++) {
+			if (!swpReadDirty(fd, &pre, &prefixlen, &dirty->pixel[(rect.height - row - 1) * pitch], pitch)) {
+				fprintf(stderr, "Failed to read dirty rectangle %d.\n", i);
+				swpFreeDirtyUpdate(update);
+				return -1;
+			}
+		}
+		total += (ssize_t) (sizeof(rect) + pitch * rect.height);
+	}
+	swpVerbosePrintf("Dirty update of %d rectangles, %zd bytes.\n", update->numrects, total);
+
+	/*	Applied to the displayed texture by the main thread.	*/
+	event.type = SDL_USEREVENT;
+	event.user.code = SWP_EVENT_DIRTY_UPDATE;
+	event.user.data1 = update;
+	SDL_PushEvent(&event);
+
+	return total;
+}
+
+/**
+ *	Give the displayed slot a texture of its own, the
+ *	texture shared with the cache is left untouched.
+ */
+static int swpDetachDisplayedTexture(swpRenderingState *state, unsigned int slot, GLint width, GLint height,
+                                     GLint intfor) {
+
+	swpTextureDesc desc = {0};
+	GLuint tex = 0;
+
+	desc.width = (unsigned int) width;
+	desc.height = (unsigned int) height;
+	desc.bpp = 4;
+	desc.size = desc.width * desc.height * 4;
+	desc.intfor = intfor == GL_RGBA || intfor == GL_RGBA8 ? GL_RGBA : GL_RGB;
+	desc.format = GL_BGRA;
+	desc.imgdatatype = GL_UNSIGNED_BYTE;
+	desc.pixel = malloc(desc.size);
+	if (desc.pixel == NULL)
+		return 0;
+
+	/*	Once per picture, later updates are applied in place.	*/
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_BGRA, GL_UNSIGNED_BYTE, desc.pixel);
+	if (!swpLoadTextureFromMem(&tex, state->data.pbo[slot], &desc))
+		return 0;
+
+	swpCacheReleaseTexture(state->data.texhash[slot]);
+	state->data.texs[slot] = tex;
+	state->data.texhash[slot] = 0;
+	state->toTexIndex = tex;
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, tex);
+
+	return 1;
+}
+
+int swpApplyDirtyUpdate(swpRenderingState *state, swpDirtyUpdate *update) {
+
+	const unsigned int slot = (state->data.curtex - 1 + state->data.numtexs) % state->data.numtexs;
+	GLint width = 0, height = 0, intfor = 0, compressed = 0;
+	unsigned int picwidth, picheight;
+	unsigned int i, applied = 0;
+
+	/*	Only still pictures displayed at their own resolution are updated.	*/
+	if (state->stream != NULL || state->animation != NULL || state->tiled != NULL ||
+	    state->source.pixel != NULL) {
+		swpVerbosePrintf("Dirty update ignored, the displayed picture can not be updated.\n");
+		swpFreeDirtyUpdate(update);
+		return 0;
+	}
+	if (update->frameid != 0 && update->frameid != state->framehash) {
+		swpVerbosePrintf("Dirty update ignored, frame %llx is not displayed.\n", (unsigned long long) update->frameid);
+		swpFreeDirtyUpdate(update);
+		return 0;
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, state->data.texs[slot]);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &intfor);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+	if (compressed || (state->data.texhash[slot] != 0 &&
+	                   !swpDetachDisplayedTexture(state, slot, width, height, intfor))) {
+		swpVerbosePrintf("Dirty update ignored, the displayed texture can not be updated.\n");
+		swpFreeDirtyUpdate(update);
+		return 0;
+	}
+
+	/*	Rectangles are in picture coordinates, the texture may have been reduced to fit the VRAM budget.	*/
+	picwidth = state->picsize[0] > 0 ? state->picsize[0] : (unsigned int) width;
+	picheight = state->picsize[1] > 0 ? state->picsize[1] : (unsigned int) height;
+
+	/*	Only the changed rectangles are uploaded.	*/
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	for (i = 0; i < update->numrects; i++) {
+		const swpDirtyRect* rect = &update->rects[i];
+		unsigned int x0, y0, x1, y1;
+		unsigned char* scaled;
+
+		if (rect->width == 0 || rect->height == 0)
+			continue;
+		if (rect->width > picwidth || rect->x > picwidth - rect->width ||
+		    rect->height > picheight || rect->y > picheight - rect->height) {
+			fprintf(stderr, "Dirty rectangle %dx%d+%d+%d outside of the %dx%d picture.\n", rect->width,
+			        rect->height, rect->x, rect->y, picwidth, picheight);
+			continue;
+		}
+		if (picwidth == (unsigned int) width && picheight == (unsigned int) height) {
+			glTexSubImage2D(GL_TEXTURE_2D, 0, (GLint) rect->x, height - (GLint) (rect->y + rect->height),
+			                (GLsizei) rect->width, (GLsizei) rect->height, GL_BGRA, GL_UNSIGNED_BYTE, rect->pixel);
+			applied++;
+			continue;
+		}
+
+		/*	Texels covered by the rectangle in the reduced texture.	*/
+		x0 = (unsigned int) ((Uint64) rect->x * (Uint64) width / picwidth);
+		y0 = (unsigned int) ((Uint64) rect->y * (Uint64) height / picheight);
+		x1 = (unsigned int) (((Uint64) (rect->x + rect->width) * (Uint64) width + picwidth - 1) / picwidth);
+		y1 = (unsigned int) (((Uint64) (rect->y + rect->height) * (Uint64) height + picheight - 1) / picheight);
+		scaled = malloc((size_t) (x1 - x0) * (y1 - y0) * 4);
+		if (scaled == NULL || !swpScaleImage(rect->pixel, rect->width, rect->height, scaled, x1 - x0, y1 - y0,
+		                                     SWP_FILTER_LANCZOS3)) {
+			free(scaled);
+			continue;
+		}
+		glTexSubImage2D(GL_TEXTURE_2D, 0, (GLint) x0, height - (GLint) y1, (GLsizei) (x1 - x0), (GLsizei) (y1 - y0),
+		                GL_BGRA, GL_UNSIGNED_BYTE, scaled);
+		free(scaled);
+		applied++;
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	swpFreeDirtyUpdate(update);
+
+	/*	Mipmaps are regenerated once the updates have settled.	*/
+	state->mipdirty |= applied > 0;
+
+	return applied > 0;
+}
+
+void swpUpdateDirtyMipmaps(swpRenderingState *state) {
+
+	const unsigned int slot = (state->data.curtex - 1 + state->data.numtexs) % state->data.numtexs;
+
+	if (!state->mipdirty)
+		return;
+	state->mipdirty = 0;
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, state->data.texs[slot]);
+	glGenerateMipmap(GL_TEXTURE_2D);
+}
@@ -0,0 +1,148 @@
+/**
+    Simple wallpaper program.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "wallpaper.h"
+
+#include <string.h>
+#include <SDL2/SDL_endian.h>
+
+/*	XXH64 primes.	*/
+#define SWP_HASH_PRIME1 0x9E3779B185EBCA87ULL
+#define SWP_HASH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define SWP_HASH_PRIME3 0x165667B19E3779F9ULL
+#define SWP_HASH_PRIME4 0x85EBCA77C2B2AE63ULL
+#define SWP_HASH_PRIME5 0x27D4EB2F165667C5ULL
+
+static Uint64 swpHashRotl(Uint64 x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+static Uint64 swpHashRead64(const unsigned char *p) {
+	Uint64 v;
+	memcpy(&v, p, sizeof(v));
+	return SDL_SwapLE64(v);
+}
+
+static Uint32 swpHashRead32(const unsigned char *p) {
+	Uint32 v;
+	memcpy(&v, p, sizeof(v));
+	return SDL_SwapLE32(v);
+}
+
+static Uint64 swpHashRound(Uint64 acc, Uint64 input) {
+	acc += input * SWP_HASH_PRIME2;
+	acc = swpHashRotl(acc, 31);
+	return acc * SWP_HASH_PRIME1;
+}
+
+static Uint64 swpHashMergeRound(Uint64 acc, Uint64 val) {
+	acc ^= swpHashRound(0, val);
+	return acc * SWP_HASH_PRIME1 + SWP_HASH_PRIME4;
+}
+
+void swpHashInit(swpHashState *state) {
+	memset(state, 0, sizeof(*state));
+	state->v[0] = SWP_HASH_PRIME1 + SWP_HASH_PRIME2;
+	state->v[1] = SWP_HASH_PRIME2;
+	state->v[2] = 0;
+	state->v[3] = 0 - SWP_HASH_PRIME1;
+}
+
+void swpHashUpdate(swpHashState *state, const void *data, size_t len) {
+
+	const unsigned char* p = (const unsigned char *) data;
+	const unsigned char* end = p + len;
+
+	state->total += len;
+
+	/*	Not enough for a stripe, keep it for the next update.	*/
+	if (state->memsize + len < 32) {
+		memcpy(&state->mem[state->memsize], p, len);
+		state->memsize += (unsigned int) len;
+		return;
+	}
+
+	/*	Complete the buffered stripe.	*/
+	if (state->memsize > 0) {
+		memcpy(&state->mem[state->memsize], p, 32 - state->memsize);
+		p += 32 - state->memsize;
+		state->v[0] = swpHashRound(state->v[0], swpHashRead64(&state->mem[0]));
+		state->v[1] = swpHashRound(state->v[1], swpHashRead64(&state->mem[8]));
+		state->v[2] = swpHashRound(state->v[2], swpHashRead64(&state->mem[16]));
+		state->v[3] = swpHashRound(state->v[3], swpHashRead64(&state->mem[24]));
+		state->memsize = 0;
+	}
+
+	/*	Stripes of 32 bytes.	*/
+	while (p + 32 <= end) {
+		state->v[0] = swpHashRound(state->v[0], swpHashRead64(&p[0]));
+		state->v[1] = swpHashRound(state->v[1], swpHashRead64(&p[8]));
+		state->v[2] = swpHashRound(state->v[2], swpHashRead64(&p[16]));
+		state->v[3] = swpHashRound(state->v[3], swpHashRead64(&p[24]));
+		p += 32;
+	}
+
+	if (p < end) {
+		memcpy(state->mem, p, (size_t) (end - p));
+		state->memsize = (unsigned int) (end - p);
+	}
+}
+
+Uint64 swpHashDigest(const swpHashState *state) {
+
+	const unsigned char* p = state->mem;
+	const unsigned char* end = p + state->memsize;
+	Uint64 h;
+
+	if (state->total >= 32) {
+		h = swpHashRotl(state->v[0], 1) + swpHashRotl(state->v[1], 7) +
+		    swpHashRotl(state->v[2], 12) + swpHashRotl(state->v[3], 18);
+		h = swpHashMergeRound(h, state->v[0]);
+		h = swpHashMergeRound(h, state->v[1]);
+		h = swpHashMergeRound(h, state->v[2]);
+		h = swpHashMergeRound(h, state->v[3]);
+	} else
+		h = SWP_HASH_PRIME5;
+	h += state->total;
+
+	/*	Remaining bytes.	*/
+	while (p + 8 <= end) {
+		h ^= swpHashRound(0, swpHashRead64(p));
+		h = swpHashRotl(h, 27) * SWP_HASH_PRIME1 + SWP_HASH_PRIME4;
+		p += 8;
+	}
+	if (p + 4 <= end) {
+		h ^= (Uint64) swpHashRead32(p) * SWP_HASH_PRIME1;
+		h = swpHashRotl(h, 23) * SWP_HASH_PRIME2 + SWP_HASH_PRIME3;
+		p += 4;
+	}
+	while (p < end) {
+		h ^= (*p) * SWP_HASH_PRIME5;
+		h = swpHashRotl(h, 11) * SWP_HASH_PRIME1;
+		p++;
+	}
+
+	/*	Avalanche.	*/
+	h ^= h >> 33;
+	h *= SWP_HASH_PRIME2;
+	h ^= h >> 29;
+	h *= SWP_HASH_PRIME3;
+	h ^= h >> 32;
+
+	return h;
+}
@@ -0,0 +1,109 @@
+/**
+    Simple wallpaper application.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "wallpaper.h"
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+unsigned int g_idlereclaim = 30;
+unsigned int g_idletrim = 0;
+
+void swpMarkActive(swpRenderingState *state) {
+
+	state->lastingest = SDL_GetTicks();
+	state->reclaimed = 0;
+}
+
+/**
+ *	@Return non-zero if the displayed content is
+ *	static and no resource is about to be used.
+ */
+static int swpIsIdle(const swpRenderingState *state) {
+
+	return g_idlereclaim > 0 && !state->reclaimed && !state->inTransition && !state->mipdirty &&
+	       state->stream == NULL && state->animation == NULL && state->sliced == NULL;
+}
+
+unsigned int swpGetIdleTimeout(const swpRenderingState *state) {
+
+	const Uint32 elapsed = SDL_GetTicks() - state->lastingest;
+	const Uint32 delay = g_idlereclaim * 1000;
+
+	if (!swpIsIdle(state))
+		return state->timeout;
+	return elapsed >= delay ? 0 : SDL_min(delay - elapsed, state->timeout);
+}
+
+void swpReclaimIdle(swpRenderingState *state) {
+
+	const int displayed = (state->data.curtex - 1 + state->data.numtexs) % state->data.numtexs;
+	size_t before;
+	unsigned int i;
+
+	if (!swpIsIdle(state) || SDL_GetTicks() - state->lastingest < g_idlereclaim * 1000)
+		return;
+	state->reclaimed = 1;
+	before = swpGetVRAMUsage();
+
+	/*	Slot textures other than the displayed are recreated by the next uploads.	*/
+	for (i = 0; i < state->data.numtexs; i++) {
+		if ((int) i == displayed || state->data.texs[i] == 0)
+			continue;
+		if (state->data.texhash[i] != 0) {
+			/*	Texture stays in the cache, within its budget.	*/
+			swpCacheReleaseTexture(state->data.texhash[i]);
+			state->data.texhash[i] = 0;
+		} else if (glIsTexture(state->data.texs[i]) == GL_TRUE) {
+			swpTrackVRAM(SWP_VRAM_TEXTURE, state->data.texs[i], 0);
+			glDeleteTextures(1, &state->data.texs[i]);
+		}
+		state->data.texs[i] = 0;
+	}
+	state->fromTexIndex = 0;
+
+	/*	Orphan the pixel buffers, their storage is specified again on each upload.	*/
+	if (g_support_pbo) {
+		for (i = 0; i < state->data.numtexs; i++) {
+			if (swpGetTrackedVRAM(SWP_VRAM_BUFFER, state->data.pbo[i]) == 0)
+				continue;
+			glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, state->data.pbo[i]);
+			glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0, NULL, GL_STREAM_DRAW_ARB);
+			swpTrackVRAM(SWP_VRAM_BUFFER, state->data.pbo[i], 0);
+		}
+		if (state->playlist != NULL && swpGetTrackedVRAM(SWP_VRAM_BUFFER, state->playlist->pbo) > 0) {
+			glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, state->playlist->pbo);
+			glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0, NULL, GL_STREAM_DRAW_ARB);
+			swpTrackVRAM(SWP_VRAM_BUFFER, state->playlist->pbo, 0);
+		}
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	}
+
+	/*	Upload ring is created again on the next picture.	*/
+	swpTrimUploadRing();
+
+	/*	Return the freed pages of the decoded pictures to the system.	*/
+#if defined(__GLIBC__)
+	if (g_idletrim)
+		malloc_trim(0);
+#endif
+
+	swpVerbosePrintf("Idle for %d seconds, reclaimed %zu KB of GPU memory.\n", g_idlereclaim,
+	                 (before - SDL_min(before, swpGetVRAMUsage())) / 1024);
+}
@@ -69,7 +69,8 @@ int main(int argc, char** argv){
 	int fd = 0;                     /*	*/
 	int pipe = 0;                   /*	*/
 	int fdfifo = 0;                 /*	*/
-	int64_t before;
+	int startupfds[3] = {-1, -1, -1};   /*	Pictures to load at startup.	*/
+	int numstartupfds = 0;
 
 	/*	*/
 	int numtranspaths = 0;
@@ -77,11 +78,15 @@ int main(int argc, char** argv){
 
 	/*	*/
 	int visible = 1;
+	int pendingshaders = 0;         /*	Transition shaders not yet linked or warmed up.	*/
+	int pendingsnapshot = 0;        /*	Snapshot read back in flight.	*/
+	swpTextureDesc* desc;           /*	Picture to display.	*/
+	swpPlaylistEntry* entry;        /*	Playlist picture to display, NULL if sent.	*/
 
 	/*	*/
-	swpTextureDesc desc = { 0 };
 	SDL_Event event = {0};          /*	*/
 	SDL_Thread* thread = NULL;      /*	*/
+	SDL_Thread* startupthread = NULL;   /*	*/
 	swpRenderingState state = {0};  /*	*/
 	SDL_Window* window = NULL;      /*	*/
 	SDL_GLContext* context = NULL;  /*	*/
@@ -96,7 +101,7 @@ int main(int argc, char** argv){
 	/*	*/
 	int c;
 	int index;
-	const char* shortopt = "vVdf:p:CwFbR:P:s:";
+	const char* shortopt = "vVdf:p:CwFbR:P:s:M:";
 	static struct option longoption[] = {
 		{"version",     no_argument, 		NULL, 'v'},	/*	Version of the application.	*/
 		{"verbose",     no_argument, 		NULL, 'V'},	/*	Enable verbose.	*/
@@ -104,7 +109,7 @@ int main(int argc, char** argv){
 		{"wallpaper",   no_argument,	 	NULL, 'w'},	/*	Set display as wallpaper.	*/
 		{"fullscreen",  no_argument, 		NULL, 'F'},	/*	Set as fullscreen.	*/
 		{"borderless",  no_argument, 		NULL, 'b'},	/*	Set window border less.*/
-		{"compression", optional_argument, 	NULL, 'C'},	/*	Enable compression or texture.	*/
+		{"compression", optional_argument, 	NULL, 'C'},	/*	Block compress textures, bc3 or bc7.	*/
 		{"fifo",        required_argument, 	NULL, 'p'},	/*	Path for the FIFO.	*/
 		{"resolution",  required_argument, 	NULL, 'R'},	/*	Set window resolution.	*/
 		{"position",    required_argument, 	NULL, 'P'},	/*	Set window position.	*/
@@ -113,12 +118,35 @@ int main(int argc, char** argv){
 		{"file",        required_argument,	NULL, 'f'},	/*	File to load picture from.	*/
 		{"filter",      required_argument,	NULL, 'B'},	/*	Filter.	*/
 		{"title",       required_argument,	NULL, 'T'},	/*	Override the title.	*/
+		{"frame-budget",required_argument,	NULL, 'M'},	/*	Memory budget in MB of pre-decoded animation frames.	*/
+		{"prescale",    optional_argument,	NULL, 'L'},	/*	Prescale pictures to the window resolution.	*/
+		{"prescale-cap",required_argument,	NULL, 'l'},	/*	Maximum prescaled resolution.	*/
+		{"tile-budget", required_argument,	NULL, 'm'},	/*	Memory budget in MB of tile textures.	*/
+		{"cache-host",  required_argument,	NULL, 'H'},	/*	Memory budget in MB of cached pictures.	*/
+		{"cache-gpu",   required_argument,	NULL, 'G'},	/*	Memory budget in MB of cached textures.	*/
+		{"shared-cache",required_argument,	NULL, 'k'},	/*	Memory budget in MB of the cross-process picture cache.	*/
+		{"startup-report",no_argument,		NULL, 'Z'},	/*	Print the startup timeline.	*/
+		{"playlist",    required_argument,	NULL, 'y'},	/*	File listing the pictures of a slideshow.	*/
+		{"interval",    required_argument,	NULL, 'I'},	/*	Seconds between the playlist pictures.	*/
+		{"shuffle",     no_argument,		NULL, 'u'},	/*	Play the playlist in random order.	*/
+		{"prefetch",    required_argument,	NULL, 'N'},	/*	Number of playlist pictures decoded ahead.	*/
+		{"upload-thread",no_argument,		NULL, 'U'},	/*	Upload pictures on a thread with a shared context.	*/
+		{"mipmap",      required_argument,	NULL, 'X'},	/*	Mipmap policy, none, auto or full.	*/
+		{"vram-budget", required_argument,	NULL, 'W'},	/*	Memory budget in MB of textures and buffers.	*/
+		{"idle-reclaim",required_argument,	NULL, 'E'},	/*	Seconds without ingest before releasing buffers.	*/
+		{"malloc-trim", no_argument,		NULL, 'K'},	/*	Trim the heap when idle.	*/
+		{"slice-budget",required_argument,	NULL, 'J'},	/*	Milliseconds of sliced uploads each frame.	*/
+		{"upload-path", required_argument,	NULL, 'Q'},	/*	Upload path, auto, direct, pbo or persistent.	*/
+		{"fps-cap",     required_argument,	NULL, 'O'},	/*	Frames per second of transitions.	*/
 
 		{"row",         required_argument, 	NULL, 'r'},
 		{"column",      required_argument, 	NULL, 'c'},
 		{NULL, 0, NULL, 0},
 	};
 
+	/*	Time base of the startup timeline.	*/
+	swpInitStartup();
+
 	while ((c = getopt_long(argc, argv, shortopt, longoption, &index)) != EOF) {
 		switch (c) {
 			case 'v':
@@ -141,7 +169,12 @@ int main(int argc, char** argv){
 				g_fullscreen = 1;
 				break;
 			case 'C':
-				g_compression = 1;
+				g_compression = SWP_COMPRESSION_AUTO;
+				if (optarg && strcmp(optarg, "bc3") == 0) {
+					g_compression = SWP_COMPRESSION_BC3;
+				} else if (optarg && strcmp(optarg, "bc7") != 0) {
+					fprintf(stderr, "Unknown compression %s, using bc7.\n", optarg);
+				}
 				break;
 			case 'R':
 				if (optarg) {
@@ -180,19 +213,147 @@ int main(int argc, char** argv){
 					ctitle = optarg;
 				}
 				break;
+			case 'M':
+				if (optarg) {
+					g_framebudget = (size_t) strtoul(optarg, NULL, 10) * 1024 * 1024;
+					swpVerbosePrintf("Animation frame budget %s MB.\n", optarg);
+				}
+				break;
+			case 'E':
+				if (optarg) {
+					g_idlereclaim = (unsigned int) strtoul(optarg, NULL, 10);
+				}
+				break;
+			case 'K':
+				g_idletrim = 1;
+				break;
+			case 'J':
+				if (optarg) {
+					g_slicebudget = (unsigned int) strtoul(optarg, NULL, 10);
+				}
+				break;
+			case 'W':
+				if (optarg) {
+					g_vrambudget = (size_t) strtoul(optarg, NULL, 10) * 1024 * 1024;
+					swpVerbosePrintf("VRAM budget %s MB.\n", optarg);
+				}
+				break;
+			case 'O':
+				if (optarg) {
+					g_fpscap = (unsigned int) strtoul(optarg, NULL, 10);
+				}
+				break;
+			case 'Q':
+				g_uploadpath = swpGetUploadPath(optarg);
+				if (g_uploadpath == (unsigned int) -1) {
+					fprintf(stderr, "Unknown upload path %s, using auto.\n", optarg);
+					g_uploadpath = SWP_UPLOAD_PATH_AUTO;
+				}
+				break;
+			case 'X':
+				if (strcmp(optarg, "none") == 0) {
+					g_mipmap = SWP_MIPMAP_NONE;
+				} else if (strcmp(optarg, "full") == 0) {
+					g_mipmap = SWP_MIPMAP_FULL;
+				} else if (strcmp(optarg, "auto") == 0) {
+					g_mipmap = SWP_MIPMAP_AUTO;
+				} else {
+					fprintf(stderr, "Unknown mipmap policy %s, using auto.\n", optarg);
+				}
+				break;
+			case 'L':
+				g_prescale = SWP_FILTER_LANCZOS3;
+				if (optarg && strcmp(optarg, "mitchell") == 0) {
+					g_prescale = SWP_FILTER_MITCHELL;
+				} else if (optarg && strcmp(optarg, "lanczos") != 0) {
+					fprintf(stderr, "Unknown prescale filter %s, using lanczos.\n", optarg);
+				}
+				break;
+			case 'm':
+				if (optarg) {
+					g_tilebudget = (size_t) strtoul(optarg, NULL, 10) * 1024 * 1024;
+					swpVerbosePrintf("Tile texture budget %s MB.\n", optarg);
+				}
+				break;
+			case 'H':
+				if (optarg) {
+					g_cachehost = (size_t) strtoul(optarg, NULL, 10) * 1024 * 1024;
+					swpVerbosePrintf("Picture cache budget %s MB.\n", optarg);
+				}
+				break;
+			case 'G':
+				if (optarg) {
+					g_cachegpu = (size_t) strtoul(optarg, NULL, 10) * 1024 * 1024;
+					swpVerbosePrintf("Texture cache budget %s MB.\n", optarg);
+				}
+				break;
+			case 'k':
+				if (optarg) {
+					g_sharedcache = (size_t) strtoul(optarg, NULL, 10) * 1024 * 1024;
+					swpVerbosePrintf("Shared picture cache budget %s MB.\n", optarg);
+				}
+				break;
+			case 'l':
+				if (optarg) {
+					g_prescale = g_prescale == SWP_FILTER_NONE ? SWP_FILTER_LANCZOS3 : g_prescale;
+					swpParseResolutionArgument(optarg, &g_prescalecap[0]);
+					swpVerbosePrintf("Prescale cap %dx%d.\n", g_prescalecap[0], g_prescalecap[1]);
+				}
+				break;
+			case 'Z':
+				g_startupreport = 1;
+				break;
+			case 'y':
+				if (optarg) {
+					g_playlistpath = optarg;
+				}
+				break;
+			case 'I':
+				if (optarg) {
+					g_playlistinterval = SDL_max(1, (unsigned int) strtoul(optarg, NULL, 10));
+					swpVerbosePrintf("Playlist interval %d seconds.\n", g_playlistinterval);
+				}
+				break;
+			case 'u':
+				g_playlistshuffle = 1;
+				break;
+			case 'N':
+				if (optarg) {
+					g_playlistprefetch = (unsigned int) strtoul(optarg, NULL, 10);
+				}
+				break;
+			case 'U':
+				g_uploadthread = 1;
+				break;
 			default:
 				break;
 		}
 	}
+	swpStartupMark("options parsed");
 
 	/*	Check if stdin is piped.	*/
 	if (isatty(STDIN_FILENO) == 0) {
 		pipe = 1;
 	}
 
+	/*	Initialize FreeImage and read the pictures from file and STDIN on a separate thread, while
+	 *	SDL and OpenGL are initialized. STDIN may be a continuous stream.	*/
+	if (fd > 0)
+		startupfds[numstartupfds++] = fd;
+	if (pipe == 1)
+		startupfds[numstartupfds++] = STDIN_FILENO;
+	startupthread = SDL_CreateThread((SDL_ThreadFunction) swpCatchStartupTexture,
+	                                 "catch_startup", startupfds);
+	if (startupthread == NULL) {
+		fprintf(stderr, "Failed to create thread, %s.\n", SDL_GetError());
+		FreeImage_Initialise(0);
+		swpSetStartupReady(SWP_STARTUP_FREEIMAGE);
+	}
+
 	/*	Signal.	*/
 	signal(SIGINT, swpCatchSignal);
 	signal(SIGTERM, swpCatchSignal);
+	signal(SIGUSR1, swpCatchSignal);
 	signal(SIGSEGV, swpCatchSignal);
 
 	/*	Create FIFO.	*/
@@ -209,9 +370,10 @@ int main(int argc, char** argv){
 		status = EXIT_FAILURE;
 		goto error;
 	}
+	swpStartupMark("fifo created");
 
 	/*	Initialize SDL.	*/
-	result = SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS);
+	result = SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS | SDL_INIT_TIMER);
 	SDL_SetHint(SDL_HINT_VIDEO_MINIMIZE_ON_FOCUS_LOSS, "0");
 	if (result != 0) {
 		fprintf(stderr, "Failed to initialize SDL, %s.\n", SDL_GetError());
@@ -219,9 +381,7 @@ int main(int argc, char** argv){
 		goto error;
 	}
 
-	/*	*/
-	FreeImage_Initialise(0);
-	swpVerbosePrintf("FreeImage version %s.\n", FreeImage_GetVersion());
+	swpStartupMark("sdl initialized");
 
 	/*	Set window resolution.	*/
 	if (g_winres[0] == -1 && g_winres[1] == -1) {
@@ -254,6 +414,7 @@ int main(int argc, char** argv){
 
 	/*	*/
 	SDL_ShowWindow(window);
+	swpStartupMark("window created");
 
 	/*  */
 	if (g_wallpaper == 1) {
@@ -309,6 +470,15 @@ int main(int argc, char** argv){
 		fprintf(stderr, "Failed to set OpenGL context current, %s.\n", SDL_GetError());
 		goto error;
 	}
+	SDL_GL_GetDrawableSize(window, &g_drawable[0], &g_drawable[1]);
+	swpStartupMark("gl context created");
+
+	/*	Query function pointers, extensions and limits once, and choose the fast paths.	*/
+	swpProbeCapabilities();
+
+	/*	Pictures read meanwhile can be decoded for the limits of the context.	*/
+	swpSetStartupReady(SWP_STARTUP_GL);
+	swpStartupMark("gl capabilities probed");
 
 	/*  Check if all required extension is supported.   */
 	for (i = 0; i < numMinReqExtensions; i++) {
@@ -318,10 +488,6 @@ int main(int argc, char** argv){
 		}
 	}
 
-	/*  */
-	glGetIntegerv(GL_CONTEXT_PROFILE_MASK, &g_core_profile);
-	g_core_profile = (g_core_profile & GL_CONTEXT_CORE_PROFILE_BIT) != 0;
-
 	/*	Create FIFO thread.	*/
 	thread = SDL_CreateThread((SDL_ThreadFunction) swpCatchPipedTexture,
 	                          "catch_pipe", &fdfifo);
@@ -352,13 +518,6 @@ int main(int argc, char** argv){
 	swpVerbosePrintf("GL_EXTENSION %s.\n", glGetString(GL_EXTENSIONS));
 	swpVerbosePrintf("GL_SHADING_LANGUAGE_VERSION %s.\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
 
-	/*	Check OpenGL limitations.	*/
-	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &g_maxtexsize);
-	swpVerbosePrintf("Max texture size %d.\n", g_maxtexsize);
-
-	/*	Load OpenGL functions.	*/
-	swpLoadGLFunc();
-
 	/*	Enable opengl debug callback if in debug mode.	*/
 	if (g_debug)
 		swpEnableDebug();
@@ -368,6 +527,8 @@ int main(int argc, char** argv){
 
 	/*	State.	*/
 	state.timeout = INT32_MAX;
+	swpMarkActive(&state);
+	swpInitFrameClock(&state.clock, window);
 
 	/*	Initialize rendering data.	*/
 	state.data.numtexs = SWP_NUM_TEXTURES;
@@ -383,59 +544,97 @@ int main(int argc, char** argv){
 	state.data.displayshader->prog = display_prog;
 	state.data.displayshader->elapse = 0;
 	state.data.displayshader->texloc0 = glGetUniformLocationARB(state.data.displayshader->prog, "tex0");
+	state.data.displayshader->fliploc = glGetUniformLocationARB(state.data.displayshader->prog, "flipv");
 	glUseProgram(state.data.displayshader->prog);
 	glUniform1iARB(state.data.displayshader->texloc0, 0);
 
-	/*	Load transition from file.	 */
-	if (numtranspaths > 0)
-		swpLoadTransitionShaders(&state, numtranspaths, (const char **) transfilepaths);
-	else
-		swpCreateDefaultTransitionShader(&state);
+	/*	Default transition, until the transitions from file have been compiled after the first frame.	 */
+	swpCreateDefaultTransitionShader(&state);
+	swpStartupMark("shaders created");
 
-	/*	Check if PBO is supported.	*/
-	g_support_pbo = swpCheckExtensionSupported("GL_ARB_pixel_buffer_object");
+	/*	Fastest upload path of the driver, measured on the first start.	*/
+	swpTuneUploadPath();
+	swpStartupMark("upload path chosen");
 
 	/*	Create Pixel buffer object.	*/
 	if (g_support_pbo)
 		glGenBuffersARB(state.data.numtexs, &state.data.pbo[0]);
 
-	/*	Load texture from file.	*/
-	if (fd > 0) {
-		swpTextureDesc desc = {0};
-		swpReadPicFromfd(fd, &desc);
-		event.user.code = 0;
-		event.type = SDL_USEREVENT;
-		event.user.data1 = (void *) &desc;
-		SDL_PushEvent(&event);
-		close(fd);
-	}
+	/*	Upload ring sized for a drawable sized picture with its mipmaps, grown for larger ones.	*/
+	if (g_uploadpath == SWP_UPLOAD_PATH_PERSISTENT)
+		swpCreateUploadRing((size_t) g_drawable[0] * g_drawable[1] * 4 * 4 / 3);
 
-	/*	Load texture from STDIN if piped.	*/
-	if (pipe == 1) {
+	/*	Display the last picture of the previous session before anything else is loaded,
+	 *	once the pixel buffers and the upload ring of the upload path exist.	*/
+	if (swpLoadSnapshot(&state)) {
+		swpRender(vao, window, &state);
+		swpStartupMark("snapshot presented");
+	}
 
-		swpReadPicFromfd(STDIN_FILENO, &desc);
+	/*	Upload and generate mipmaps on a separate thread, the render thread only binds complete textures.	*/
+	if (g_uploadthread)
+		swpCreateUploadThread(window, context);
 
-		event.user.code = 0;
-		event.type = SDL_USEREVENT;
-		event.user.data1 = (void *) &desc;
-		SDL_PushEvent(&event);
-	}
+	/*	Start decoding the slideshow pictures ahead.	*/
+	if (g_playlistpath != NULL)
+		swpCreatePlaylist(&state);
+	swpStartupMark("render loop entered");
 
 	/*	Initialize texture binding.	*/
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, state.data.texs[state.data.curtex]);
+	glBindTexture(GL_TEXTURE_2D, state.data.texs[(state.data.curtex - 1 + state.data.numtexs) % state.data.numtexs]);
 
 	/*	*/
 	while (g_alive != 0) {
 
-		/*	Wait intill incoming event.	*/
-		while (SDL_WaitEventTimeout(&event, state.timeout)) {
+		/*	Wait intill incoming event or the next transition frame, waking up while there is work left
+		 *	for idle time. Nothing wakes up a static wallpaper once its idle resources are released.	*/
+		while (SDL_WaitEventTimeout(&event, state.inTransition && visible ? swpGetFrameTimeout(&state.clock)
+		                                    : numtranspaths > 0 || pendingshaders || state.mipdirty || state.sliced != NULL ||
+		                                      pendingsnapshot ? SWP_IDLE_INTERVAL : swpGetIdleTimeout(&state))) {
 
 			switch(event.type){
 			case SDL_APP_TERMINATING:
 			case SDL_QUIT:
 				swpVerbosePrintf("Requested to quit.");
 				goto error;
+			case SDL_KEYDOWN:
+
+				/*	Pan and zoom pictures displayed as tiles.	*/
+				if (state.tiled != NULL) {
+					switch (event.key.keysym.sym) {
+					case SDLK_LEFT:
+						swpPanTiledImage(&state, -0.1f, 0.0f, 1.0f);
+						break;
+					case SDLK_RIGHT:
+						swpPanTiledImage(&state, 0.1f, 0.0f, 1.0f);
+						break;
+					case SDLK_UP:
+						swpPanTiledImage(&state, 0.0f, 0.1f, 1.0f);
+						break;
+					case SDLK_DOWN:
+						swpPanTiledImage(&state, 0.0f, -0.1f, 1.0f);
+						break;
+					case SDLK_PLUS:
+					case SDLK_EQUALS:
+					case SDLK_KP_PLUS:
+						swpPanTiledImage(&state, 0.0f, 0.0f, 1.25f);
+						break;
+					case SDLK_MINUS:
+					case SDLK_KP_MINUS:
+						swpPanTiledImage(&state, 0.0f, 0.0f, 0.8f);
+						break;
+					case SDLK_0:
+					case SDLK_HOME:
+						swpPanTiledImage(&state, 0.0f, 0.0f, 0.0f);
+						break;
+					default:
+						break;
+					}
+					if (visible)
+						swpRender(vao, window, &state);
+				}
+				break;
 			case SDL_KEYUP:
 				if(event.key.keysym.sym == SDLK_RETURN && ( event.key.keysym.mod & SDLK_LCTRL ) ){
 					swpVerbosePrintf("Set to fullscreen mode.\n");
@@ -455,6 +654,11 @@ int main(int argc, char** argv){
 					glScissor(0,0, event.window.data1, event.window.data2);
 					swpVerbosePrintf("viewport: %dx%d\n", event.window.data1, event.window.data2);
 
+					/*	Rescale the displayed picture to the new drawable size, displayed once uploaded.	*/
+					SDL_GL_GetDrawableSize(window, &g_drawable[0], &g_drawable[1]);
+					if (state.stream == NULL && state.animation == NULL)
+						swpRescaleTexture(&state);
+
 					/*	call draw.	*/
 					if(visible)
 						swpRender(vao, window, &state);
@@ -480,19 +684,108 @@ int main(int argc, char** argv){
 
 				break;
 			case SDL_USEREVENT:
+				if (event.user.code != SWP_EVENT_PRINT_STATS)
+					swpMarkActive(&state);
+
+				/*	Event for when the picture has been loaded from file to memory,
+				 *	or the next picture of the playlist is due and has been loaded ahead.	*/
+				entry = NULL;
+				if (event.user.code == SWP_EVENT_UPDATE_IMAGE ||
+				    (event.user.code == SWP_EVENT_PLAYLIST_NEXT && (entry = swpNextPlaylistEntry(&state)) != NULL)) {
+					desc = entry != NULL ? &entry->desc : (swpTextureDesc *) event.user.data1;
+
+					/*	Uploaded in bands over the next frames, the event is pushed again once complete.	*/
+					if (entry == NULL && swpBeginSlicedUpload(&state, desc))
+						break;
+
+					/*	Picture displayed at once supersedes the one not yet complete,
+					 *	a completed sliced upload may be promoted after a newer picture started.	*/
+					if (entry != NULL || desc->texture == 0)
+						swpReleaseSlicedUpload(&state);
+
+					/*	Image replaces the previous animation or the last frame of a previous stream.	*/
+					swpReleaseAnimation(&state);
+					swpReleaseTiledImage(&state);
+					if (state.data.planes[0] != 0) {
+						for (i = 0; i < 3; i++)
+							swpTrackVRAM(SWP_VRAM_TEXTURE, state.data.planes[i], 0);
+						glDeleteTextures(3, state.data.planes);
+						memset(state.data.planes, 0, sizeof(state.data.planes));
+					}
 
-				/*	Event for when the picture has been loaded from file to memory.	*/
-				if (event.user.code == SWP_EVENT_UPDATE_IMAGE) {
+					/*	Keep the full resolution picture for rescaling.	*/
+					swpSetPrescaleSource(&state, desc);
+					state.framehash = desc->hash;
+					state.picsize[0] = desc->width;
+					state.picsize[1] = desc->height;
+					state.mipdirty = 0;
+
+					/*	Slot no longer references the texture shared with the cache.	*/
+					if (state.data.texhash[state.data.curtex] != 0) {
+						swpCacheReleaseTexture(state.data.texhash[state.data.curtex]);
+						state.data.texs[state.data.curtex] = 0;
+						state.data.texhash[state.data.curtex] = 0;
+					}
 
-					/*	*/
-					swpLoadTextureFromMem(&state.data.texs[state.data.curtex],
-					                      state.data.pbo[state.data.curtex],
-					                      (swpTextureDesc *) event.user.data1);
+					if (desc->texture != 0) {
+
+						/*	Texture uploaded ahead takes the place of the slot texture.	*/
+						if (glIsTexture(state.data.texs[state.data.curtex]) == GL_TRUE) {
+							swpTrackVRAM(SWP_VRAM_TEXTURE, state.data.texs[state.data.curtex], 0);
+							glDeleteTextures(1, &state.data.texs[state.data.curtex]);
+						}
+						state.data.texs[state.data.curtex] = desc->texture;
+						desc->texture = 0;
+						if (desc->hash != 0 &&
+						    swpCacheSetTexture(desc->hash, state.data.texs[state.data.curtex], desc))
+							state.data.texhash[state.data.curtex] = desc->hash;
+					} else if (desc->pixel == NULL && desc->hash != 0) {
+
+						/*	Texture is still resident, pinned by the cache lookup.	*/
+						state.data.texs[state.data.curtex] = swpCacheGetTexture(desc->hash);
+						state.data.texhash[state.data.curtex] = desc->hash;
+					} else {
+
+						/*	The pixel data is only released by a successful upload, the full
+						 *	resolution picture is owned by the prescale source.	*/
+						if (!swpLoadTextureFromMem(&state.data.texs[state.data.curtex],
+						                           state.data.pbo[state.data.curtex], desc)) {
+							swpReleasePixel(desc->pixel);
+							swpSetPrescaleSource(&state, NULL);
+							desc->pixel = NULL;
+							desc->source = NULL;
+						} else if (desc->hash != 0 &&
+						           swpCacheSetTexture(desc->hash, state.data.texs[state.data.curtex], desc)) {
+
+							/*	Share the texture with the cache for when the picture is sent again.	*/
+							state.data.texhash[state.data.curtex] = desc->hash;
+						}
+					}
+					state.data.topdown[state.data.curtex] = desc->topdown;
 					state.data.curtex = (state.data.curtex + 1) % state.data.numtexs;
-					glFinish();
 
-					/*	Set transition state.	*/
-					if (state.data.numshaders > 1) {
+					/*	Submit the upload, the upload ring fences the slot instead of draining the GPU.	*/
+					glFlush();
+
+					/*	Display as tiles if the picture is larger than the max texture size.	*/
+					state.tiled = desc->tiled;
+
+					/*	Start playback if the picture is the first frame of an animation.	*/
+					if (desc->animation != NULL) {
+						swpBeginAnimation(&state, desc->animation,
+						                  state.data.texs[(state.data.curtex - 1 + state.data.numtexs) %
+						                                  state.data.numtexs]);
+					}
+
+					/*	Decode the next playlist picture into the entry.	*/
+					if (entry != NULL)
+						swpConsumePlaylistEntry(&state, entry);
+
+					/*	Set transition state, transition shaders sample both pictures at the same
+					 *	coordinates, pictures of opposite row order are switched without it.	*/
+					if (swpGetTransitionShader(&state) != NULL &&
+					    state.data.topdown[(state.data.curtex - 1 + state.data.numtexs) % state.data.numtexs] ==
+					    state.data.topdown[(state.data.curtex - 2 + state.data.numtexs) % state.data.numtexs]) {
 						state.elapseTransition = 0.0f;
 						state.inTransition = 1;
 
@@ -511,28 +804,67 @@ int main(int argc, char** argv){
 						glBindTexture(GL_TEXTURE_2D, state.fromTexIndex);
 
 						/*	Init timer for transition shader.	*/
-						before = SDL_GetPerformanceCounter();
+						swpStartFrameClock(&state.clock);
 
-					} else if (event.user.code == SWP_EVENT_UPDATE_TRANSITION) {
+					} else {
 
 						/*	*/
 						glActiveTexture(GL_TEXTURE0);
-						glBindTexture(GL_TEXTURE_2D, state.data.texs[state.data.curtex]);
+						glBindTexture(GL_TEXTURE_2D, state.data.texs[(state.data.curtex - 1 + state.data.numtexs) %
+						                                             state.data.numtexs]);
 					}
 
 					/*	Update window.	*/
 					if (visible) {
 						swpRender(vao, window, &state);
 					}
-				} else {
-					/*	Update the elapse transition time in seconds.	*/
-					state.elapseTransition += (float) (SDL_GetPerformanceCounter() - (float) before) /
-					                          (float) SDL_GetPerformanceFrequency();
 
-					/*	Update window.	*/
-					if (visible) {
+					swpPrintStartupReport("first picture presented");
+
+					/*	Persist the picture for the next start.	*/
+					swpSaveSnapshot();
+				} else if (event.user.code == SWP_EVENT_UPDATE_STREAM) {
+
+					/*	Stream started or ended.	*/
+					if (event.user.data1 != NULL) {
+						swpReleaseSlicedUpload(&state);
+						swpReleaseAnimation(&state);
+						swpSetPrescaleSource(&state, NULL);
+						swpReleaseTiledImage(&state);
+						swpBeginStream(&state, (swpYUVStream *) event.user.data1);
+					} else
+						swpEndStream(&state, (swpYUVStream *) event.user.data2);
+				} else if (event.user.code == SWP_EVENT_STREAM_FRAME) {
+
+					/*	Upload newest frame and display it.	*/
+					if (event.user.data1 == state.stream && swpUpdateStream(&state) && visible) {
+						swpRender(vao, window, &state);
+					}
+				} else if (event.user.code == SWP_EVENT_ANIMATION_FRAME) {
+
+					/*	Upload the changed region of the next animation frame.	*/
+					if (event.user.data1 == state.animation && swpUpdateAnimation(&state) && visible) {
+						swpRender(vao, window, &state);
+					}
+				} else if (event.user.code == SWP_EVENT_DIRTY_UPDATE) {
+
+					/*	Upload only the changed rectangles of the displayed picture.	*/
+					if (swpApplyDirtyUpdate(&state, (swpDirtyUpdate *) event.user.data1) && visible) {
+						swpRender(vao, window, &state);
+					}
+				} else if (event.user.code == SWP_EVENT_PRINT_STATS) {
+					swpPrintStats();
+					swpPrintFrameStats(&state.clock);
+				} else if (event.user.code == SWP_EVENT_RESCALED) {
+
+					/*	Rescaled picture for the new drawable size is ready.	*/
+					if (swpFinishRescale(&state, (swpRescale *) event.user.data1) && visible) {
 						swpRender(vao, window, &state);
 					}
+				} else if (event.user.code == SWP_EVENT_PLAYLIST_DECODED) {
+
+					/*	Upload the prefetched playlist picture ahead of the time it is displayed.	*/
+					swpUploadPlaylistEntry(&state, (swpPlaylistEntry *) event.user.data1);
 				}
 
 				break;
@@ -540,6 +872,35 @@ int main(int argc, char** argv){
 				break;
 			}
 		}
+
+		/*	Idle, compile the transitions from file and warm them up one at the time,
+		 *	deferred while a transition is running.	*/
+		if (numtranspaths > 0 && !state.inTransition) {
+			swpLoadTransitionShaders(&state, numtranspaths, (const char **) transfilepaths);
+			numtranspaths = 0;
+			pendingshaders = 1;
+		} else if (pendingshaders && !state.inTransition)
+			pendingshaders = swpUpdateTransitionShaders(&state, vao);
+
+		/*	Dirty updates have settled.	*/
+		swpUpdateDirtyMipmaps(&state);
+
+		/*	Next bands of the picture being uploaded.	*/
+		swpStepSlicedUpload(&state);
+
+		/*	Next transition frame, timed from the start of the transition.	*/
+		if (state.inTransition && visible && swpIsFrameDue(&state.clock)) {
+			state.elapseTransition = swpTickFrameClock(&state.clock);
+			swpRender(vao, window, &state);
+			if (!state.inTransition && g_verbose)
+				swpPrintFrameStats(&state.clock);
+		}
+
+		/*	Persist the picture for the next start, read back once it has settled.	*/
+		pendingsnapshot = swpUpdateSnapshot(&state);
+
+		/*	Release the resources of a static wallpaper.	*/
+		swpReclaimIdle(&state);
 	}
 
 	error:
@@ -547,9 +908,25 @@ int main(int argc, char** argv){
 	/*	Cleanup code.	*/
 	g_alive = 0;
 	SDL_DetachThread(thread);
+	SDL_DetachThread(startupthread);
+	if (state.stream != NULL)
+		swpFrameQueueClose(&state.stream->queue);
+	swpReleasePlaylist(&state);
+	swpReleaseAnimation(&state);
+	swpSetPrescaleSource(&state, NULL);
+	swpReleaseTiledImage(&state);
+	swpReleaseSnapshot();
+	if (context != NULL)
+		swpReleaseSlicedUpload(&state);
+	swpReleaseTaskPool();
+	if (context != NULL)
+		swpReleaseCache();
+	swpReleaseCapabilities();
 
 	/*	Release OpenGL resources.	*/
 	if (context != NULL) {
+		swpReleaseUploadThread();
+		swpReleaseUploadRing();
 		if (glIsVertexArray(vao) == GL_TRUE) {
 			glDeleteVertexArrays(1, &vao);
 		}
@@ -566,6 +943,13 @@ int main(int argc, char** argv){
 				glDeleteBuffersARB(1, &state.data.pbo[i]);
 			}
 		}
+		for (i = 0; i < 3; i++) {
+			if (glIsTexture(state.data.planes[i]) == GL_TRUE) {
+				glDeleteTextures(1, &state.data.planes[i]);
+			}
+		}
+
+		swpReleaseVRAMTracking();
 
 		/*	Release Context.	*/
 		SDL_GL_MakeCurrent(window, NULL);
@@ -578,6 +962,8 @@ int main(int argc, char** argv){
 	}
 
 	/*	Release FreeImage and SDL library resources.*/
+	swpPrintStartupReport("exit");
+	swpWaitStartupReady(SWP_STARTUP_FREEIMAGE);
 	FreeImage_DeInitialise();
 	SDL_Quit();
 
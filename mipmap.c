@@ -0,0 +1,187 @@
+/**
+    Simple wallpaper application.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "wallpaper.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define SWP_MIPMAP_BAND 32      /*	Destination rows filtered by each task.	*/
+
+unsigned int g_mipmap = SWP_MIPMAP_AUTO;
+
+/**
+ *	Mip level filter job shared by the tasks.
+ */
+typedef struct swp_mipmap_job_t{
+	const unsigned char* src;       /*	*/
+	unsigned char* dst;             /*	*/
+	unsigned int width;             /*	Source width.	*/
+	unsigned int height;            /*	Source height.	*/
+	unsigned int dstwidth;          /*	*/
+	unsigned int dstheight;         /*	*/
+}swpMipmapJob;
+
+/**
+ *	2x2 box filter of \count destination pixels
+ *	from two source rows.
+ */
+static void swpBoxFilterRow(const unsigned char *__restrict__ row0, const unsigned char *__restrict__ row1,
+                            unsigned char *__restrict__ dst, unsigned int count) {
+
+	unsigned int x = 0, c;
+
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi16(2);
+
+	/*	4 destination pixels from 8 source pixels of each row.	*/
+	for (; x + 4 <= count; x += 4) {
+		const __m128i a0 = _mm_loadu_si128((const __m128i *) &row0[x * 8]);
+		const __m128i a1 = _mm_loadu_si128((const __m128i *) &row0[x * 8 + 16]);
+		const __m128i b0 = _mm_loadu_si128((const __m128i *) &row1[x * 8]);
+		const __m128i b1 = _mm_loadu_si128((const __m128i *) &row1[x * 8 + 16]);
+
+		/*	Vertical sums, two source pixels in each register.	*/
+		const __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+		const __m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+		const __m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+		const __m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+		/*	Horizontal sums of the pixel pairs.	*/
+		const __m128i h01 = _mm_unpacklo_epi64(_mm_add_epi16(s0, _mm_srli_si128(s0, 8)),
+		                                       _mm_add_epi16(s1, _mm_srli_si128(s1, 8)));
+		const __m128i h23 = _mm_unpacklo_epi64(_mm_add_epi16(s2, _mm_srli_si128(s2, 8)),
+		                                       _mm_add_epi16(s3, _mm_srli_si128(s3, 8)));
+
+		_mm_storeu_si128((__m128i *) &dst[x * 4],
+		                 _mm_packus_epi16(_mm_srli_epi16(_mm_add_epi16(h01, round), 2),
+		                                  _mm_srli_epi16(_mm_add_epi16(h23, round), 2)));
+	}
+#endif
+	for (; x < count; x++) {
+		for (c = 0; c < 4; c++)
+			dst[x * 4 + c] = (unsigned char) ((row0[x * 8 + c] + row0[x * 8 + 4 + c] + row1[x * 8 + c] +
+			                                   row1[x * 8 + 4 + c] + 2) / 4);
+	}
+}
+
+static void swpMipmapTask(void *userdata, unsigned int index) {
+
+	const swpMipmapJob* job = (const swpMipmapJob *) userdata;
+	const unsigned int end = SDL_min((index + 1) * SWP_MIPMAP_BAND, job->dstheight);
+	const size_t pitch = (size_t) job->width * 4;
+	unsigned int y, c;
+
+	for (y = index * SWP_MIPMAP_BAND; y < end; y++) {
+		/*	Single row or column levels average the pixel with itself.	*/
+		const unsigned char* row0 = &job->src[(size_t) SDL_min(y * 2, job->height - 1) * pitch];
+		const unsigned char* row1 = &job->src[(size_t) SDL_min(y * 2 + 1, job->height - 1) * pitch];
+		unsigned char* dst = &job->dst[(size_t) y * job->dstwidth * 4];
+
+		if (job->width > 1) {
+			swpBoxFilterRow(row0, row1, dst, job->dstwidth);
+		} else {
+			for (c = 0; c < 4; c++)
+				dst[c] = (unsigned char) ((row0[c] + row1[c] + 1) / 2);
+		}
+	}
+}
+
+unsigned int swpGetMipLevelCount(unsigned int width, unsigned int height) {
+
+	unsigned int full, count;
+
+	for (full = 1; (SDL_max(width, height) >> full) > 0; full++);
+	full = SDL_min(full, SWP_MAX_TEXTURE_LEVELS);
+
+	switch (g_mipmap) {
+		case SWP_MIPMAP_NONE:
+			return 1;
+		case SWP_MIPMAP_FULL:
+			return full;
+		default:
+			break;
+	}
+
+	/*	Levels down to the drawable size, and the one below for trilinear filtering.	*/
+	if (g_drawable[0] <= 0 || g_drawable[1] <= 0)
+		return full;
+	for (count = 1; count < full && ((width >> (count - 1)) > (unsigned int) g_drawable[0] ||
+	                                 (height >> (count - 1)) > (unsigned int) g_drawable[1]); count++);
+	return count;
+}
+
+int swpBuildMipmaps(swpTextureDesc *desc) {
+
+	swpMipmapJob job;
+	unsigned char* pixel;
+	unsigned int numlevels, i;
+	size_t size = 0;
+
+	if (desc->pixel == NULL || desc->numlevels > 0 || desc->animation != NULL || desc->tiled != NULL ||
+	    desc->bpp != 4 || desc->imgdatatype != GL_UNSIGNED_BYTE)
+		return 0;
+
+	/*	Layout of the levels, GL level sizes are rounded down.	*/
+	numlevels = swpGetMipLevelCount(desc->width, desc->height);
+	for (i = 0; i < numlevels; i++) {
+		desc->levels[i].width = SDL_max(desc->width >> i, 1);
+		desc->levels[i].height = SDL_max(desc->height >> i, 1);
+		desc->levels[i].offset = size;
+		desc->levels[i].size = (size_t) desc->levels[i].width * desc->levels[i].height * 4;
+		size += desc->levels[i].size;
+	}
+	desc->alignment = 4;
+
+	/*	Level zero is uploaded as it is.	*/
+	if (numlevels == 1) {
+		desc->numlevels = 1;
+		return 1;
+	}
+
+	pixel = malloc(size);
+	if (pixel == NULL) {
+		fprintf(stderr, "Failed to allocate %zu bytes for mipmaps, %s.\n", size, strerror(errno));
+		return 0;
+	}
+	memcpy(pixel, desc->pixel, desc->levels[0].size);
+
+	/*	Each level is filtered from the previous on the task pool.	*/
+	for (i = 1; i < numlevels; i++) {
+		job.src = &pixel[desc->levels[i - 1].offset];
+		job.dst = &pixel[desc->levels[i].offset];
+		job.width = desc->levels[i - 1].width;
+		job.height = desc->levels[i - 1].height;
+		job.dstwidth = desc->levels[i].width;
+		job.dstheight = desc->levels[i].height;
+		swpParallelFor((job.dstheight + SWP_MIPMAP_BAND - 1) / SWP_MIPMAP_BAND, swpMipmapTask, &job);
+	}
+	swpVerbosePrintf("Built %d mipmap levels of %dx%d.\n", numlevels, desc->width, desc->height);
+
+	swpReleasePixel(desc->pixel);
+	desc->pixel = pixel;
+	desc->size = (unsigned int) size;
+	desc->numlevels = numlevels;
+
+	return 1;
+}
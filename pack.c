@@ -0,0 +1,244 @@
+/**
+    Simple wallpaper program.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#define _POSIX_C_SOURCE 200809L
+#include "wallpaper.h"
+#include "swpk.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ *	Largest width and height of a pack.
+ */
+#define SWP_PACK_MAX_SIZE 65536
+
+static int swpReadFull(int fd, unsigned char *buf, size_t len) {
+
+	ssize_t n;
+
+	while (len > 0) {
+		n = read(fd, buf, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return 0;
+		buf += n;
+		len -= (size_t) n;
+	}
+	return 1;
+}
+
+static size_t swpGetPackSize(const swpkHeader *header) {
+
+	size_t size = sizeof(swpkHeader);
+	unsigned int i;
+
+	/*	Saturated, the header is not validated yet.	*/
+	for (i = 0; i < SDL_min(header->numlevels, SWPK_MAX_LEVELS); i++) {
+		if (header->levels[i].offset > SIZE_MAX - header->levels[i].size)
+			return SIZE_MAX;
+		size = SDL_max(size, (size_t) (header->levels[i].offset + header->levels[i].size));
+	}
+	return size;
+}
+
+/**
+ *	@Return minimum size in bytes of the level in the
+ *	pixel format, rows padded to the row alignment.
+ */
+static size_t swpGetPackLevelSize(const swpkHeader *header, const swpkLevel *level) {
+
+	size_t rowpitch;
+
+	if (header->format != SWPK_FORMAT_BGRA8)
+		return swpGetBCSize(level->width, level->height, header->format);
+	rowpitch = ((size_t) level->width * 4 + header->alignment - 1) & ~((size_t) header->alignment - 1);
+	return rowpitch * (level->height - 1) + (size_t) level->width * 4;
+}
+
+static int swpValidatePack(const swpkHeader *header, size_t filesize) {
+
+	const int tiled = (header->flags & SWPK_FLAG_TILED) != 0;
+	size_t maxsize = sizeof(swpkHeader);
+	unsigned int i;
+
+	if (memcmp(header->magic, SWPK_MAGIC, 4) != 0 || header->version != SWPK_VERSION) {
+		fprintf(stderr, "Unsupported pack version %d.\n", header->version);
+		return 0;
+	}
+	if (header->numlevels == 0 || header->numlevels > SWPK_MAX_LEVELS || header->format > SWPK_FORMAT_BC7 ||
+	    header->width == 0 || header->height == 0 || header->levels[0].width != header->width ||
+	    header->levels[0].height != header->height ||
+	    (header->alignment != 1 && header->alignment != 2 && header->alignment != 4 && header->alignment != 8)) {
+		fprintf(stderr, "Invalid pack header.\n");
+		return 0;
+	}
+
+	/*	Only uncompressed packs can be displayed as tiles.	*/
+	if (header->width > SWP_PACK_MAX_SIZE || header->height > SWP_PACK_MAX_SIZE ||
+	    (header->format != SWPK_FORMAT_BGRA8 &&
+	     (header->width > (unsigned int) g_maxtexsize || header->height > (unsigned int) g_maxtexsize))) {
+		fprintf(stderr, "Texture to big(limit %d), %dx%d.\n", g_maxtexsize, header->width, header->height);
+		return 0;
+	}
+
+	for (i = 0; i < header->numlevels; i++) {
+		const swpkLevel* level = &header->levels[i];
+
+		/*	Levels halve like the GL chain, or round up for the tile pyramid.	*/
+		if (i > 0) {
+			const swpkLevel* prev = &header->levels[i - 1];
+			if (level->width != (tiled ? (prev->width + 1) / 2 : SDL_max(prev->width / 2, 1)) ||
+			    level->height != (tiled ? (prev->height + 1) / 2 : SDL_max(prev->height / 2, 1))) {
+				fprintf(stderr, "Pack level %d is not half of the previous level.\n", i);
+				return 0;
+			}
+		}
+		if (level->size < swpGetPackLevelSize(header, level) || level->offset < sizeof(swpkHeader) ||
+		    level->offset > filesize || level->size > filesize - level->offset) {
+			fprintf(stderr, "Pack level %d exceeds the file size.\n", i);
+			return 0;
+		}
+		maxsize += (size_t) level->size + SWPK_DATA_ALIGNMENT;
+	}
+
+	/*	Levels are packed, a gap would be read for nothing.	*/
+	if (filesize > maxsize || filesize > UINT_MAX) {
+		fprintf(stderr, "Pack levels are not contiguous.\n");
+		return 0;
+	}
+	if (header->format == SWPK_FORMAT_BC7 && !g_support_bptc) {
+		fprintf(stderr, "Pack is BC7 compressed, GL_ARB_texture_compression_bptc is not supported.\n");
+		return 0;
+	}
+	if ((header->format == SWPK_FORMAT_BC1 || header->format == SWPK_FORMAT_BC3) && !g_support_s3tc) {
+		fprintf(stderr, "Pack is block compressed, GL_EXT_texture_compression_s3tc is not supported.\n");
+		return 0;
+	}
+	return 1;
+}
+
+ssize_t swpReadPackFromfd(int fd, const void *prefix, size_t prefixlen, swpTextureDesc *desc) {
+
+	swpkHeader header;
+	unsigned char* data;
+	struct stat st;
+	size_t size;
+	unsigned int i;
+
+	/*	Regular files are mapped, the pixel data is uploaded directly from the page cache.	*/
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (size_t) st.st_size >= sizeof(swpkHeader)) {
+		size = (size_t) st.st_size;
+		data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			fprintf(stderr, "Failed to map pack, %s.\n", strerror(errno));
+			return -1;
+		}
+		memcpy(&header, data, sizeof(header));
+		if (!swpValidatePack(&header, size) || !swpAddPixelMapping(data, size)) {
+			munmap(data, size);
+			return -1;
+		}
+	} else {
+
+		/*	Read the rest of the header.	*/
+		memcpy(&header, prefix, SDL_min(prefixlen, sizeof(header)));
+		if (prefixlen < sizeof(header) &&
+		    !swpReadFull(fd, (unsigned char *) &header + prefixlen, sizeof(header) - prefixlen)) {
+			fprintf(stderr, "Failed to read pack header.\n");
+			return -1;
+		}
+		size = swpGetPackSize(&header);
+		if (!swpValidatePack(&header, size))
+			return -1;
+
+		/*	Read the levels.	*/
+		data = malloc(size);
+		if (data == NULL) {
+			fprintf(stderr, "Failed to allocate %zu bytes, %s.\n", size, strerror(errno));
+			return -1;
+		}
+		memcpy(data, &header, sizeof(header));
+		if (prefixlen > sizeof(header))
+			memcpy(&data[sizeof(header)], (const unsigned char *) prefix + sizeof(header),
+			       SDL_min(prefixlen, size) - sizeof(header));
+		if (SDL_max(prefixlen, sizeof(header)) < size &&
+		    !swpReadFull(fd, &data[SDL_max(prefixlen, sizeof(header))], size - SDL_max(prefixlen, sizeof(header)))) {
+			fprintf(stderr, "Failed to read pack levels.\n");
+			free(data);
+			return -1;
+		}
+	}
+
+	/*	Texture description of the pre-built levels.	*/
+	desc->width = header.width;
+	desc->height = header.height;
+	desc->size = (unsigned int) size;
+	desc->pixel = data;
+	desc->format = GL_BGRA;
+	desc->imgdatatype = GL_UNSIGNED_BYTE;
+	desc->alignment = header.alignment;
+	desc->numlevels = SDL_min(header.numlevels, SWP_MAX_TEXTURE_LEVELS);
+	switch (header.format) {
+		case SWPK_FORMAT_BC1:
+			desc->bpp = 0;
+			desc->compressed = 1;
+			desc->intfor = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+			break;
+		case SWPK_FORMAT_BC3:
+			desc->bpp = 0;
+			desc->compressed = 1;
+			desc->intfor = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+			break;
+		case SWPK_FORMAT_BC7:
+			desc->bpp = 0;
+			desc->compressed = 1;
+			desc->intfor = GL_COMPRESSED_RGBA_BPTC_UNORM;
+			break;
+		default:
+			desc->bpp = 4;
+			desc->compressed = 0;
+			desc->intfor = header.flags & SWPK_FLAG_ALPHA ? GL_RGBA : GL_RGB;
+			break;
+	}
+	for (i = 0; i < desc->numlevels; i++) {
+		desc->levels[i].width = header.levels[i].width;
+		desc->levels[i].height = header.levels[i].height;
+		desc->levels[i].offset = (size_t) header.levels[i].offset;
+		desc->levels[i].size = (size_t) header.levels[i].size;
+	}
+	swpVerbosePrintf("Pack %dx%d, format %d, %d levels.\n", desc->width, desc->height, header.format,
+	                 desc->numlevels);
+
+	/*	Pictures larger than a texture use the levels as tile pyramid.	*/
+	if (desc->width > g_maxtexsize || desc->height > g_maxtexsize) {
+		if (desc->compressed || swpCreateTiledImage(desc) == NULL) {
+			fprintf(stderr, "Texture to big(limit %d), %dx%d.\n", g_maxtexsize, desc->width, desc->height);
+			swpReleasePixel(desc->pixel);
+			return -1;
+		}
+	}
+
+	return (ssize_t) size;
+}
@@ -0,0 +1,343 @@
+/**
+    Simple wallpaper application.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#define _POSIX_C_SOURCE 200809L
+#include "wallpaper.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <SDL2/SDL_events.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_timer.h>
+#include <SDL2/SDL_error.h>
+
+char* g_playlistpath = NULL;
+unsigned int g_playlistinterval = 300;
+unsigned int g_playlistshuffle = 0;
+unsigned int g_playlistprefetch = 2;
+
+static void swpShufflePlaylist(swpPlaylist *playlist) {
+
+	unsigned int i;
+
+	/*	Fisher-Yates, only called from the decode thread.	*/
+	for (i = playlist->numpaths; i > 1; i--) {
+		const unsigned int j = (unsigned int) rand() % i;
+		const unsigned int t = playlist->order[i - 1];
+		playlist->order[i - 1] = playlist->order[j];
+		playlist->order[j] = t;
+	}
+}
+
+static int swpParsePlaylist(swpPlaylist *playlist, const char *path) {
+
+	char* text = NULL;
+	char* line;
+	char* next;
+	const char* slash;
+	size_t dirlen;
+
+	if (swpLoadString(path, (void **) &text) <= 0) {
+		free(text);
+		return 0;
+	}
+
+	/*	Relative entries are relative to the playlist file.	*/
+	slash = strrchr(path, '/');
+	dirlen = slash != NULL ? (size_t) (slash - path) + 1 : 0;
+
+	for (line = text; line != NULL && *line != '\0'; line = next) {
+		char** paths;
+		size_t len;
+
+		next = strchr(line, '\n');
+		if (next != NULL)
+			*next++ = '\0';
+		len = strlen(line);
+		while (len > 0 && (line[len - 1] == '\r' || line[len - 1] == ' ' || line[len - 1] == '\t'))
+			line[--len] = '\0';
+		if (len == 0 || line[0] == '#')
+			continue;
+
+		paths = realloc(playlist->paths, (playlist->numpaths + 1) * sizeof(char *));
+		if (paths == NULL)
+			break;
+		playlist->paths = paths;
+		if (line[0] == '/')
+			dirlen = 0;
+		playlist->paths[playlist->numpaths] = malloc(dirlen + len + 1);
+		if (playlist->paths[playlist->numpaths] == NULL)
+			break;
+		memcpy(playlist->paths[playlist->numpaths], path, dirlen);
+		memcpy(playlist->paths[playlist->numpaths] + dirlen, line, len + 1);
+		playlist->numpaths++;
+		dirlen = slash != NULL ? (size_t) (slash - path) + 1 : 0;
+	}
+	free(text);
+
+	return playlist->numpaths > 0;
+}
+
+static int swpPlaylistDecoder(void *userdata) {
+
+	swpPlaylist* playlist = (swpPlaylist *) userdata;
+	unsigned int failures = 0;
+	SDL_Event event = {0};
+
+	SDL_LockMutex(playlist->lock);
+	while (playlist->alive) {
+		swpPlaylistEntry* entry;
+		const char* path;
+		int fd;
+
+		/*	Wait for a free entry, the ring is full with the prefetched pictures.	*/
+		entry = &playlist->entries[playlist->tail];
+		if (entry->status != SWP_PLAYLIST_FREE) {
+			SDL_CondWait(playlist->cond, playlist->lock);
+			continue;
+		}
+		entry->status = SWP_PLAYLIST_DECODING;
+
+		/*	Next picture, reshuffled on each round.	*/
+		if (playlist->position == 0 && g_playlistshuffle)
+			swpShufflePlaylist(playlist);
+		path = playlist->paths[playlist->order[playlist->position]];
+		playlist->position = (playlist->position + 1) % playlist->numpaths;
+		SDL_UnlockMutex(playlist->lock);
+
+		/*	Read and decode off the main thread.	*/
+		memset(&entry->desc, 0, sizeof(entry->desc));
+		fd = open(path, O_RDONLY);
+		if (fd < 0 || swpReadPicFromfd(fd, &entry->desc) <= 0) {
+			if (fd < 0)
+				fprintf(stderr, "Failed to open %s, %s.\n", path, strerror(errno));
+			else
+				close(fd);
+
+			SDL_LockMutex(playlist->lock);
+			entry->status = SWP_PLAYLIST_FREE;
+
+			/*	Give up if no picture of the playlist can be loaded.	*/
+			if (++failures >= playlist->numpaths) {
+				fprintf(stderr, "No picture of the playlist could be loaded.\n");
+				break;
+			}
+			continue;
+		}
+		close(fd);
+		failures = 0;
+		swpVerbosePrintf("Prefetched %s.\n", path);
+
+		SDL_LockMutex(playlist->lock);
+		entry->status = SWP_PLAYLIST_DECODED;
+		playlist->tail = (playlist->tail + 1) % g_playlistprefetch;
+		SDL_UnlockMutex(playlist->lock);
+
+		/*	Upload on the upload thread, or the main thread while idle.	*/
+		event.type = SDL_USEREVENT;
+		event.user.code = SWP_EVENT_PLAYLIST_DECODED;
+		event.user.data1 = entry;
+		swpSubmitUpload(&entry->desc, &event);
+		SDL_LockMutex(playlist->lock);
+	}
+	SDL_UnlockMutex(playlist->lock);
+
+	return 0;
+}
+
+static Uint32 swpPlaylistTimer(Uint32 interval, void *userdata) {
+
+	SDL_Event event = {0};
+
+	event.type = SDL_USEREVENT;
+	event.user.code = SWP_EVENT_PLAYLIST_NEXT;
+	event.user.data1 = userdata;
+	SDL_PushEvent(&event);
+
+	return interval;
+}
+
+int swpCreatePlaylist(swpRenderingState *state) {
+
+	swpPlaylist* playlist;
+	unsigned int i;
+
+	playlist = calloc(1, sizeof(*playlist));
+	if (playlist == NULL)
+		return 0;
+	if (!swpParsePlaylist(playlist, g_playlistpath)) {
+		fprintf(stderr, "Playlist %s has no pictures.\n", g_playlistpath);
+		free(playlist);
+		return 0;
+	}
+	playlist->order = malloc(playlist->numpaths * sizeof(unsigned int));
+	if (playlist->order == NULL) {
+		fprintf(stderr, "Failed to allocate playlist, %s.\n", strerror(errno));
+		state->playlist = playlist;
+		swpReleasePlaylist(state);
+		return 0;
+	}
+	for (i = 0; i < playlist->numpaths; i++)
+		playlist->order[i] = i;
+	srand((unsigned int) SDL_GetPerformanceCounter());
+
+	g_playlistprefetch = SDL_max(1, SDL_min(g_playlistprefetch, SWP_PLAYLIST_MAX_PREFETCH));
+	if (g_support_pbo)
+		glGenBuffersARB(1, &playlist->pbo);
+
+	playlist->lock = SDL_CreateMutex();
+	playlist->cond = SDL_CreateCond();
+	playlist->alive = 1;
+	state->playlist = playlist;
+
+	playlist->thread = SDL_CreateThread(swpPlaylistDecoder, "playlist", playlist);
+	if (playlist->thread == NULL) {
+		fprintf(stderr, "Failed to create thread, %s.\n", SDL_GetError());
+		swpReleasePlaylist(state);
+		return 0;
+	}
+
+	/*	The first picture is displayed as soon as it has been loaded.	*/
+	playlist->due = 1;
+	playlist->timer = SDL_AddTimer(g_playlistinterval * 1000, swpPlaylistTimer, playlist);
+	swpVerbosePrintf("Playlist of %d pictures, every %d seconds.\n", playlist->numpaths, g_playlistinterval);
+
+	return 1;
+}
+
+void swpUploadPlaylistEntry(swpRenderingState *state, swpPlaylistEntry *entry) {
+
+	swpPlaylist* playlist = state->playlist;
+	GLint bound;
+
+	if (playlist == NULL)
+		return;
+
+	/*	Still pictures are uploaded ahead, the switch is only a texture bind. Animations,
+	 *	tiled pictures and textures resident in the cache are displayed as they are.	*/
+	if (entry->desc.pixel != NULL && entry->desc.texture == 0 && entry->desc.animation == NULL &&
+	    entry->desc.tiled == NULL) {
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+		if (swpLoadTextureFromMem(&entry->desc.texture, playlist->pbo, &entry->desc))
+			entry->desc.pixel = NULL;
+		glBindTexture(GL_TEXTURE_2D, (GLuint) bound);
+	}
+
+	SDL_LockMutex(playlist->lock);
+	entry->status = SWP_PLAYLIST_READY;
+	SDL_UnlockMutex(playlist->lock);
+
+	/*	The timer already fired while the picture was being loaded.	*/
+	if (playlist->due && entry == &playlist->entries[playlist->head]) {
+		SDL_Event event = {0};
+		event.type = SDL_USEREVENT;
+		event.user.code = SWP_EVENT_PLAYLIST_NEXT;
+		event.user.data1 = playlist;
+		SDL_PushEvent(&event);
+	}
+}
+
+swpPlaylistEntry *swpNextPlaylistEntry(swpRenderingState *state) {
+
+	swpPlaylist* playlist = state->playlist;
+	swpPlaylistEntry* entry;
+
+	if (playlist == NULL)
+		return NULL;
+
+	SDL_LockMutex(playlist->lock);
+	entry = &playlist->entries[playlist->head];
+	if (entry->status != SWP_PLAYLIST_READY) {
+
+		/*	Not loaded yet, displayed as soon as it is uploaded.	*/
+		playlist->due = 1;
+		SDL_UnlockMutex(playlist->lock);
+		swpVerbosePrintf("Next playlist picture is not loaded yet.\n");
+		return NULL;
+	}
+	playlist->due = 0;
+	SDL_UnlockMutex(playlist->lock);
+
+	return entry;
+}
+
+void swpConsumePlaylistEntry(swpRenderingState *state, swpPlaylistEntry *entry) {
+
+	swpPlaylist* playlist = state->playlist;
+
+	/*	The texture and picture are owned by the display now, decode the next.	*/
+	SDL_LockMutex(playlist->lock);
+	memset(&entry->desc, 0, sizeof(entry->desc));
+	entry->status = SWP_PLAYLIST_FREE;
+	playlist->head = (playlist->head + 1) % g_playlistprefetch;
+	SDL_CondSignal(playlist->cond);
+	SDL_UnlockMutex(playlist->lock);
+}
+
+void swpReleasePlaylist(swpRenderingState *state) {
+
+	swpPlaylist* playlist = state->playlist;
+	unsigned int i;
+
+	if (playlist == NULL)
+		return;
+
+	SDL_RemoveTimer(playlist->timer);
+
+	/*	Wait for the picture being decoded.	*/
+	SDL_LockMutex(playlist->lock);
+	playlist->alive = 0;
+	SDL_CondSignal(playlist->cond);
+	SDL_UnlockMutex(playlist->lock);
+	SDL_WaitThread(playlist->thread, NULL);
+
+	for (i = 0; i < SWP_PLAYLIST_MAX_PREFETCH; i++) {
+		swpPlaylistEntry* entry = &playlist->entries[i];
+		if (entry->desc.texture != 0) {
+			swpTrackVRAM(SWP_VRAM_TEXTURE, entry->desc.texture, 0);
+			glDeleteTextures(1, &entry->desc.texture);
+		}
+		if (entry->status != SWP_PLAYLIST_FREE) {
+			swpReleasePixel(entry->desc.pixel);
+			swpReleasePixel(entry->desc.source);
+			if (entry->desc.animation != NULL)
+				swpFreeAnimation(entry->desc.animation);
+			if (entry->desc.tiled != NULL)
+				swpFreeTiledImage(entry->desc.tiled);
+			if (entry->desc.hash != 0 && entry->desc.pixel == NULL && entry->desc.texture == 0)
+				swpCacheReleaseTexture(entry->desc.hash);
+		}
+	}
+	if (playlist->pbo != 0) {
+		swpTrackVRAM(SWP_VRAM_BUFFER, playlist->pbo, 0);
+		glDeleteBuffersARB(1, &playlist->pbo);
+	}
+
+	for (i = 0; i < playlist->numpaths; i++)
+		free(playlist->paths[i]);
+	free(playlist->paths);
+	free(playlist->order);
+	SDL_DestroyCond(playlist->cond);
+	SDL_DestroyMutex(playlist->lock);
+	free(playlist);
+	state->playlist = NULL;
+}
@@ -0,0 +1,177 @@
+/**
+    Simple wallpaper program.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "wallpaper.h"
+
+#include <stdlib.h>
+#include <assert.h>
+#include <SDL2/SDL_cpuinfo.h>
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_error.h>
+
+/**
+ *	Job shared by the caller and the worker threads.
+ */
+typedef struct swp_task_job_t{
+	swpTaskFunc func;               /*	Task function.	*/
+	void* userdata;                 /*	Task function argument.	*/
+	unsigned int count;             /*	Number of tasks.	*/
+	unsigned int done;              /*	Number of completed tasks.	*/
+	unsigned int active;            /*	Number of workers referencing the job.	*/
+	SDL_atomic_t next;              /*	Next task index to claim.	*/
+}swpTaskJob;
+
+static SDL_SpinLock g_poolinit = 0;
+static SDL_mutex* g_poolcall = NULL;    /*	Serialize callers, one job at the time.	*/
+static SDL_mutex* g_poollock = NULL;    /*	Protects the current job.	*/
+static SDL_cond* g_poolwork = NULL;     /*	Signaled when a job is posted.	*/
+static SDL_cond* g_pooldone = NULL;     /*	Signaled when a job has completed.	*/
+static swpTaskJob* g_pooljob = NULL;    /*	Current job, NULL if idle.	*/
+static SDL_Thread** g_poolthreads = NULL;
+static unsigned int g_poolalive = 0;
+unsigned int g_numworkers = 0;
+
+static void swpRunTasks(swpTaskJob *job) {
+
+	int index;
+
+	while ((index = SDL_AtomicAdd(&job->next, 1)) < (int) job->count) {
+		job->func(job->userdata, (unsigned int) index);
+
+		SDL_LockMutex(g_poollock);
+		job->done++;
+		if (job->done == job->count)
+			SDL_CondBroadcast(g_pooldone);
+		SDL_UnlockMutex(g_poollock);
+	}
+}
+
+static int swpTaskWorker(void *userdata) {
+
+	swpTaskJob* job;
+
+	SDL_LockMutex(g_poollock);
+	while (g_poolalive) {
+
+		/*	Wait for a job with unclaimed tasks.	*/
+		job = g_pooljob;
+		if (job == NULL || SDL_AtomicGet(&job->next) >= (int) job->count) {
+			SDL_CondWait(g_poolwork, g_poollock);
+			continue;
+		}
+
+		job->active++;
+		SDL_UnlockMutex(g_poollock);
+		swpRunTasks(job);
+		SDL_LockMutex(g_poollock);
+		job->active--;
+		if (job->active == 0)
+			SDL_CondBroadcast(g_pooldone);
+	}
+	SDL_UnlockMutex(g_poollock);
+
+	return 0;
+}
+
+static void swpCreateTaskPool(void) {
+
+	unsigned int i;
+
+	g_poolcall = SDL_CreateMutex();
+	g_poollock = SDL_CreateMutex();
+	g_poolwork = SDL_CreateCond();
+	g_pooldone = SDL_CreateCond();
+	g_poolalive = 1;
+
+	/*	The calling thread takes part in each job.	*/
+	if (g_numworkers == 0)
+		g_numworkers = SDL_max(1, SDL_GetCPUCount());
+	g_poolthreads = calloc(g_numworkers, sizeof(SDL_Thread *));
+	assert(g_poolthreads);
+	for (i = 0; i + 1 < g_numworkers; i++) {
+		g_poolthreads[i] = SDL_CreateThread(swpTaskWorker, "worker", NULL);
+		if (g_poolthreads[i] == NULL)
+			fprintf(stderr, "Failed to create worker thread, %s.\n", SDL_GetError());
+	}
+	swpVerbosePrintf("Created task pool with %d threads.\n", g_numworkers);
+}
+
+void swpParallelFor(unsigned int count, swpTaskFunc func, void *userdata) {
+
+	swpTaskJob job;
+
+	if (count == 0)
+		return;
+
+	/*	Create the worker threads on first use.	*/
+	SDL_AtomicLock(&g_poolinit);
+	if (g_poolcall == NULL)
+		swpCreateTaskPool();
+	SDL_AtomicUnlock(&g_poolinit);
+
+	job.func = func;
+	job.userdata = userdata;
+	job.count = count;
+	job.done = 0;
+	job.active = 0;
+	SDL_AtomicSet(&job.next, 0);
+
+	SDL_LockMutex(g_poolcall);
+
+	SDL_LockMutex(g_poollock);
+	g_pooljob = &job;
+	SDL_CondBroadcast(g_poolwork);
+	SDL_UnlockMutex(g_poollock);
+
+	swpRunTasks(&job);
+
+	/*	Wait until every task has completed and no worker references the job.	*/
+	SDL_LockMutex(g_poollock);
+	while (job.done < job.count || job.active > 0)
+		SDL_CondWait(g_pooldone, g_poollock);
+	g_pooljob = NULL;
+	SDL_UnlockMutex(g_poollock);
+
+	SDL_UnlockMutex(g_poolcall);
+}
+
+void swpReleaseTaskPool(void) {
+
+	unsigned int i;
+
+	if (g_poolcall == NULL)
+		return;
+
+	SDL_LockMutex(g_poollock);
+	g_poolalive = 0;
+	SDL_CondBroadcast(g_poolwork);
+	SDL_UnlockMutex(g_poollock);
+
+	for (i = 0; i + 1 < g_numworkers; i++) {
+		if (g_poolthreads[i] != NULL)
+			SDL_WaitThread(g_poolthreads[i], NULL);
+	}
+	free(g_poolthreads);
+	g_poolthreads = NULL;
+
+	SDL_DestroyCond(g_pooldone);
+	SDL_DestroyCond(g_poolwork);
+	SDL_DestroyMutex(g_poollock);
+	SDL_DestroyMutex(g_poolcall);
+	g_poolcall = NULL;
+}
@@ -0,0 +1,156 @@
+/**
+    Simple wallpaper application.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#define _POSIX_C_SOURCE 200809L
+#include "wallpaper.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define SWP_PROGRAM_MAGIC 0x42505753u    /*	'SWPB'	*/
+#define SWP_PROGRAM_MAX_SIZE (16 * 1024 * 1024)
+
+/**
+ *	Program binary file header, followed
+ *	by the binary returned by the driver.
+ */
+typedef struct swp_program_header_t{
+	Uint32 magic;                   /*	SWP_PROGRAM_MAGIC.	*/
+	Uint32 format;                  /*	Driver binary format.	*/
+	Uint32 length;                  /*	Size of the binary in bytes.	*/
+	Uint32 reserved;                /*	*/
+}swpProgramHeader;
+
+static int swpGetProgramPath(char *path, size_t size, Uint64 hash, int create) {
+
+	static Uint64 driver = 0;
+	char name[64];
+	swpHashState state;
+
+	/*	Binaries are only valid for the driver that created them.	*/
+	if (driver == 0) {
+		const char* strings[3];
+		unsigned int i;
+
+		strings[0] = (const char *) glGetString(GL_VENDOR);
+		strings[1] = (const char *) glGetString(GL_RENDERER);
+		strings[2] = (const char *) glGetString(GL_VERSION);
+		swpHashInit(&state);
+		for (i = 0; i < 3; i++) {
+			if (strings[i] != NULL)
+				swpHashUpdate(&state, strings[i], strlen(strings[i]) + 1);
+		}
+		driver = swpHashDigest(&state);
+	}
+
+	swpHashInit(&state);
+	swpHashUpdate(&state, &driver, sizeof(driver));
+	swpHashUpdate(&state, &hash, sizeof(hash));
+	snprintf(name, sizeof(name), "program-%016llx.bin", (unsigned long long) swpHashDigest(&state));
+	return swpGetCachePath(path, size, name, create);
+}
+
+int swpLoadProgramBinary(GLuint prog, Uint64 hash) {
+
+	swpProgramHeader header;
+	char path[4096];
+	void* binary;
+	GLint status = GL_FALSE;
+	int fd;
+
+	if (!swpGetProgramPath(path, sizeof(path), hash, 0))
+		return 0;
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+
+	if (read(fd, &header, sizeof(header)) != sizeof(header) || header.magic != SWP_PROGRAM_MAGIC ||
+	    header.length == 0 || header.length > SWP_PROGRAM_MAX_SIZE) {
+		close(fd);
+		unlink(path);
+		return 0;
+	}
+	binary = malloc(header.length);
+	if (binary == NULL || read(fd, binary, header.length) != (ssize_t) header.length) {
+		free(binary);
+		close(fd);
+		unlink(path);
+		return 0;
+	}
+	close(fd);
+
+	/*	The driver rejects binaries of other driver builds, compile from source instead.	*/
+	glProgramBinary(prog, (GLenum) header.format, binary, (GLsizei) header.length);
+	free(binary);
+	glGetProgramiv(prog, GL_LINK_STATUS, &status);
+	if (status == GL_FALSE) {
+		swpVerbosePrintf("Program binary %s was rejected by the driver.\n", path);
+		unlink(path);
+		return 0;
+	}
+	return 1;
+}
+
+void swpSaveProgramBinary(GLuint prog, Uint64 hash) {
+
+	swpProgramHeader header = {0};
+	char path[4096];
+	char tmppath[4096 + 32];
+	GLint length = 0;
+	GLenum format;
+	void* binary;
+	int fd;
+
+	glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0 || length > SWP_PROGRAM_MAX_SIZE)
+		return;
+	binary = malloc((size_t) length);
+	if (binary == NULL)
+		return;
+	glGetProgramBinary(prog, length, &length, &format, binary);
+	if (length <= 0 || !swpGetProgramPath(path, sizeof(path), hash, 1)) {
+		free(binary);
+		return;
+	}
+
+	header.magic = SWP_PROGRAM_MAGIC;
+	header.format = format;
+	header.length = (Uint32) length;
+
+	/*	Write to a temporary file, concurrent instances never read a partial binary.	*/
+	snprintf(tmppath, sizeof(tmppath), "%s.%ld", path, (long) getpid());
+	fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		free(binary);
+		return;
+	}
+	if (write(fd, &header, sizeof(header)) != sizeof(header) || write(fd, binary, (size_t) length) != length) {
+		fprintf(stderr, "Failed to write program binary %s, %s.\n", tmppath, strerror(errno));
+		close(fd);
+		unlink(tmppath);
+		free(binary);
+		return;
+	}
+	close(fd);
+	if (rename(tmppath, path) != 0)
+		unlink(tmppath);
+	free(binary);
+}
@@ -0,0 +1,599 @@
+/**
+    Simple wallpaper program.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "wallpaper.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <SDL2/SDL_cpuinfo.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SWP_SCALE_AVX2 1
+#endif
+
+#define SWP_PI 3.14159265358979323846f
+
+/*	Number of rows processed by each task.	*/
+#define SWP_SCALE_BAND 32
+
+unsigned int g_prescale = SWP_FILTER_NONE;
+int g_prescalecap[2] = {-1, -1};
+int g_drawable[2] = {0, 0};
+
+/**
+ *	Filter contribution of each source
+ *	pixel for every destination pixel.
+ */
+typedef struct swp_scale_weights_t{
+	unsigned int* start;            /*	First source pixel.	*/
+	unsigned int* count;            /*	Number of source pixels.	*/
+	float* weights;                 /*	Normalized weights, maxtaps per destination pixel.	*/
+	unsigned int maxtaps;           /*	*/
+}swpScaleWeights;
+
+/**
+ *	Scaling job shared by the tasks.
+ */
+typedef struct swp_scale_job_t{
+	const unsigned char* src;       /*	Source pixels.	*/
+	unsigned char* tmp;             /*	Horizontally scaled pixels.	*/
+	unsigned char* dst;             /*	Destination pixels.	*/
+	unsigned int srcwidth;          /*	*/
+	unsigned int srcheight;         /*	*/
+	unsigned int dstwidth;          /*	*/
+	unsigned int dstheight;         /*	*/
+	swpScaleWeights horizontal;     /*	*/
+	swpScaleWeights vertical;       /*	*/
+	unsigned int avx2;              /*	Use the AVX2 code path.	*/
+}swpScaleJob;
+
+static float swpSinc(float x) {
+	if (x == 0.0f)
+		return 1.0f;
+	x *= SWP_PI;
+	return sinf(x) / x;
+}
+
+static float swpFilterLanczos3(float x) {
+	x = fabsf(x);
+	if (x < 3.0f)
+		return swpSinc(x) * swpSinc(x / 3.0f);
+	return 0.0f;
+}
+
+static float swpFilterMitchell(float x) {
+	const float B = 1.0f / 3.0f;
+	const float C = 1.0f / 3.0f;
+
+	x = fabsf(x);
+	if (x < 1.0f)
+		return ((12.0f - 9.0f * B - 6.0f * C) * x * x * x + (-18.0f + 12.0f * B + 6.0f * C) * x * x +
+		        (6.0f - 2.0f * B)) / 6.0f;
+	if (x < 2.0f)
+		return ((-B - 6.0f * C) * x * x * x + (6.0f * B + 30.0f * C) * x * x + (-12.0f * B - 48.0f * C) * x +
+		        (8.0f * B + 24.0f * C)) / 6.0f;
+	return 0.0f;
+}
+
+static int swpComputeScaleWeights(swpScaleWeights *w, unsigned int insize, unsigned int outsize,
+                                  unsigned int filter) {
+
+	float (*kernel)(float) = filter == SWP_FILTER_MITCHELL ? swpFilterMitchell : swpFilterLanczos3;
+	const float radius = filter == SWP_FILTER_MITCHELL ? 2.0f : 3.0f;
+	const float scale = (float) insize / (float) outsize;
+	const float fscale = SDL_max(scale, 1.0f);
+	const float support = radius * fscale;
+	unsigned int i, k;
+
+	w->maxtaps = (unsigned int) ceilf(support) * 2 + 1;
+	w->start = malloc(outsize * sizeof(unsigned int));
+	w->count = malloc(outsize * sizeof(unsigned int));
+	w->weights = malloc((size_t) outsize * w->maxtaps * sizeof(float));
+	if (w->start == NULL || w->count == NULL || w->weights == NULL)
+		return 0;
+
+	for (i = 0; i < outsize; i++) {
+		const float center = ((float) i + 0.5f) * scale;
+		float* weights = &w->weights[(size_t) i * w->maxtaps];
+		int x0 = (int) floorf(center - support + 0.5f);
+		int x1 = (int) floorf(center + support + 0.5f);
+		float total = 0.0f;
+
+		/*	Clamp to the image, the weights are normalized afterward.	*/
+		x0 = SDL_max(x0, 0);
+		x1 = SDL_min(x1, (int) insize);
+		if (x1 - x0 > (int) w->maxtaps)
+			x1 = x0 + w->maxtaps;
+
+		for (k = 0; k < (unsigned int) (x1 - x0); k++) {
+			weights[k] = kernel(((float) (x0 + k) + 0.5f - center) / fscale);
+			total += weights[k];
+		}
+		for (k = 0; k < (unsigned int) (x1 - x0); k++)
+			weights[k] = total != 0.0f ? weights[k] / total : 0.0f;
+
+		w->start[i] = (unsigned int) x0;
+		w->count[i] = (unsigned int) (x1 - x0);
+	}
+
+	return 1;
+}
+
+static void swpReleaseScaleWeights(swpScaleWeights *w) {
+	free(w->start);
+	free(w->count);
+	free(w->weights);
+}
+
+static unsigned char swpClampPixel(float v) {
+	if (v <= 0.0f)
+		return 0;
+	if (v >= 255.0f)
+		return 255;
+	return (unsigned char) (v + 0.5f);
+}
+
+static void swpScaleRowHorizontal(const swpScaleJob *job, const unsigned char *src, unsigned char *dst) {
+
+	const swpScaleWeights* w = &job->horizontal;
+	unsigned int x, k, c;
+
+	for (x = 0; x < job->dstwidth; x++) {
+		const unsigned char* in = &src[w->start[x] * 4];
+		const float* weights = &w->weights[(size_t) x * w->maxtaps];
+		float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+		for (k = 0; k < w->count[x]; k++) {
+			for (c = 0; c < 4; c++)
+				acc[c] += weights[k] * (float) in[k * 4 + c];
+		}
+		for (c = 0; c < 4; c++)
+			dst[x * 4 + c] = swpClampPixel(acc[c]);
+	}
+}
+
+static void swpScaleRowVertical(const swpScaleJob *job, unsigned int y, unsigned char *dst) {
+
+	const swpScaleWeights* w = &job->vertical;
+	const size_t pitch = (size_t) job->dstwidth * 4;
+	const float* weights = &w->weights[(size_t) y * w->maxtaps];
+	const unsigned char* in = &job->tmp[w->start[y] * pitch];
+	size_t x;
+	unsigned int k;
+
+	for (x = 0; x < pitch; x++) {
+		float acc = 0.0f;
+		for (k = 0; k < w->count[y]; k++)
+			acc += weights[k] * (float) in[k * pitch + x];
+		dst[x] = swpClampPixel(acc);
+	}
+}
+
+#if defined(SWP_SCALE_AVX2)
+
+__attribute__((target("avx2")))
+static __m128i swpPackPixelAVX2(__m128 acc) {
+	__m128i i32 = _mm_cvtps_epi32(acc);
+	__m128i i16 = _mm_packs_epi32(i32, i32);
+	return _mm_packus_epi16(i16, i16);
+}
+
+__attribute__((target("avx2")))
+static void swpScaleRowHorizontalAVX2(const swpScaleJob *job, const unsigned char *src, unsigned char *dst) {
+
+	const swpScaleWeights* w = &job->horizontal;
+	unsigned int x, k;
+
+	for (x = 0; x < job->dstwidth; x++) {
+		const unsigned char* in = &src[w->start[x] * 4];
+		const float* weights = &w->weights[(size_t) x * w->maxtaps];
+		const unsigned int count = w->count[x];
+		__m256 acc = _mm256_setzero_ps();
+		__m128 sum;
+		int pixel;
+
+		/*	Two source pixels, eight channels, per iteration.	*/
+		for (k = 0; k + 2 <= count; k += 2) {
+			__m128i p = _mm_loadl_epi64((const __m128i *) &in[k * 4]);
+			__m256 f = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(p));
+			__m256 wk = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(weights[k])),
+			                                 _mm_set1_ps(weights[k + 1]), 1);
+			acc = _mm256_add_ps(acc, _mm256_mul_ps(f, wk));
+		}
+		sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+		if (k < count) {
+			__m128i p;
+			memcpy(&pixel, &in[k * 4], 4);
+			p = _mm_cvtsi32_si128(pixel);
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(p)), _mm_set1_ps(weights[k])));
+		}
+
+		pixel = _mm_cvtsi128_si32(swpPackPixelAVX2(sum));
+		memcpy(&dst[x * 4], &pixel, 4);
+	}
+}
+
+__attribute__((target("avx2")))
+static void swpScaleRowVerticalAVX2(const swpScaleJob *job, unsigned int y, unsigned char *dst) {
+
+	const swpScaleWeights* w = &job->vertical;
+	const size_t pitch = (size_t) job->dstwidth * 4;
+	const float* weights = &w->weights[(size_t) y * w->maxtaps];
+	const unsigned char* in = &job->tmp[w->start[y] * pitch];
+	const unsigned int count = w->count[y];
+	size_t x;
+	unsigned int k;
+
+	/*	Eight channels per iteration.	*/
+	for (x = 0; x + 8 <= pitch; x += 8) {
+		__m256 acc = _mm256_setzero_ps();
+		__m256i i32;
+		__m128i i16;
+
+		for (k = 0; k < count; k++) {
+			__m128i p = _mm_loadl_epi64((const __m128i *) &in[k * pitch + x]);
+			__m256 f = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(p));
+			acc = _mm256_add_ps(acc, _mm256_mul_ps(f, _mm256_set1_ps(weights[k])));
+		}
+
+		i32 = _mm256_cvtps_epi32(acc);
+		i16 = _mm_packs_epi32(_mm256_castsi256_si128(i32), _mm256_extracti128_si256(i32, 1));
+		_mm_storel_epi64((__m128i *) &dst[x], _mm_packus_epi16(i16, i16));
+	}
+
+	/*	Remaining channels.	*/
+	for (; x < pitch; x++) {
+		float acc = 0.0f;
+		for (k = 0; k < count; k++)
+			acc += weights[k] * (float) in[k * pitch + x];
+		dst[x] = swpClampPixel(acc);
+	}
+}
+
+#endif
+
+static void swpScaleHorizontalTask(void *userdata, unsigned int index) {
+
+	const swpScaleJob* job = (const swpScaleJob *) userdata;
+	const unsigned int end = SDL_min((index + 1) * SWP_SCALE_BAND, job->srcheight);
+	unsigned int y;
+
+	for (y = index * SWP_SCALE_BAND; y < end; y++) {
+		const unsigned char* src = &job->src[(size_t) y * job->srcwidth * 4];
+		unsigned char* dst = &job->tmp[(size_t) y * job->dstwidth * 4];
+#if defined(SWP_SCALE_AVX2)
+		if (job->avx2) {
+			swpScaleRowHorizontalAVX2(job, src, dst);
+			continue;
+		}
+#endif
+		swpScaleRowHorizontal(job, src, dst);
+	}
+}
+
+static void swpScaleVerticalTask(void *userdata, unsigned int index) {
+
+	const swpScaleJob* job = (const swpScaleJob *) userdata;
+	const unsigned int end = SDL_min((index + 1) * SWP_SCALE_BAND, job->dstheight);
+	unsigned int y;
+
+	for (y = index * SWP_SCALE_BAND; y < end; y++) {
+		unsigned char* dst = &job->dst[(size_t) y * job->dstwidth * 4];
+#if defined(SWP_SCALE_AVX2)
+		if (job->avx2) {
+			swpScaleRowVerticalAVX2(job, y, dst);
+			continue;
+		}
+#endif
+		swpScaleRowVertical(job, y, dst);
+	}
+}
+
+int swpScaleImage(const void *__restrict__ src, unsigned int srcwidth, unsigned int srcheight,
+                  void *__restrict__ dst, unsigned int dstwidth, unsigned int dstheight, unsigned int filter) {
+
+	swpScaleJob job;
+	int status = 0;
+
+	memset(&job, 0, sizeof(job));
+	job.src = (const unsigned char *) src;
+	job.dst = (unsigned char *) dst;
+	job.srcwidth = srcwidth;
+	job.srcheight = srcheight;
+	job.dstwidth = dstwidth;
+	job.dstheight = dstheight;
+#if defined(SWP_SCALE_AVX2)
+	job.avx2 = SDL_HasAVX2();
+#endif
+
+	/*	Separable filter, horizontal pass followed by the vertical pass.	*/
+	job.tmp = malloc((size_t) dstwidth * srcheight * 4);
+	if (job.tmp != NULL &&
+	    swpComputeScaleWeights(&job.horizontal, srcwidth, dstwidth, filter) &&
+	    swpComputeScaleWeights(&job.vertical, srcheight, dstheight, filter)) {
+
+		swpParallelFor((srcheight + SWP_SCALE_BAND - 1) / SWP_SCALE_BAND, swpScaleHorizontalTask, &job);
+		swpParallelFor((dstheight + SWP_SCALE_BAND - 1) / SWP_SCALE_BAND, swpScaleVerticalTask, &job);
+		status = 1;
+	} else {
+		fprintf(stderr, "Failed to allocate scaling buffers, %s.\n", strerror(errno));
+	}
+
+	swpReleaseScaleWeights(&job.horizontal);
+	swpReleaseScaleWeights(&job.vertical);
+	free(job.tmp);
+
+	return status;
+}
+
+void swpGetPrescaleSize(unsigned int width, unsigned int height, unsigned int *dstwidth, unsigned int *dstheight) {
+
+	unsigned int maxwidth = g_drawable[0] > 0 ? (unsigned int) g_drawable[0] : width;
+	unsigned int maxheight = g_drawable[1] > 0 ? (unsigned int) g_drawable[1] : height;
+
+	/*	Configured cap has precedence over the drawable size.	*/
+	if (g_prescalecap[0] > 0 && g_prescalecap[1] > 0) {
+		maxwidth = (unsigned int) g_prescalecap[0];
+		maxheight = (unsigned int) g_prescalecap[1];
+	}
+
+	/*	Only scale down.	*/
+	*dstwidth = SDL_min(width, maxwidth);
+	*dstheight = SDL_min(height, maxheight);
+}
+
+int swpPrescaleTexture(swpTextureDesc *desc) {
+
+	unsigned int width, height;
+	void* scaled;
+
+	if (g_prescale == SWP_FILTER_NONE || desc->bpp != 4 || desc->imgdatatype != GL_UNSIGNED_BYTE ||
+	    desc->numlevels > 0)
+		return 0;
+
+	swpGetPrescaleSize(desc->width, desc->height, &width, &height);
+	if (width == desc->width && height == desc->height)
+		return 0;
+
+	scaled = malloc((size_t) width * height * 4);
+	if (scaled == NULL)
+		return 0;
+	if (!swpScaleImage(desc->pixel, desc->width, desc->height, scaled, width, height, g_prescale)) {
+		free(scaled);
+		return 0;
+	}
+	swpVerbosePrintf("Prescaled %dx%d to %dx%d.\n", desc->width, desc->height, width, height);
+
+	/*	Keep the full resolution picture for rescaling when the window is resized.	*/
+	desc->source = desc->pixel;
+	desc->srcwidth = desc->width;
+	desc->srcheight = desc->height;
+	desc->pixel = scaled;
+	desc->width = width;
+	desc->height = height;
+	desc->size = width * height * 4;
+
+	return 1;
+}
+
+void swpSetPrescaleSource(swpRenderingState *__restrict__ state, swpTextureDesc *__restrict__ desc) {
+
+	/*	Release the previous picture, unless the upload thread is still scaling it.	*/
+	if (state->rescale != NULL) {
+		state->rescale = NULL;
+		state->rescaledue = 0;
+	} else
+		swpReleasePixel(state->source.pixel);
+	memset(&state->source, 0, sizeof(state->source));
+
+	if (desc == NULL || desc->source == NULL)
+		return;
+
+	state->source = *desc;
+	state->source.pixel = desc->source;
+	state->source.width = desc->srcwidth;
+	state->source.height = desc->srcheight;
+	state->source.size = desc->srcwidth * desc->srcheight * 4;
+	state->source.source = NULL;
+	state->source.animation = NULL;
+
+	/*	The displayed levels may have been built and compressed, the source is the plain picture.	*/
+	if (desc->compressed)
+		state->source.intfor = desc->intfor == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? GL_RGB : GL_RGBA;
+	state->source.bpp = 4;
+	state->source.format = GL_BGRA;
+	state->source.numlevels = 0;
+	state->source.compressed = 0;
+	state->prescaled[0] = desc->width;
+	state->prescaled[1] = desc->height;
+	desc->source = NULL;
+}
+
+/**
+ *	Scale the full resolution picture of the rescale
+ *	and build its levels, on the upload thread.
+ */
+static void swpPrepareRescale(swpTextureDesc *desc) {
+
+	swpRescale* rescale = (swpRescale *) desc;
+
+	desc->pixel = malloc(desc->size);
+	if (desc->pixel == NULL)
+		return;
+
+	if (desc->width == rescale->srcwidth && desc->height == rescale->srcheight) {
+		memcpy(desc->pixel, rescale->source, desc->size);
+	} else if (!swpScaleImage(rescale->source, rescale->srcwidth, rescale->srcheight, desc->pixel, desc->width,
+	                          desc->height, g_prescale)) {
+		free(desc->pixel);
+		desc->pixel = NULL;
+		return;
+	}
+	swpVerbosePrintf("Rescaled %dx%d to %dx%d.\n", rescale->srcwidth, rescale->srcheight, desc->width, desc->height);
+
+	swpBuildMipmaps(desc);
+	swpCompressTexture(desc);
+}
+
+int swpRescaleTexture(swpRenderingState *state) {
+
+	swpRescale* rescale;
+	SDL_Event event = {0};
+	unsigned int width, height;
+	float rw, rh;
+
+	if (state->source.pixel == NULL)
+		return 0;
+
+	/*	One rescale at the time, the size is checked again once it is displayed.	*/
+	if (state->rescale != NULL) {
+		state->rescaledue = 1;
+		return 0;
+	}
+
+	/*	Only rescale when the size changed significantly.	*/
+	swpGetPrescaleSize(state->source.width, state->source.height, &width, &height);
+	rw = (float) width / (float) state->prescaled[0];
+	rh = (float) height / (float) state->prescaled[1];
+	if (rw > 0.8f && rw < 1.25f && rh > 0.8f && rh < 1.25f)
+		return 0;
+
+	rescale = calloc(1, sizeof(*rescale));
+	if (rescale == NULL)
+		return 0;
+	rescale->desc = state->source;
+	rescale->desc.width = width;
+	rescale->desc.height = height;
+	rescale->desc.size = width * height * 4;
+	rescale->desc.pixel = NULL;
+	rescale->desc.texture = 0;
+	rescale->source = state->source.pixel;
+	rescale->srcwidth = state->source.width;
+	rescale->srcheight = state->source.height;
+	state->rescale = rescale;
+
+	/*	Scaled, built and uploaded off the render thread, the current texture is displayed meanwhile.	*/
+	event.type = SDL_USEREVENT;
+	event.user.code = SWP_EVENT_RESCALED;
+	event.user.data1 = rescale;
+	swpSubmitPreparedUpload(&rescale->desc, swpPrepareRescale, &event);
+	return 1;
+}
+
+int swpFinishRescale(swpRenderingState *state, swpRescale *rescale) {
+
+	const int slot = (state->data.curtex - 1 + state->data.numtexs) % state->data.numtexs;
+	int updated = 0;
+
+	/*	Superseded by a newer picture, the full resolution picture was left to the rescale.	*/
+	if (rescale != state->rescale) {
+		if (rescale->desc.texture != 0) {
+			swpTrackVRAM(SWP_VRAM_TEXTURE, rescale->desc.texture, 0);
+			glDeleteTextures(1, &rescale->desc.texture);
+		}
+		swpReleasePixel(rescale->desc.pixel);
+		swpReleasePixel((void *) rescale->source);
+		free(rescale);
+		return 0;
+	}
+	state->rescale = NULL;
+
+	/*	Uploaded on the event without the upload thread.	*/
+	if (rescale->desc.texture == 0 && rescale->desc.pixel != NULL &&
+	    swpLoadTextureFromMem(&rescale->desc.texture, state->data.pbo[slot], &rescale->desc))
+		rescale->desc.pixel = NULL;
+	swpReleasePixel(rescale->desc.pixel);
+
+	/*	Replace the displayed texture, no longer shared with the cache.	*/
+	if (rescale->desc.texture != 0) {
+		if (state->data.texhash[slot] != 0) {
+			swpCacheReleaseTexture(state->data.texhash[slot]);
+			state->data.texhash[slot] = 0;
+		} else if (glIsTexture(state->data.texs[slot]) == GL_TRUE) {
+			swpTrackVRAM(SWP_VRAM_TEXTURE, state->data.texs[slot], 0);
+			glDeleteTextures(1, &state->data.texs[slot]);
+		}
+		state->data.texs[slot] = rescale->desc.texture;
+		state->data.topdown[slot] = 0;
+		state->prescaled[0] = rescale->desc.width;
+		state->prescaled[1] = rescale->desc.height;
+
+		/*	Rebind the displayed texture.	*/
+		state->toTexIndex = state->data.texs[slot];
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, state->data.texs[slot]);
+		updated = 1;
+	}
+	free(rescale);
+
+	/*	Drawable resized again while rescaling.	*/
+	if (state->rescaledue) {
+		state->rescaledue = 0;
+		swpRescaleTexture(state);
+	}
+	return updated;
+}
+
+/**
+ *	Downsample job shared by the tasks.
+ */
+typedef struct swp_downsample_job_t{
+	const unsigned char* src;       /*	*/
+	unsigned char* dst;             /*	*/
+	unsigned int width;             /*	Source width.	*/
+	unsigned int height;            /*	Source height.	*/
+}swpDownsampleJob;
+
+static void swpDownsampleTask(void *userdata, unsigned int index) {
+
+	const swpDownsampleJob* job = (const swpDownsampleJob *) userdata;
+	const unsigned int dstwidth = (job->width + 1) / 2;
+	const unsigned int dstheight = (job->height + 1) / 2;
+	const unsigned int end = SDL_min((index + 1) * SWP_SCALE_BAND, dstheight);
+	const size_t pitch = (size_t) job->width * 4;
+	unsigned int x, y, c;
+
+	for (y = index * SWP_SCALE_BAND; y < end; y++) {
+		/*	Odd sizes repeat the last row and column.	*/
+		const unsigned char* row0 = &job->src[(size_t) (y * 2) * pitch];
+		const unsigned char* row1 = &job->src[(size_t) SDL_min(y * 2 + 1, job->height - 1) * pitch];
+		unsigned char* dst = &job->dst[(size_t) y * dstwidth * 4];
+
+		for (x = 0; x < dstwidth; x++) {
+			const unsigned int x0 = x * 8;
+			const unsigned int x1 = SDL_min(x * 2 + 1, job->width - 1) * 4;
+			for (c = 0; c < 4; c++)
+				dst[x * 4 + c] = (unsigned char) ((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+		}
+	}
+}
+
+void swpDownsample2x(const void *__restrict__ src, unsigned int width, unsigned int height, void *__restrict__ dst) {
+
+	swpDownsampleJob job;
+
+	job.src = (const unsigned char *) src;
+	job.dst = (unsigned char *) dst;
+	job.width = width;
+	job.height = height;
+
+	swpParallelFor(((height + 1) / 2 + SWP_SCALE_BAND - 1) / SWP_SCALE_BAND, swpDownsampleTask, &job);
+}
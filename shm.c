@@ -0,0 +1,486 @@
+/**
+    Simple wallpaper program.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#define _POSIX_C_SOURCE 200809L
+#include "wallpaper.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_atomic.h>
+
+#define SWP_SHARED_INDEX "/swp-index-3"
+#define SWP_SHARED_MAGIC 0x53575043u     /*	'SWPC'	*/
+#define SWP_SHARED_NUM_SLOTS 256
+
+/**
+ *	Slot states.
+ */
+#define SWP_SHARED_EMPTY    0
+#define SWP_SHARED_WRITING  1
+#define SWP_SHARED_READY    2
+#define SWP_SHARED_EVICTING 3
+#define SWP_SHARED_STATE_MASK 0x3
+
+/**
+ *	Slot tag of the picture in the state, the hash
+ *	and the state are claimed with a single exchange.
+ */
+#define SWP_SHARED_TAG(hash, state) (((Uint64) (hash) & ~(Uint64) SWP_SHARED_STATE_MASK) | (state))
+
+/**
+ *	Picture published in the shared cache. The pixel data is
+ *	in a segment named by the slot and the hash, so processes
+ *	publishing the same picture never write the same segment.
+ */
+typedef struct swp_shared_slot_t{
+	_Atomic Uint64 tag;             /*	Content hash in the upper bits, slot state in the lower two.	*/
+	_Atomic Uint32 owner;           /*	Process writing or evicting the slot, 0 if none.	*/
+	_Atomic Uint64 lastuse;         /*	LRU clock of last use.	*/
+	Uint64 hash;                    /*	Full content hash, written by the owner.	*/
+	Uint64 size;                    /*	Size of the pixel data in bytes.	*/
+	Uint32 width;                   /*	*/
+	Uint32 height;                  /*	*/
+	Uint32 bpp;                     /*	*/
+	Uint32 intfor;                  /*	*/
+	Uint32 format;                  /*	*/
+	Uint32 imgdatatype;             /*	*/
+}swpSharedSlot;
+
+/**
+ *	Index shared by all processes, modified
+ *	only with atomic operations.
+ */
+typedef struct swp_shared_index_t{
+	_Atomic Uint32 magic;           /*	Set when initialized.	*/
+	_Atomic Uint64 budget;          /*	Global budget in bytes, set by the first process.	*/
+	_Atomic Uint64 clock;           /*	LRU clock shared by the processes.	*/
+	swpSharedSlot slots[SWP_SHARED_NUM_SLOTS];
+}swpSharedIndex;
+
+/**
+ *	Pixel data mapped from a shared segment.
+ */
+typedef struct swp_shared_mapping_t{
+	void* pixel;                    /*	*/
+	size_t size;                    /*	*/
+}swpSharedMapping;
+
+size_t g_sharedcache = 0;
+
+static SDL_SpinLock g_sharedinit = 0;
+static unsigned int g_sharedopened = 0;
+static swpSharedIndex* g_sharedindex = NULL;
+static SDL_SpinLock g_mappinginit = 0;
+static SDL_mutex* g_sharedlock = NULL;          /*	Protects the mapping list.	*/
+static swpSharedMapping* g_sharedmappings = NULL;
+static unsigned int g_numsharedmappings = 0;
+
+static void swpLockMappings(void) {
+
+	/*	Create the lock on first use.	*/
+	SDL_AtomicLock(&g_mappinginit);
+	if (g_sharedlock == NULL)
+		g_sharedlock = SDL_CreateMutex();
+	SDL_AtomicUnlock(&g_mappinginit);
+
+	SDL_LockMutex(g_sharedlock);
+}
+
+int swpAddPixelMapping(void *pixel, size_t size) {
+
+	swpSharedMapping* mappings;
+
+	swpLockMappings();
+	mappings = realloc(g_sharedmappings, (g_numsharedmappings + 1) * sizeof(swpSharedMapping));
+	if (mappings == NULL) {
+		SDL_UnlockMutex(g_sharedlock);
+		return 0;
+	}
+	g_sharedmappings = mappings;
+	g_sharedmappings[g_numsharedmappings].pixel = pixel;
+	g_sharedmappings[g_numsharedmappings].size = size;
+	g_numsharedmappings++;
+	SDL_UnlockMutex(g_sharedlock);
+
+	return 1;
+}
+
+static void swpGetSharedName(const swpSharedSlot *slot, Uint64 hash, char *name, size_t size) {
+	snprintf(name, size, "/swp-%03u-%016llx", (unsigned int) (slot - g_sharedindex->slots), (unsigned long long) hash);
+}
+
+static swpSharedIndex *swpOpenSharedIndex(void) {
+
+	struct stat st;
+	void* index;
+	Uint32 expected = 0;
+	Uint64 budget = 0;
+	int fd;
+
+	if (g_sharedcache == 0)
+		return NULL;
+
+	/*	Opened once, failure is not retried.	*/
+	SDL_AtomicLock(&g_sharedinit);
+	if (g_sharedopened) {
+		SDL_AtomicUnlock(&g_sharedinit);
+		return g_sharedindex;
+	}
+	g_sharedopened = 1;
+
+	fd = shm_open(SWP_SHARED_INDEX, O_RDWR | O_CREAT, 0600);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open shared cache index, %s.\n", strerror(errno));
+		SDL_AtomicUnlock(&g_sharedinit);
+		return NULL;
+	}
+
+	/*	First process sizes the index, zero filled.	*/
+	if (fstat(fd, &st) < 0 || (st.st_size < (off_t) sizeof(swpSharedIndex) &&
+	                            ftruncate(fd, sizeof(swpSharedIndex)) < 0)) {
+		fprintf(stderr, "Failed to size shared cache index, %s.\n", strerror(errno));
+		close(fd);
+		SDL_AtomicUnlock(&g_sharedinit);
+		return NULL;
+	}
+
+	index = mmap(NULL, sizeof(swpSharedIndex), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (index == MAP_FAILED) {
+		fprintf(stderr, "Failed to map shared cache index, %s.\n", strerror(errno));
+		SDL_AtomicUnlock(&g_sharedinit);
+		return NULL;
+	}
+
+	g_sharedindex = (swpSharedIndex *) index;
+	atomic_compare_exchange_strong(&g_sharedindex->budget, &budget, (Uint64) g_sharedcache);
+	atomic_compare_exchange_strong(&g_sharedindex->magic, &expected, SWP_SHARED_MAGIC);
+	swpVerbosePrintf("Shared cache budget %llu MB.\n",
+	                 (unsigned long long) atomic_load(&g_sharedindex->budget) / (1024 * 1024));
+	SDL_AtomicUnlock(&g_sharedinit);
+
+	return g_sharedindex;
+}
+
+/**
+ *	Take over the slot if the process writing or evicting it
+ *	has died, and remove the segment it left behind.
+ *
+ *	@Return non-zero if the slot was reclaimed.
+ */
+static int swpReclaimSharedSlot(swpSharedSlot *slot) {
+
+	Uint32 owner = atomic_load(&slot->owner);
+	Uint64 tag;
+	char name[32];
+
+	if (owner == 0 || kill((pid_t) owner, 0) == 0 || errno != ESRCH)
+		return 0;
+	if (!atomic_compare_exchange_strong(&slot->owner, &owner, (Uint32) getpid()))
+		return 0;
+
+	tag = atomic_load(&slot->tag);
+	if ((tag & SWP_SHARED_STATE_MASK) == SWP_SHARED_WRITING || (tag & SWP_SHARED_STATE_MASK) == SWP_SHARED_EVICTING) {
+		swpGetSharedName(slot, slot->hash, name, sizeof(name));
+		shm_unlink(name);
+		atomic_store(&slot->tag, SWP_SHARED_EMPTY);
+		swpVerbosePrintf("Reclaimed shared cache slot of exited process %d.\n", owner);
+	}
+	atomic_store(&slot->owner, 0);
+	return 1;
+}
+
+/**
+ *	@Return bytes of the pictures published or being published.
+ */
+static Uint64 swpGetSharedUsage(swpSharedIndex *index) {
+
+	Uint64 used = 0;
+	unsigned int i;
+
+	for (i = 0; i < SWP_SHARED_NUM_SLOTS; i++) {
+		swpSharedSlot* slot = &index->slots[i];
+		if ((atomic_load(&slot->tag) & SWP_SHARED_STATE_MASK) != SWP_SHARED_EMPTY && !swpReclaimSharedSlot(slot))
+			used += slot->size;
+	}
+	return used;
+}
+
+static int swpEvictShared(swpSharedIndex *index, Uint64 size) {
+
+	const Uint64 budget = atomic_load(&index->budget);
+	const Uint32 pid = (Uint32) getpid();
+	char name[32];
+
+	if (size > budget)
+		return 0;
+
+	/*	Usage is summed from the slots, including the slot claimed for the picture,
+	 *	so slots of exited processes never leak their bytes.	*/
+	while (swpGetSharedUsage(index) > budget) {
+		swpSharedSlot* victim = NULL;
+		Uint64 oldest = 0, tag = 0;
+		Uint32 owner = 0;
+		unsigned int i;
+
+		for (i = 0; i < SWP_SHARED_NUM_SLOTS; i++) {
+			swpSharedSlot* slot = &index->slots[i];
+			Uint64 lastuse = atomic_load(&slot->lastuse);
+			Uint64 slottag = atomic_load(&slot->tag);
+			if ((slottag & SWP_SHARED_STATE_MASK) == SWP_SHARED_READY && (victim == NULL || lastuse < oldest)) {
+				victim = slot;
+				oldest = lastuse;
+				tag = slottag;
+			}
+		}
+		if (victim == NULL)
+			return 0;
+
+		/*	Another process may evict the same slot.	*/
+		if (!atomic_compare_exchange_strong(&victim->owner, &owner, pid))
+			continue;
+		if (!atomic_compare_exchange_strong(&victim->tag, &tag, (tag & ~(Uint64) SWP_SHARED_STATE_MASK) |
+		                                                        SWP_SHARED_EVICTING)) {
+			atomic_store(&victim->owner, 0);
+			continue;
+		}
+
+		/*	Processes that mapped the segment keep their mapping.	*/
+		swpGetSharedName(victim, victim->hash, name, sizeof(name));
+		shm_unlink(name);
+		atomic_store(&victim->tag, SWP_SHARED_EMPTY);
+		atomic_store(&victim->owner, 0);
+	}
+
+	return 1;
+}
+
+int swpSharedLookup(Uint64 hash, swpTextureDesc *desc) {
+
+	swpSharedIndex* index = swpOpenSharedIndex();
+	struct stat st;
+	char name[32];
+	void* pixel;
+	unsigned int i;
+	int fd;
+
+	if (index == NULL)
+		return 0;
+
+	for (i = 0; i < SWP_SHARED_NUM_SLOTS; i++) {
+		swpSharedSlot* slot = &index->slots[(hash + i) % SWP_SHARED_NUM_SLOTS];
+
+		if (atomic_load(&slot->tag) != SWP_SHARED_TAG(hash, SWP_SHARED_READY) || slot->hash != hash)
+			continue;
+
+		/*	Map the pixel data read-only, the segment may have been evicted since.	*/
+		swpGetSharedName(slot, hash, name, sizeof(name));
+		fd = shm_open(name, O_RDONLY, 0);
+		if (fd < 0)
+			return 0;
+		if (fstat(fd, &st) < 0 || (Uint64) st.st_size != slot->size) {
+			close(fd);
+			return 0;
+		}
+		pixel = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (pixel == MAP_FAILED)
+			return 0;
+
+		/*	Remember the mapping so it can be released with swpReleasePixel.	*/
+		if (!swpAddPixelMapping(pixel, (size_t) st.st_size)) {
+			munmap(pixel, (size_t) st.st_size);
+			return 0;
+		}
+
+		atomic_store(&slot->lastuse, atomic_fetch_add(&index->clock, 1) + 1);
+
+		memset(desc, 0, sizeof(*desc));
+		desc->width = slot->width;
+		desc->height = slot->height;
+		desc->bpp = slot->bpp;
+		desc->size = (unsigned int) st.st_size;
+		desc->intfor = slot->intfor;
+		desc->format = slot->format;
+		desc->imgdatatype = slot->imgdatatype;
+		desc->pixel = pixel;
+		desc->hash = hash;
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ *	Release the claim of the slot.
+ */
+static void swpReleaseSharedSlot(swpSharedSlot *slot) {
+
+	atomic_store(&slot->tag, SWP_SHARED_EMPTY);
+	atomic_store(&slot->owner, 0);
+}
+
+void swpSharedPublish(Uint64 hash, const swpTextureDesc *desc) {
+
+	swpSharedIndex* index = swpOpenSharedIndex();
+	swpSharedSlot* slot = NULL;
+	const void* pixel = desc->source != NULL ? desc->source : desc->pixel;
+	const unsigned int width = desc->source != NULL ? desc->srcwidth : desc->width;
+	const unsigned int height = desc->source != NULL ? desc->srcheight : desc->height;
+	const Uint64 size = (Uint64) width * height * desc->bpp;
+	const Uint32 pid = (Uint32) getpid();
+	char name[32];
+	void* dst;
+	unsigned int i;
+	int fd;
+
+	if (index == NULL)
+		return;
+
+	/*	Claim a slot, unless another process has published or is publishing the picture.	*/
+	for (i = 0; i < SWP_SHARED_NUM_SLOTS; i++) {
+		swpSharedSlot* probe = &index->slots[(hash + i) % SWP_SHARED_NUM_SLOTS];
+		Uint64 tag = atomic_load(&probe->tag);
+		Uint32 owner = 0;
+
+		if ((tag & SWP_SHARED_STATE_MASK) != SWP_SHARED_EMPTY && (tag & ~(Uint64) SWP_SHARED_STATE_MASK) ==
+		                                                         (hash & ~(Uint64) SWP_SHARED_STATE_MASK)) {
+			/*	Unless the publisher has exited.	*/
+			if (!swpReclaimSharedSlot(probe))
+				return;
+			tag = atomic_load(&probe->tag);
+		}
+		if ((tag & SWP_SHARED_STATE_MASK) != SWP_SHARED_EMPTY)
+			continue;
+
+		/*	The owner is set first, a process exiting at any point leaves a slot that can be reclaimed.
+		 *	The slot is checked again when another process claimed it, it may publish the same picture.	*/
+		if (!atomic_compare_exchange_strong(&probe->owner, &owner, pid)) {
+			swpReclaimSharedSlot(probe);
+			i--;
+			continue;
+		}
+		probe->hash = hash;
+		probe->size = size;
+		tag = SWP_SHARED_EMPTY;
+		if (atomic_compare_exchange_strong(&probe->tag, &tag, SWP_SHARED_TAG(hash, SWP_SHARED_WRITING))) {
+			slot = probe;
+			break;
+		}
+		atomic_store(&probe->owner, 0);
+		i--;
+	}
+	if (slot == NULL)
+		return;
+
+	/*	A slot emptied behind the probe may have been claimed for the same picture meanwhile.
+	 *	Back off if it is ready, or if it is being written and comes first in the probe order.	*/
+	for (i = 0; i < SWP_SHARED_NUM_SLOTS; i++) {
+		swpSharedSlot* other = &index->slots[(hash + i) % SWP_SHARED_NUM_SLOTS];
+		const Uint64 tag = atomic_load(&other->tag);
+
+		if (other == slot)
+			break;
+		if (tag == SWP_SHARED_TAG(hash, SWP_SHARED_WRITING) || tag == SWP_SHARED_TAG(hash, SWP_SHARED_READY)) {
+			swpReleaseSharedSlot(slot);
+			return;
+		}
+	}
+	for (i++; i < SWP_SHARED_NUM_SLOTS; i++) {
+		swpSharedSlot* other = &index->slots[(hash + i) % SWP_SHARED_NUM_SLOTS];
+
+		if (atomic_load(&other->tag) == SWP_SHARED_TAG(hash, SWP_SHARED_READY)) {
+			swpReleaseSharedSlot(slot);
+			return;
+		}
+	}
+
+	if (!swpEvictShared(index, size)) {
+		swpReleaseSharedSlot(slot);
+		return;
+	}
+
+	/*	Write the pixel data to the segment of the slot, only the owner of the slot
+	 *	writes it. An existing segment was left by a process that exited, it is removed.	*/
+	swpGetSharedName(slot, hash, name, sizeof(name));
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0 && errno == EEXIST) {
+		shm_unlink(name);
+		fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	}
+	if (fd < 0 || ftruncate(fd, (off_t) size) < 0 ||
+	    (dst = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		fprintf(stderr, "Failed to create shared picture %s, %s.\n", name, strerror(errno));
+		if (fd >= 0) {
+			close(fd);
+			shm_unlink(name);
+		}
+		swpReleaseSharedSlot(slot);
+		return;
+	}
+	close(fd);
+	memcpy(dst, pixel, size);
+	munmap(dst, size);
+
+	slot->width = width;
+	slot->height = height;
+	slot->bpp = desc->bpp;
+	slot->intfor = desc->intfor;
+	slot->format = desc->format;
+	slot->imgdatatype = desc->imgdatatype;
+	atomic_store(&slot->lastuse, atomic_fetch_add(&index->clock, 1) + 1);
+
+	/*	Visible to the other processes once ready.	*/
+	atomic_store(&slot->tag, SWP_SHARED_TAG(hash, SWP_SHARED_READY));
+	atomic_store(&slot->owner, 0);
+	swpVerbosePrintf("Published %dx%d picture to the shared cache.\n", width, height);
+}
+
+void swpReleasePixel(void *pixel) {
+
+	unsigned int i;
+
+	if (pixel == NULL)
+		return;
+
+	/*	Pixel data mapped from the shared cache or a file.	*/
+	if (g_sharedlock != NULL) {
+		swpLockMappings();
+		for (i = 0; i < g_numsharedmappings; i++) {
+			if (g_sharedmappings[i].pixel == pixel) {
+				munmap(pixel, g_sharedmappings[i].size);
+				g_sharedmappings[i] = g_sharedmappings[g_numsharedmappings - 1];
+				g_numsharedmappings--;
+				SDL_UnlockMutex(g_sharedlock);
+				return;
+			}
+		}
+		SDL_UnlockMutex(g_sharedlock);
+	}
+
+	free(pixel);
+}
@@ -0,0 +1,206 @@
+/**
+    Simple wallpaper application.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "wallpaper.h"
+
+#include <stdlib.h>
+
+unsigned int g_slicebudget = 4;
+
+/**
+ *	Pictures of at least this size are sliced
+ *	even when no transition is running.
+ */
+#define SWP_SLICE_MIN_SIZE (16 * 1024 * 1024)
+
+/**
+ *	Rows of each band, a multiple of the
+ *	block height of the compressed formats.
+ */
+#define SWP_SLICE_ROWS 64
+
+/**
+ *	@Return non-zero if the picture can be
+ *	uploaded level by level into immutable storage.
+ */
+static int swpIsSliceable(const swpRenderingState *state, const swpTextureDesc *desc) {
+
+	if (g_slicebudget == 0 || !g_support_texture_storage || g_uploadthread)
+		return 0;
+	if (desc->texture != 0 || desc->pixel == NULL || desc->animation != NULL || desc->tiled != NULL ||
+	    desc->numlevels == 0)
+		return 0;
+
+	/*	Formats left to the driver to compress are uploaded at once.	*/
+	if (swpGetStorageFormat(desc->intfor) == 0 ||
+	    (!desc->compressed && g_compression != SWP_COMPRESSION_NONE && !g_support_s3tc))
+		return 0;
+
+	return state->inTransition || desc->size >= SWP_SLICE_MIN_SIZE;
+}
+
+/**
+ *	@Return number of rows in a band of the level,
+ *	block rows if the level is compressed.
+ */
+static unsigned int swpGetSliceRows(const swpTextureDesc *desc, const swpTextureLevel *level) {
+
+	return desc->compressed ? (level->height + 3) / 4 : level->height;
+}
+
+/**
+ *	Release the texture and the pixel data of the job.
+ */
+static void swpFreeSlicedUpload(swpSlicedUpload *sliced) {
+
+	if (glIsTexture(sliced->texture) == GL_TRUE) {
+		swpTrackVRAM(SWP_VRAM_TEXTURE, sliced->texture, 0);
+		glDeleteTextures(1, &sliced->texture);
+	}
+	swpReleasePixel(sliced->upload.pixel);
+	swpReleasePixel(sliced->desc->source);
+	sliced->desc->source = NULL;
+	free(sliced);
+}
+
+int swpBeginSlicedUpload(swpRenderingState *state, swpTextureDesc *desc) {
+
+	swpSlicedUpload* sliced;
+	GLenum storagefor;
+
+	if (!swpIsSliceable(state, desc))
+		return 0;
+
+	sliced = calloc(1, sizeof(swpSlicedUpload));
+	if (sliced == NULL)
+		return 0;
+
+	/*	The newest picture supersedes the one not yet complete.	*/
+	if (state->sliced != NULL) {
+		swpVerbosePrintf("Sliced upload superseded by a newer picture.\n");
+		swpFreeSlicedUpload(state->sliced);
+		state->sliced = NULL;
+	}
+
+	/*	Storage is allocated at once, within the VRAM budget.	*/
+	if (!swpFitVRAMBudget(desc, &sliced->upload, 0))
+		sliced->upload = *desc;
+	else if (sliced->upload.pixel != desc->pixel)
+		swpReleasePixel(desc->pixel);
+	desc->pixel = NULL;
+	storagefor = swpGetStorageFormat(sliced->upload.intfor);
+	sliced->desc = desc;
+	sliced->texture = swpCreateTextureStorage(storagefor, sliced->upload.width, sliced->upload.height,
+	                                          sliced->upload.numlevels);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	swpTrackVRAM(SWP_VRAM_TEXTURE, sliced->texture,
+	             swpGetVRAMSize(storagefor, sliced->upload.width, sliced->upload.height, sliced->upload.numlevels));
+
+	swpVerbosePrintf("Slicing upload of %dx%d picture, %d levels.\n", sliced->upload.width, sliced->upload.height,
+	                 sliced->upload.numlevels);
+	state->sliced = sliced;
+	return 1;
+}
+
+/**
+ *	Upload the rows [\first, \first + \count) of the level of the job.
+ */
+static void swpUploadBand(const swpSlicedUpload *sliced, unsigned int first, unsigned int count) {
+
+	const swpTextureDesc *desc = &sliced->upload;
+	const swpTextureLevel *level = &desc->levels[sliced->level];
+	const size_t pitch = level->size / swpGetSliceRows(desc, level);
+	const GLubyte *pixel = (const GLubyte *) desc->pixel + level->offset + pitch * first;
+	const GLint yoffset = (GLint) (desc->compressed ? first * 4 : first);
+	const GLsizei height = (GLsizei) SDL_min(desc->compressed ? count * 4 : count, level->height - (unsigned int) yoffset);
+
+	if (g_support_dsa) {
+		if (desc->compressed)
+			glCompressedTextureSubImage2D(sliced->texture, (GLint) sliced->level, 0, yoffset, (GLsizei) level->width,
+			                              height, desc->intfor, (GLsizei) (pitch * count), pixel);
+		else
+			glTextureSubImage2D(sliced->texture, (GLint) sliced->level, 0, yoffset, (GLsizei) level->width, height,
+			                    desc->format, desc->imgdatatype, pixel);
+	} else {
+		if (desc->compressed)
+			glCompressedTexSubImage2DARB(GL_TEXTURE_2D, (GLint) sliced->level, 0, yoffset, (GLsizei) level->width,
+			                             height, desc->intfor, (GLsizei) (pitch * count), pixel);
+		else
+			glTexSubImage2D(GL_TEXTURE_2D, (GLint) sliced->level, 0, yoffset, (GLsizei) level->width, height,
+			                desc->format, desc->imgdatatype, pixel);
+	}
+}
+
+void swpStepSlicedUpload(swpRenderingState *state) {
+
+	swpSlicedUpload* sliced = state->sliced;
+	const Uint64 start = SDL_GetPerformanceCounter();
+	const Uint64 budget = SDL_GetPerformanceFrequency() * g_slicebudget / 1000;
+	unsigned int rows, count;
+	SDL_Event event = {0};
+
+	if (sliced == NULL)
+		return;
+
+	/*	Bands are read from the client memory, not the unpack buffer.	*/
+	if (g_support_pbo)
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	if (!g_support_dsa)
+		glBindTexture(GL_TEXTURE_2D, sliced->texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, sliced->upload.alignment > 0 ? sliced->upload.alignment : 4);
+
+	/*	At least one band each frame, more while within the budget.	*/
+	do {
+		rows = swpGetSliceRows(&sliced->upload, &sliced->upload.levels[sliced->level]);
+		count = SDL_min(SWP_SLICE_ROWS, rows - sliced->row);
+		swpUploadBand(sliced, sliced->row, count);
+		sliced->row += count;
+		if (sliced->row >= rows) {
+			sliced->row = 0;
+			sliced->level++;
+		}
+	} while (sliced->level < sliced->upload.numlevels && SDL_GetPerformanceCounter() - start < budget);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (!g_support_dsa)
+		glBindTexture(GL_TEXTURE_2D, 0);
+	glFlush();
+
+	if (sliced->level < sliced->upload.numlevels)
+		return;
+
+	/*	Complete, promoted by the path of the textures uploaded ahead.	*/
+	swpVerbosePrintf("Sliced upload complete.\n");
+	sliced->desc->texture = sliced->texture;
+	swpReleasePixel(sliced->upload.pixel);
+	state->sliced = NULL;
+
+	event.type = SDL_USEREVENT;
+	event.user.code = SWP_EVENT_UPDATE_IMAGE;
+	event.user.data1 = sliced->desc;
+	SDL_PushEvent(&event);
+	free(sliced);
+}
+
+void swpReleaseSlicedUpload(swpRenderingState *state) {
+
+	if (state->sliced == NULL)
+		return;
+	swpFreeSlicedUpload(state->sliced);
+	state->sliced = NULL;
+}
@@ -0,0 +1,467 @@
+/**
+    Simple wallpaper application.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#define _POSIX_C_SOURCE 200809L
+#include "wallpaper.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_error.h>
+
+#define SWP_SNAPSHOT_MAGIC 0x53505753u   /*	'SWPS'	*/
+#define SWP_SNAPSHOT_VERSION 1
+#define SWP_SNAPSHOT_DATA_OFFSET 4096   /*	Pixel data starts on the second page.	*/
+
+/**
+ *	Snapshot file header, followed by bottom-up
+ *	BGRA pixel data at SWP_SNAPSHOT_DATA_OFFSET.
+ */
+typedef struct swp_snapshot_header_t{
+	Uint32 magic;                   /*	SWP_SNAPSHOT_MAGIC.	*/
+	Uint32 version;                 /*	SWP_SNAPSHOT_VERSION.	*/
+	Uint32 width;                   /*	*/
+	Uint32 height;                  /*	*/
+	Uint32 intfor;                  /*	Texture internal format.	*/
+	Uint32 reserved[3];             /*	*/
+}swpSnapshotHeader;
+
+/**
+ *	Read back picture waiting to be written.
+ */
+typedef struct swp_snapshot_job_t{
+	unsigned char* pixel;           /*	Read back texture level.	*/
+	unsigned int width;             /*	*/
+	unsigned int height;            /*	*/
+	unsigned int dstwidth;          /*	Drawable size.	*/
+	unsigned int dstheight;         /*	*/
+	GLuint intfor;                  /*	*/
+	unsigned int topdown;           /*	Rows read back top-down.	*/
+}swpSnapshotJob;
+
+static SDL_mutex* g_snapshotlock = NULL;
+static SDL_cond* g_snapshotcond = NULL;
+static SDL_Thread* g_snapshotthread = NULL;
+static swpSnapshotJob* g_snapshotjob = NULL;    /*	Pending job, replaced by newer pictures.	*/
+static unsigned int g_snapshotquit = 0;
+static char g_snapshotpath[4096] = {0};
+static unsigned int g_snapshotdue = 0;              /*	Displayed picture changed since the last snapshot.	*/
+static GLuint g_snapshotbuffer = 0;                 /*	Pack buffer of the asynchronous read back.	*/
+static GLsync g_snapshotfence = NULL;               /*	Signaled when the read back is complete, NULL if none.	*/
+static swpSnapshotJob* g_snapshotpending = NULL;    /*	Job of the read back in flight.	*/
+
+int swpGetCachePath(char *path, size_t size, const char *name, int create) {
+
+	const char* cachehome = getenv("XDG_CACHE_HOME");
+	const char* home = getenv("HOME");
+	char dir[4096];
+
+	/*	$XDG_CACHE_HOME/swp, defaulting to $HOME/.cache/swp.	*/
+	if (cachehome != NULL && cachehome[0] == '/')
+		snprintf(dir, sizeof(dir), "%s", cachehome);
+	else if (home != NULL)
+		snprintf(dir, sizeof(dir), "%s/.cache", home);
+	else
+		return 0;
+	if (create && mkdir(dir, 0700) != 0 && errno != EEXIST)
+		return 0;
+	strncat(dir, "/swp", sizeof(dir) - strlen(dir) - 1);
+	if (create && mkdir(dir, 0700) != 0 && errno != EEXIST) {
+		fprintf(stderr, "Failed to create %s, %s.\n", dir, strerror(errno));
+		return 0;
+	}
+
+	return snprintf(path, size, "%s/%s", dir, name) < (int) size;
+}
+
+static const char *swpGetSnapshotPath(int create) {
+
+	char name[64];
+	swpHashState hash;
+
+	/*	One snapshot per FIFO, each instance on a monitor has its own.	*/
+	swpHashInit(&hash);
+	swpHashUpdate(&hash, g_fifopath, strlen(g_fifopath));
+	snprintf(name, sizeof(name), "snapshot-%016llx.bgra", (unsigned long long) swpHashDigest(&hash));
+	if (!swpGetCachePath(g_snapshotpath, sizeof(g_snapshotpath), name, create))
+		return NULL;
+	return g_snapshotpath;
+}
+
+static int swpWriteFull(int fd, const unsigned char *buf, size_t len) {
+
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, buf, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return 0;
+		buf += n;
+		len -= (size_t) n;
+	}
+	return 1;
+}
+
+static void swpWriteSnapshot(swpSnapshotJob *job) {
+
+	unsigned char header[SWP_SNAPSHOT_DATA_OFFSET] = {0};
+	swpSnapshotHeader* snapheader = (swpSnapshotHeader *) header;
+	const unsigned char* pixel = job->pixel;
+	unsigned char* scaled = NULL;
+	const char* path;
+	char tmppath[4096 + 32];
+	unsigned int y;
+	int fd;
+
+	path = swpGetSnapshotPath(1);
+	if (path == NULL)
+		return;
+
+	/*	Snapshots are stored bottom-up.	*/
+	if (job->topdown) {
+		const size_t rowpitch = (size_t) job->width * 4;
+		unsigned char* row = malloc(rowpitch);
+		if (row == NULL)
+			return;
+		for (y = 0; y < job->height / 2; y++) {
+			memcpy(row, &job->pixel[y * rowpitch], rowpitch);
+			memcpy(&job->pixel[y * rowpitch], &job->pixel[(job->height - 1 - y) * rowpitch], rowpitch);
+			memcpy(&job->pixel[(job->height - 1 - y) * rowpitch], row, rowpitch);
+		}
+		free(row);
+	}
+
+	/*	Scale the texture level to the drawable, so the restore is a plain upload.	*/
+	if (job->width != job->dstwidth || job->height != job->dstheight) {
+		scaled = malloc((size_t) job->dstwidth * job->dstheight * 4);
+		if (scaled == NULL || !swpScaleImage(job->pixel, job->width, job->height, scaled, job->dstwidth,
+		                                     job->dstheight, SWP_FILTER_LANCZOS3)) {
+			free(scaled);
+			return;
+		}
+		pixel = scaled;
+	}
+
+	snapheader->magic = SWP_SNAPSHOT_MAGIC;
+	snapheader->version = SWP_SNAPSHOT_VERSION;
+	snapheader->width = job->dstwidth;
+	snapheader->height = job->dstheight;
+	snapheader->intfor = job->intfor;
+
+	/*	Replace the previous snapshot atomically, a crash never leaves a partial file.	*/
+	snprintf(tmppath, sizeof(tmppath), "%s.%ld", path, (long) getpid());
+	fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to create snapshot %s, %s.\n", tmppath, strerror(errno));
+		free(scaled);
+		return;
+	}
+	if (!swpWriteFull(fd, header, sizeof(header)) ||
+	    !swpWriteFull(fd, pixel, (size_t) job->dstwidth * job->dstheight * 4)) {
+		fprintf(stderr, "Failed to write snapshot %s, %s.\n", tmppath, strerror(errno));
+		close(fd);
+		unlink(tmppath);
+		free(scaled);
+		return;
+	}
+	close(fd);
+	if (rename(tmppath, path) != 0) {
+		fprintf(stderr, "Failed to rename snapshot %s, %s.\n", tmppath, strerror(errno));
+		unlink(tmppath);
+	}
+	swpVerbosePrintf("Saved %dx%d snapshot to %s.\n", job->dstwidth, job->dstheight, path);
+	free(scaled);
+}
+
+static int swpSnapshotWriter(void *userdata) {
+
+	swpSnapshotJob* job;
+
+	SDL_LockMutex(g_snapshotlock);
+	for (;;) {
+		while (g_snapshotjob == NULL && !g_snapshotquit)
+			SDL_CondWait(g_snapshotcond, g_snapshotlock);
+
+		/*	The pending snapshot is still written on exit.	*/
+		job = g_snapshotjob;
+		g_snapshotjob = NULL;
+		if (job == NULL)
+			break;
+		SDL_UnlockMutex(g_snapshotlock);
+
+		swpWriteSnapshot(job);
+		free(job->pixel);
+		free(job);
+
+		SDL_LockMutex(g_snapshotlock);
+	}
+	SDL_UnlockMutex(g_snapshotlock);
+
+	return 0;
+}
+
+int swpLoadSnapshot(swpRenderingState *state) {
+
+	const swpSnapshotHeader* header;
+	swpTextureDesc desc = {0};
+	const char* path;
+	struct stat st;
+	unsigned char* data;
+	size_t size;
+	int fd;
+
+	path = swpGetSnapshotPath(0);
+	if (path == NULL)
+		return 0;
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < SWP_SNAPSHOT_DATA_OFFSET) {
+		close(fd);
+		return 0;
+	}
+	size = (size_t) st.st_size;
+	data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return 0;
+
+	header = (const swpSnapshotHeader *) data;
+	if (header->magic != SWP_SNAPSHOT_MAGIC || header->version != SWP_SNAPSHOT_VERSION ||
+	    header->width == 0 || header->height == 0 ||
+	    header->width > (unsigned int) g_maxtexsize || header->height > (unsigned int) g_maxtexsize ||
+	    size < SWP_SNAPSHOT_DATA_OFFSET + (size_t) header->width * header->height * 4 ||
+	    !swpAddPixelMapping(data, size)) {
+		munmap(data, size);
+		return 0;
+	}
+
+	/*	Single pre-built level, uploaded straight from the page cache without mipmap generation.	*/
+	desc.width = header->width;
+	desc.height = header->height;
+	desc.bpp = 4;
+	desc.size = (unsigned int) size;
+	desc.intfor = header->intfor == GL_RGBA ? GL_RGBA : GL_RGB;
+	desc.format = GL_BGRA;
+	desc.imgdatatype = GL_UNSIGNED_BYTE;
+	desc.pixel = data;
+	desc.alignment = 4;
+	desc.numlevels = 1;
+	desc.levels[0].width = header->width;
+	desc.levels[0].height = header->height;
+	desc.levels[0].offset = SWP_SNAPSHOT_DATA_OFFSET;
+	desc.levels[0].size = (size_t) header->width * header->height * 4;
+	swpVerbosePrintf("Restoring %dx%d snapshot from %s.\n", desc.width, desc.height, path);
+
+	/*	The snapshot exists, failing to display it is an error of the upload path.	*/
+	if (!swpLoadTextureFromMem(&state->data.texs[state->data.curtex], state->data.pbo[state->data.curtex], &desc) ||
+	    glIsTexture(state->data.texs[state->data.curtex]) == GL_FALSE) {
+		fprintf(stderr, "Failed to restore the snapshot %s.\n", path);
+		return 0;
+	}
+
+	state->toTexIndex = state->data.texs[state->data.curtex];
+	state->data.topdown[state->data.curtex] = 0;
+	state->picsize[0] = desc.width;
+	state->picsize[1] = desc.height;
+	state->data.curtex = (state->data.curtex + 1) % state->data.numtexs;
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, state->toTexIndex);
+	return 1;
+}
+
+void swpSaveSnapshot(void) {
+
+	/*	Read back on a later idle pass, not on the frame the picture is displayed.	*/
+	g_snapshotdue = 1;
+}
+
+/**
+ *	Hand the read back picture over to the writer,
+ *	superseding a snapshot not yet written.
+ */
+static void swpSubmitSnapshot(swpSnapshotJob *job) {
+
+	/*	Create the writer on first use.	*/
+	if (g_snapshotthread == NULL) {
+		g_snapshotlock = SDL_CreateMutex();
+		g_snapshotcond = SDL_CreateCond();
+		g_snapshotthread = SDL_CreateThread(swpSnapshotWriter, "snapshot", NULL);
+		if (g_snapshotthread == NULL) {
+			fprintf(stderr, "Failed to create thread, %s.\n", SDL_GetError());
+			free(job->pixel);
+			free(job);
+			return;
+		}
+	}
+
+	SDL_LockMutex(g_snapshotlock);
+	if (g_snapshotjob != NULL) {
+		free(g_snapshotjob->pixel);
+		free(g_snapshotjob);
+	}
+	g_snapshotjob = job;
+	SDL_CondSignal(g_snapshotcond);
+	SDL_UnlockMutex(g_snapshotlock);
+}
+
+/**
+ *	Copy the read back pixels out of the pack buffer
+ *	once the fence of \timeout nanoseconds has signaled.
+ *
+ *	@Return non-zero if the read back is still in flight.
+ */
+static int swpFinishSnapshotReadback(GLuint64 timeout) {
+
+	const void* pbuf;
+	GLenum status;
+
+	if (g_snapshotfence == NULL)
+		return 0;
+	status = glClientWaitSync(g_snapshotfence, timeout > 0 ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, timeout);
+	if (status == GL_TIMEOUT_EXPIRED)
+		return 1;
+	glDeleteSync(g_snapshotfence);
+	g_snapshotfence = NULL;
+
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, g_snapshotbuffer);
+	pbuf = status != GL_WAIT_FAILED ? glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB) : NULL;
+	if (pbuf != NULL) {
+		memcpy(g_snapshotpending->pixel, pbuf, (size_t) g_snapshotpending->width * g_snapshotpending->height * 4);
+		glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+		swpSubmitSnapshot(g_snapshotpending);
+	} else {
+		free(g_snapshotpending->pixel);
+		free(g_snapshotpending);
+	}
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+	g_snapshotpending = NULL;
+
+	return 0;
+}
+
+int swpUpdateSnapshot(const swpRenderingState *state) {
+
+	const unsigned int slot = (state->data.curtex - 1 + state->data.numtexs) % state->data.numtexs;
+	const GLuint tex = state->data.texs[slot];
+	const int async = g_support_pbo && g_support_sync;
+	swpSnapshotJob* job;
+	GLint active, bound, levels, alpha;
+	GLint width, height, level = 0;
+	size_t size;
+
+	/*	Read back in flight, mapped once the GPU is done with it.	*/
+	if (swpFinishSnapshotReadback(0))
+		return 1;
+
+	/*	Only between transitions and uploads, on a picture that has settled.	*/
+	if (!g_snapshotdue || state->inTransition || state->sliced != NULL || state->mipdirty)
+		return 0;
+	g_snapshotdue = 0;
+	if (glIsTexture(tex) == GL_FALSE || g_drawable[0] <= 0 || g_drawable[1] <= 0)
+		return 0;
+
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &active);
+	glActiveTexture(GL_TEXTURE0);
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+	glBindTexture(GL_TEXTURE_2D, tex);
+
+	/*	Read back the smallest level that still covers the drawable.	*/
+	glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &levels);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_ALPHA_SIZE, &alpha);
+	while (level < levels && width / 2 >= g_drawable[0] && height / 2 >= g_drawable[1]) {
+		width /= 2;
+		height /= 2;
+		level++;
+	}
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+	size = (size_t) width * height * 4;
+
+	job = calloc(1, sizeof(*job));
+	if (job != NULL)
+		job->pixel = malloc(size);
+	if (job != NULL && job->pixel != NULL && width > 0 && height > 0) {
+		job->width = (unsigned int) width;
+		job->height = (unsigned int) height;
+		job->dstwidth = (unsigned int) g_drawable[0];
+		job->dstheight = (unsigned int) g_drawable[1];
+		job->intfor = alpha > 0 ? GL_RGBA : GL_RGB;
+		job->topdown = state->data.topdown[slot];
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+		if (async) {
+			/*	Copied into the pack buffer by the GPU, fenced instead of waited for.	*/
+			if (g_snapshotbuffer == 0)
+				glGenBuffersARB(1, &g_snapshotbuffer);
+			glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, g_snapshotbuffer);
+			glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB, (GLsizeiptr) size, NULL, GL_STREAM_READ_ARB);
+			glGetTexImage(GL_TEXTURE_2D, level, GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+			glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+			g_snapshotfence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			g_snapshotpending = job;
+			glFlush();
+		} else {
+			glGetTexImage(GL_TEXTURE_2D, level, GL_BGRA, GL_UNSIGNED_BYTE, job->pixel);
+			swpSubmitSnapshot(job);
+		}
+	} else if (job != NULL) {
+		free(job->pixel);
+		free(job);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, (GLuint) bound);
+	glActiveTexture((GLenum) active);
+
+	return g_snapshotpending != NULL;
+}
+
+void swpReleaseSnapshot(void) {
+
+	/*	Read back still in flight is written as well.	*/
+	if (g_snapshotfence != NULL)
+		swpFinishSnapshotReadback(GL_TIMEOUT_IGNORED);
+	if (g_snapshotbuffer != 0) {
+		glDeleteBuffersARB(1, &g_snapshotbuffer);
+		g_snapshotbuffer = 0;
+	}
+
+	if (g_snapshotthread == NULL)
+		return;
+
+	/*	Wait for the last snapshot to be written.	*/
+	SDL_LockMutex(g_snapshotlock);
+	g_snapshotquit = 1;
+	SDL_CondSignal(g_snapshotcond);
+	SDL_UnlockMutex(g_snapshotlock);
+	SDL_WaitThread(g_snapshotthread, NULL);
+	g_snapshotthread = NULL;
+
+	SDL_DestroyCond(g_snapshotcond);
+	SDL_DestroyMutex(g_snapshotlock);
+}
@@ -0,0 +1,128 @@
+/**
+    Simple wallpaper application.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "wallpaper.h"
+
+#include <stdio.h>
+#include <SDL2/SDL_atomic.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_timer.h>
+
+#define SWP_MAX_STARTUP_MARKS 64
+
+/**
+ *	Point in time of the startup timeline.
+ */
+typedef struct swp_startup_mark_t{
+	const char* phase;              /*	Phase that completed.	*/
+	SDL_threadID thread;            /*	Thread that completed the phase.	*/
+	Uint64 time;                    /*	Performance counter.	*/
+}swpStartupPhase;
+
+unsigned int g_startupreport = 0;
+
+static SDL_mutex* g_startuplock = NULL;
+static SDL_cond* g_startupcond = NULL;
+static SDL_atomic_t g_startupready;
+static Uint64 g_startupbase = 0;
+static SDL_threadID g_startupthread = 0;
+static swpStartupPhase g_startupmarks[SWP_MAX_STARTUP_MARKS];
+static SDL_atomic_t g_numstartupmarks;
+static SDL_atomic_t g_startupreported;
+
+void swpInitStartup(void) {
+
+	g_startupbase = SDL_GetPerformanceCounter();
+	g_startupthread = SDL_ThreadID();
+	g_startuplock = SDL_CreateMutex();
+	g_startupcond = SDL_CreateCond();
+	SDL_AtomicSet(&g_startupready, 0);
+	SDL_AtomicSet(&g_numstartupmarks, 0);
+	SDL_AtomicSet(&g_startupreported, 0);
+}
+
+void swpSetStartupReady(unsigned int flags) {
+
+	SDL_LockMutex(g_startuplock);
+	SDL_AtomicSet(&g_startupready, SDL_AtomicGet(&g_startupready) | (int) flags);
+	SDL_CondBroadcast(g_startupcond);
+	SDL_UnlockMutex(g_startuplock);
+}
+
+void swpWaitStartupReady(unsigned int flags) {
+
+	/*	Ready after startup, without locking.	*/
+	if (((unsigned int) SDL_AtomicGet(&g_startupready) & flags) == flags)
+		return;
+
+	SDL_LockMutex(g_startuplock);
+	while (((unsigned int) SDL_AtomicGet(&g_startupready) & flags) != flags)
+		SDL_CondWait(g_startupcond, g_startuplock);
+	SDL_UnlockMutex(g_startuplock);
+}
+
+void swpStartupMark(const char *phase) {
+
+	int index;
+
+	if (!g_startupreport)
+		return;
+	index = SDL_AtomicAdd(&g_numstartupmarks, 1);
+	if (index >= SWP_MAX_STARTUP_MARKS)
+		return;
+
+	g_startupmarks[index].time = SDL_GetPerformanceCounter();
+	g_startupmarks[index].thread = SDL_ThreadID();
+	g_startupmarks[index].phase = phase;
+}
+
+void swpPrintStartupReport(const char *reason) {
+
+	const double frequency = (double) SDL_GetPerformanceFrequency();
+	int nummarks, i, j;
+
+	if (!g_startupreport || SDL_AtomicCAS(&g_startupreported, 0, 1) == SDL_FALSE)
+		return;
+
+	swpStartupMark(reason);
+	nummarks = SDL_min(SDL_AtomicGet(&g_numstartupmarks), SWP_MAX_STARTUP_MARKS);
+
+	/*	Skip marks still being written by another thread.	*/
+	for (i = 0, j = 0; i < nummarks; i++) {
+		if (g_startupmarks[i].phase != NULL)
+			g_startupmarks[j++] = g_startupmarks[i];
+	}
+	nummarks = j;
+
+	/*	Marks of the worker threads are interleaved by time.	*/
+	for (i = 1; i < nummarks; i++) {
+		swpStartupPhase mark = g_startupmarks[i];
+		for (j = i; j > 0 && g_startupmarks[j - 1].time > mark.time; j--)
+			g_startupmarks[j] = g_startupmarks[j - 1];
+		g_startupmarks[j] = mark;
+	}
+
+	fprintf(stderr, "Startup timeline:\n");
+	for (i = 0; i < nummarks; i++) {
+		const double ms = (double) (g_startupmarks[i].time - g_startupbase) * 1000.0 / frequency;
+		const double delta = i > 0 ? (double) (g_startupmarks[i].time - g_startupmarks[i - 1].time) * 1000.0 / frequency : ms;
+		fprintf(stderr, "  %9.2f ms  %+8.2f ms  %-7s %s\n", ms, delta,
+		        g_startupmarks[i].thread == g_startupthread ? "main" : "worker", g_startupmarks[i].phase);
+	}
+}
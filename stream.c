@@ -0,0 +1,571 @@
+/**
+    Simple wallpaper program.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "wallpaper.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <SDL2/SDL_events.h>
+#include <SDL2/SDL_timer.h>
+#include <unistd.h>
+
+/*	Planar YUV to RGB fragment shader.	*/
+const char* gc_yuv_fragment = ""
+"#extension GL_ARB_explicit_attrib_location : enable\n"
+"#if defined(GL_ARB_explicit_attrib_location)\n"
+"layout(location = 0) out vec4 fragColor;\n"
+"#else\n"
+"out vec4 fragColor;\n"
+"#endif\n"
+"uniform sampler2D tex0;\n"
+"uniform sampler2D tex1;\n"
+"uniform sampler2D tex2;\n"
+"uniform mat3 yuv2rgb;\n"
+"uniform vec3 yuvoffset;\n"
+"#if __VERSION__ > 120\n"
+"smooth in vec2 uv;\n"
+"#else\n"
+"varying vec2 uv;\n"
+"#endif\n"
+"void main(void){\n"
+"	vec2 st = vec2(uv.x, 1.0 - uv.y);\n"
+"   #if __VERSION__ > 120\n"
+"	vec3 yuv = vec3(texture(tex0, st).r, texture(tex1, st).r, texture(tex2, st).r);\n"
+"   #else\n"
+"	vec3 yuv = vec3(texture2D(tex0, st).r, texture2D(tex1, st).r, texture2D(tex2, st).r);\n"
+"   #endif\n"
+"	vec4 color = vec4(yuv2rgb * (yuv - yuvoffset), 1.0);\n"
+"#if defined(GL_ARB_explicit_attrib_location) || __VERSION__ > 120\n"
+"	fragColor = color;\n"
+"#else\n"
+"	gl_FragColor = color;\n"
+"#endif\n"
+"}\n";
+
+/**
+ *	Buffered reader used for parsing the stream
+ *	header and frame headers without reading the
+ *	plane data byte by byte.
+ */
+typedef struct swp_y4m_reader_t{
+	int fd;                         /*	File descriptor.	*/
+	unsigned char buf[4096];        /*	Buffered data.	*/
+	size_t pos;                     /*	Read position in buffer.	*/
+	size_t len;                     /*	Number of valid bytes in buffer.	*/
+	ssize_t total;                  /*	Total number of bytes read from fd.	*/
+}swpY4MReader;
+
+static size_t swpY4MRead(swpY4MReader* reader, void* dst, size_t size) {
+
+	unsigned char* out = (unsigned char*) dst;
+	size_t nbytes = 0;
+	ssize_t len;
+
+	while (nbytes < size) {
+
+		/*	Consume buffered data first.	*/
+		if (reader->pos < reader->len) {
+			size_t n = reader->len - reader->pos;
+			if (n > size - nbytes)
+				n = size - nbytes;
+			memcpy(&out[nbytes], &reader->buf[reader->pos], n);
+			reader->pos += n;
+			nbytes += n;
+			continue;
+		}
+
+		/*	Large reads go directly to destination.	*/
+		if (size - nbytes >= sizeof(reader->buf)) {
+			len = read(reader->fd, &out[nbytes], size - nbytes);
+		} else {
+			len = read(reader->fd, reader->buf, sizeof(reader->buf));
+			reader->pos = 0;
+			reader->len = len > 0 ? (size_t) len : 0;
+		}
+
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len <= 0)
+			break;
+
+		reader->total += len;
+		if (size - nbytes >= sizeof(reader->buf))
+			nbytes += len;
+	}
+
+	return nbytes;
+}
+
+static int swpY4MReadLine(swpY4MReader* reader, char* line, size_t size) {
+
+	size_t i = 0;
+	char c;
+
+	while (swpY4MRead(reader, &c, 1) == 1) {
+		if (c == '\n') {
+			line[i] = '\0';
+			return 1;
+		}
+		if (i + 1 < size)
+			line[i++] = c;
+	}
+
+	return 0;
+}
+
+static int swpParseY4MHeader(swpYUVStream* stream, char* header) {
+
+	char* token;
+	char* next;
+	const char* chroma = "420";
+
+	/*	Default values if not present in the header.	*/
+	stream->fpsnum = 25;
+	stream->fpsden = 1;
+	stream->fullrange = 0;
+
+	/*	Skip the magic and parse each space separated parameter.	*/
+	for (token = strchr(header, ' '); token != NULL; token = next) {
+		*token++ = '\0';
+		next = strchr(token, ' ');
+		if (next != NULL)
+			*next = '\0';
+		switch (token[0]) {
+			case 'W':
+				stream->width = (unsigned int) strtoul(&token[1], NULL, 10);
+				break;
+			case 'H':
+				stream->height = (unsigned int) strtoul(&token[1], NULL, 10);
+				break;
+			case 'F':
+				sscanf(&token[1], "%u:%u", &stream->fpsnum, &stream->fpsden);
+				break;
+			case 'C':
+				chroma = &token[1];
+				break;
+			case 'X':
+				if (strcmp(token, "XCOLORRANGE=FULL") == 0)
+					stream->fullrange = 1;
+				break;
+			default:
+				break;
+		}
+	}
+
+	if (stream->width == 0 || stream->height == 0 || stream->fpsnum == 0 || stream->fpsden == 0) {
+		fprintf(stderr, "Invalid YUV4MPEG2 header, %dx%d %d:%d.\n", stream->width, stream->height,
+		        stream->fpsnum, stream->fpsden);
+		return 0;
+	}
+
+	/*	Chroma subsampling.	*/
+	stream->framesize = stream->width * stream->height;
+	if (strcmp(chroma, "420") == 0 || strcmp(chroma, "420jpeg") == 0 || strcmp(chroma, "420mpeg2") == 0 ||
+	    strcmp(chroma, "420paldv") == 0) {
+		/*	8-bit 4:2:0 of any chroma siting, the high bit depth 420pNN forms are not supported.	*/
+		stream->chromawidth = (stream->width + 1) / 2;
+		stream->chromaheight = (stream->height + 1) / 2;
+	} else if (strcmp(chroma, "422") == 0) {
+		stream->chromawidth = (stream->width + 1) / 2;
+		stream->chromaheight = stream->height;
+	} else if (strcmp(chroma, "444") == 0) {
+		stream->chromawidth = stream->width;
+		stream->chromaheight = stream->height;
+	} else if (strcmp(chroma, "444alpha") == 0) {
+		/*	Alpha plane is read but not displayed.	*/
+		stream->chromawidth = stream->width;
+		stream->chromaheight = stream->height;
+		stream->framesize += stream->width * stream->height;
+	} else if (strcmp(chroma, "mono") == 0) {
+		stream->chromawidth = 0;
+		stream->chromaheight = 0;
+	} else {
+		fprintf(stderr, "None supported YUV4MPEG2 colorspace, C%s.\n", chroma);
+		return 0;
+	}
+	stream->framesize += 2 * stream->chromawidth * stream->chromaheight;
+
+	return 1;
+}
+
+ssize_t swpReadY4MStream(int fd, const void *__restrict__ prefix, size_t prefixlen) {
+
+	swpY4MReader* reader;
+	swpYUVStream* stream;
+	swpFrameInfo info;
+	SDL_Event event = {0};
+	char line[1024];
+	Uint64 freq;
+	Uint64 period;
+	Uint64 base;
+	Uint64 due;
+	Uint64 now;
+	ssize_t total;
+	void* slot;
+
+	/*	Reader starts with the data already read from the file descriptor.	*/
+	reader = malloc(sizeof(swpY4MReader));
+	assert(reader);
+	assert(prefixlen <= sizeof(reader->buf));
+	reader->fd = fd;
+	reader->pos = 0;
+	reader->len = prefixlen;
+	reader->total = prefixlen;
+	memcpy(reader->buf, prefix, prefixlen);
+
+	stream = calloc(1, sizeof(swpYUVStream));
+	assert(stream);
+
+	/*	Parse the stream header once.	*/
+	if (!swpY4MReadLine(reader, line, sizeof(line)) || !swpParseY4MHeader(stream, line)) {
+		free(stream);
+		free(reader);
+		return -1;
+	}
+	swpVerbosePrintf("YUV4MPEG2 stream %dx%d, %d:%d fps, %d bytes per frame.\n", stream->width, stream->height,
+	                 stream->fpsnum, stream->fpsden, stream->framesize);
+
+	if (!swpCreateFrameQueue(&stream->queue, SWP_NUM_STREAM_FRAMES, stream->framesize)) {
+		free(stream);
+		free(reader);
+		return -1;
+	}
+
+	/*	Let the main thread allocate the plane textures.	*/
+	event.type = SDL_USEREVENT;
+	event.user.code = SWP_EVENT_UPDATE_STREAM;
+	event.user.data1 = stream;
+	SDL_PushEvent(&event);
+
+	/*	Frame period in performance counter ticks.	*/
+	freq = SDL_GetPerformanceFrequency();
+	period = (freq * stream->fpsden) / stream->fpsnum;
+	base = SDL_GetPerformanceCounter();
+
+	while (g_alive && swpY4MReadLine(reader, line, sizeof(line))) {
+
+		if (strncmp(line, "FRAME", 5) != 0) {
+			fprintf(stderr, "Invalid YUV4MPEG2 frame header.\n");
+			break;
+		}
+
+		/*	Read the planes directly into the queue slot.	*/
+		slot = swpFrameQueueBeginWrite(&stream->queue);
+		if (slot == NULL)
+			break;
+		if (swpY4MRead(reader, slot, stream->framesize) != stream->framesize)
+			break;
+
+		/*	Present-time pacing, wait until the frame is due.	*/
+		due = base + stream->numframes * period;
+		now = SDL_GetPerformanceCounter();
+		if (now < due) {
+			SDL_Delay((Uint32) (((due - now) * 1000) / freq));
+		} else if (now - due > 2 * period) {
+			/*	Producer is behind, rebase instead of bursting.	*/
+			base = now - stream->numframes * period;
+		}
+
+		info.pts = (double) stream->numframes * (double) stream->fpsden / (double) stream->fpsnum;
+		swpFrameQueueEndWrite(&stream->queue, &info);
+		stream->numframes++;
+
+		/*	Only one frame event in the event queue at the time.	*/
+		if (SDL_AtomicCAS(&stream->pending, 0, 1)) {
+			event.type = SDL_USEREVENT;
+			event.user.code = SWP_EVENT_STREAM_FRAME;
+			event.user.data1 = stream;
+			SDL_PushEvent(&event);
+		}
+	}
+
+	swpVerbosePrintf("YUV4MPEG2 stream ended after %d frames.\n", stream->numframes);
+
+	/*	Notify the main thread, which owns the stream from now on.	*/
+	event.type = SDL_USEREVENT;
+	event.user.code = SWP_EVENT_UPDATE_STREAM;
+	event.user.data1 = NULL;
+	event.user.data2 = stream;
+	SDL_PushEvent(&event);
+
+	total = reader->total;
+	free(reader);
+	return total;
+}
+
+int swpCreateFrameQueue(swpFrameQueue *queue, unsigned int numslots, unsigned int slotsize) {
+
+	memset(queue, 0, sizeof(*queue));
+	queue->numslots = numslots;
+	queue->slotsize = slotsize;
+
+	queue->data = malloc((size_t) numslots * slotsize);
+	queue->info = calloc(numslots, sizeof(swpFrameInfo));
+	if (queue->data == NULL || queue->info == NULL) {
+		fprintf(stderr, "Failed to allocate %d frames of %d bytes, %s.\n", numslots, slotsize, strerror(errno));
+		swpReleaseFrameQueue(queue);
+		return 0;
+	}
+
+	queue->lock = SDL_CreateMutex();
+	queue->cond = SDL_CreateCond();
+
+	return 1;
+}
+
+void swpReleaseFrameQueue(swpFrameQueue *queue) {
+
+	if (queue->cond)
+		SDL_DestroyCond(queue->cond);
+	if (queue->lock)
+		SDL_DestroyMutex(queue->lock);
+	free(queue->data);
+	free(queue->info);
+	memset(queue, 0, sizeof(*queue));
+}
+
+void *swpFrameQueueBeginWrite(swpFrameQueue *queue) {
+
+	void* slot = NULL;
+
+	SDL_LockMutex(queue->lock);
+	while (queue->count == queue->numslots && !queue->closed)
+		SDL_CondWait(queue->cond, queue->lock);
+	if (!queue->closed)
+		slot = &queue->data[(size_t) ((queue->head + queue->count) % queue->numslots) * queue->slotsize];
+	SDL_UnlockMutex(queue->lock);
+
+	return slot;
+}
+
+void swpFrameQueueEndWrite(swpFrameQueue *queue, const swpFrameInfo *info) {
+
+	SDL_LockMutex(queue->lock);
+	queue->info[(queue->head + queue->count) % queue->numslots] = *info;
+	queue->count++;
+	SDL_CondSignal(queue->cond);
+	SDL_UnlockMutex(queue->lock);
+}
+
+void *swpFrameQueuePeek(swpFrameQueue *queue, swpFrameInfo *info) {
+
+	void* slot = NULL;
+
+	SDL_LockMutex(queue->lock);
+	if (queue->count > 0) {
+		slot = &queue->data[(size_t) queue->head * queue->slotsize];
+		if (info)
+			*info = queue->info[queue->head];
+	}
+	SDL_UnlockMutex(queue->lock);
+
+	return slot;
+}
+
+void swpFrameQueuePop(swpFrameQueue *queue) {
+
+	SDL_LockMutex(queue->lock);
+	if (queue->count > 0) {
+		queue->head = (queue->head + 1) % queue->numslots;
+		queue->count--;
+		SDL_CondSignal(queue->cond);
+	}
+	SDL_UnlockMutex(queue->lock);
+}
+
+void swpFrameQueueClose(swpFrameQueue *queue) {
+
+	SDL_LockMutex(queue->lock);
+	queue->closed = 1;
+	SDL_CondBroadcast(queue->cond);
+	SDL_UnlockMutex(queue->lock);
+}
+
+static void swpCreatePlaneTexture(GLuint *tex, unsigned int width, unsigned int height, const void *pixel) {
+
+	glGenTextures(1, tex);
+	glBindTexture(GL_TEXTURE_2D, *tex);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+	/*	Allocate the storage once, each frame only updates the content.	*/
+	glTexImage2D(GL_TEXTURE_2D, 0, g_core_profile ? GL_R8 : GL_LUMINANCE8, width, height, 0,
+	             g_core_profile ? GL_RED : GL_LUMINANCE, GL_UNSIGNED_BYTE, pixel);
+	swpTrackVRAM(SWP_VRAM_TEXTURE, *tex, (size_t) width * height);
+}
+
+int swpBeginStream(swpRenderingState *__restrict__ state, swpYUVStream *__restrict__ stream) {
+
+	swpRenderingData* data = &state->data;
+	const unsigned char gray = 128;
+	GLfloat yuv2rgb[9];
+	GLfloat yuvoffset[3];
+	float kr, kb, ky, kc;
+	int i;
+
+	/*	Previous stream is superseded, its producer is released when it ends.	*/
+	if (state->stream != NULL)
+		swpFrameQueueClose(&state->stream->queue);
+	if (data->planes[0] != 0) {
+		for (i = 0; i < 3; i++)
+			swpTrackVRAM(SWP_VRAM_TEXTURE, data->planes[i], 0);
+		glDeleteTextures(3, data->planes);
+		memset(data->planes, 0, sizeof(data->planes));
+	}
+
+	/*	Create YUV display shader on first use.	*/
+	if (data->yuvprog <= 0) {
+		data->yuvprog = swpCreateShader(gc_vertex, gc_yuv_fragment);
+		if (data->yuvprog < 0) {
+			fprintf(stderr, "Failed to create YUV shader.\n");
+			return 0;
+		}
+		glUseProgram(data->yuvprog);
+		glUniform1iARB(glGetUniformLocationARB(data->yuvprog, "tex0"), 0);
+		glUniform1iARB(glGetUniformLocationARB(data->yuvprog, "tex1"), 1);
+		glUniform1iARB(glGetUniformLocationARB(data->yuvprog, "tex2"), 2);
+		data->yuvmatloc = glGetUniformLocationARB(data->yuvprog, "yuv2rgb");
+		data->yuvoffloc = glGetUniformLocationARB(data->yuvprog, "yuvoffset");
+	}
+
+	/*	BT.709 for HD content, BT.601 otherwise.	*/
+	if (stream->height >= 720) {
+		kr = 0.2126f;
+		kb = 0.0722f;
+	} else {
+		kr = 0.299f;
+		kb = 0.114f;
+	}
+	ky = stream->fullrange ? 1.0f : 255.0f / 219.0f;
+	kc = stream->fullrange ? 1.0f : 255.0f / 224.0f;
+
+	/*	Column major, columns are the Y, U and V contributions.	*/
+	yuv2rgb[0] = ky;
+	yuv2rgb[1] = ky;
+	yuv2rgb[2] = ky;
+	yuv2rgb[3] = 0.0f;
+	yuv2rgb[4] = -kc * 2.0f * (1.0f - kb) * kb / (1.0f - kr - kb);
+	yuv2rgb[5] = kc * 2.0f * (1.0f - kb);
+	yuv2rgb[6] = kc * 2.0f * (1.0f - kr);
+	yuv2rgb[7] = -kc * 2.0f * (1.0f - kr) * kr / (1.0f - kr - kb);
+	yuv2rgb[8] = 0.0f;
+	yuvoffset[0] = stream->fullrange ? 0.0f : 16.0f / 255.0f;
+	yuvoffset[1] = 0.5f;
+	yuvoffset[2] = 0.5f;
+
+	glUseProgram(data->yuvprog);
+	glUniformMatrix3fvARB(data->yuvmatloc, 1, GL_FALSE, yuv2rgb);
+	glUniform3fvARB(data->yuvoffloc, 1, yuvoffset);
+
+	/*	Fixed size planar textures, reused for every frame.	*/
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	swpCreatePlaneTexture(&data->planes[0], stream->width, stream->height, NULL);
+	if (stream->chromawidth > 0) {
+		swpCreatePlaneTexture(&data->planes[1], stream->chromawidth, stream->chromaheight, NULL);
+		swpCreatePlaneTexture(&data->planes[2], stream->chromawidth, stream->chromaheight, NULL);
+	} else {
+		swpCreatePlaneTexture(&data->planes[1], 1, 1, &gray);
+		swpCreatePlaneTexture(&data->planes[2], 1, 1, &gray);
+	}
+
+	for (i = 0; i < 3; i++) {
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D, data->planes[i]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	/*	Stream has precedence over any transition.	*/
+	state->inTransition = 0;
+	state->stream = stream;
+
+	return 1;
+}
+
+int swpUpdateStream(swpRenderingState *state) {
+
+	swpYUVStream* stream = state->stream;
+	const unsigned char* frame;
+	size_t lumasize;
+	size_t chromasize;
+	swpFrameInfo info;
+	int i;
+
+	if (stream == NULL)
+		return 0;
+
+	/*	Allow the producer to signal the next frame.	*/
+	SDL_AtomicSet(&stream->pending, 0);
+
+	/*	Drop all frames but the newest if the main thread has fallen behind.	*/
+	SDL_LockMutex(stream->queue.lock);
+	while (stream->queue.count > 1) {
+		stream->queue.head = (stream->queue.head + 1) % stream->queue.numslots;
+		stream->queue.count--;
+		stream->numdropped++;
+	}
+	SDL_CondSignal(stream->queue.cond);
+	SDL_UnlockMutex(stream->queue.lock);
+
+	frame = swpFrameQueuePeek(&stream->queue, &info);
+	if (frame == NULL)
+		return 0;
+
+	lumasize = (size_t) stream->width * stream->height;
+	chromasize = (size_t) stream->chromawidth * stream->chromaheight;
+
+	/*	Update the content of the planes, no reallocation.	*/
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (i = 0; i < (stream->chromawidth > 0 ? 3 : 1); i++) {
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D, state->data.planes[i]);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+		                i == 0 ? stream->width : stream->chromawidth,
+		                i == 0 ? stream->height : stream->chromaheight,
+		                g_core_profile ? GL_RED : GL_LUMINANCE, GL_UNSIGNED_BYTE,
+		                i == 0 ? frame : &frame[lumasize + (i - 1) * chromasize]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	/*	glTexSubImage2D has copied the data, the slot can be reused.	*/
+	swpFrameQueuePop(&stream->queue);
+
+	return 1;
+}
+
+void swpEndStream(swpRenderingState *__restrict__ state, swpYUVStream *__restrict__ stream) {
+
+	if (stream == NULL)
+		return;
+
+	/*	Display the last frame, the plane textures are kept until the next image.	*/
+	if (stream == state->stream) {
+		swpUpdateStream(state);
+		state->stream = NULL;
+	}
+	swpVerbosePrintf("Stream displayed %d frames, %d dropped.\n", stream->numframes - stream->numdropped,
+	                 stream->numdropped);
+
+	swpFrameQueueClose(&stream->queue);
+	swpReleaseFrameQueue(&stream->queue);
+	free(stream);
+}
@@ -0,0 +1,91 @@
+/**
+    Simple wallpaper program.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#ifndef _SWP_SWPK_H_
+#define _SWP_SWPK_H_ 1
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ *	Pre-processed picture container (.swpk) written by
+ *	swp-pack. All fields are little endian. Pixel data of
+ *	each level starts at a page aligned offset, so the file
+ *	can be mapped and uploaded without any decoding.
+ */
+#define SWPK_MAGIC "SWPK"
+#define SWPK_VERSION 1
+#define SWPK_MAX_LEVELS 16
+#define SWPK_DATA_ALIGNMENT 4096
+
+/**
+ *	Pixel formats.
+ */
+#define SWPK_FORMAT_BGRA8 0     /*	Bottom-up BGRA rows.	*/
+#define SWPK_FORMAT_BC1   1     /*	S3TC DXT1 4x4 blocks, bottom-up block rows.	*/
+#define SWPK_FORMAT_BC3   2     /*	S3TC DXT5 4x4 blocks, bottom-up block rows.	*/
+#define SWPK_FORMAT_BC7   3     /*	BPTC 4x4 blocks, bottom-up block rows.	*/
+
+/**
+ *	Flags.
+ */
+#define SWPK_FLAG_ALPHA 0x1     /*	Picture has an alpha channel.	*/
+#define SWPK_FLAG_TILED 0x2     /*	Levels form a tile pyramid, larger than a single texture.	*/
+
+/**
+ *	Level of the mip chain.
+ */
+typedef struct swpk_level_t{
+	uint32_t width;         /*	Level width in pixels.	*/
+	uint32_t height;        /*	Level height in pixels.	*/
+	uint64_t offset;        /*	Offset from the beginning of the file.	*/
+	uint64_t size;          /*	Size in bytes.	*/
+	uint32_t rowpitch;      /*	Size of a row, or row of blocks, in bytes.	*/
+	uint32_t reserved;      /*	*/
+}swpkLevel;
+
+/**
+ *	File header.
+ */
+typedef struct swpk_header_t{
+	char magic[4];          /*	SWPK_MAGIC.	*/
+	uint32_t version;       /*	SWPK_VERSION.	*/
+	uint32_t width;         /*	Picture width.	*/
+	uint32_t height;        /*	Picture height.	*/
+	uint32_t format;        /*	Pixel format.	*/
+	uint32_t flags;         /*	*/
+	uint32_t numlevels;     /*	Number of levels.	*/
+	uint32_t alignment;     /*	Row alignment, matching GL_UNPACK_ALIGNMENT.	*/
+	uint32_t reserved[8];   /*	*/
+	swpkLevel levels[SWPK_MAX_LEVELS];
+}swpkHeader;
+
+/**
+ *	@Return size in bytes of a block compressed
+ *	picture, 8 bytes per BC1 block and 16 per BC3 and BC7 block.
+ */
+extern size_t swpGetBCSize(unsigned int width, unsigned int height, unsigned int format);
+
+/**
+ *	Encode block rows [\rowbegin, \rowend) of bottom-up
+ *	BGRA picture to BC1, BC3 or BC7 blocks. Block rows are
+ *	independent and can be encoded concurrently.
+ */
+extern void swpEncodeBC(const void* bgra, unsigned int width, unsigned int height,
+		unsigned int rowbegin, unsigned int rowend, unsigned int format, void* blocks);
+
+#endif
@@ -0,0 +1,370 @@
+/**
+    Simple wallpaper program.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "wallpaper.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/*	Tile vertex shader, places the quad with a scale and offset.	*/
+const char* gc_tile_vertex = ""
+"#extension GL_ARB_explicit_attrib_location : enable\n"
+"#if defined(GL_ARB_explicit_attrib_location)\n"
+"layout(location = 0) in vec3 vertex;\n"
+"#else\n"
+"attribute vec3 vertex;\n"
+"#endif\n"
+"#if __VERSION__ > 120\n"
+"smooth out vec2 uv;\n"
+"#else\n"
+"varying vec2 uv;\n"
+"#endif\n"
+"uniform vec4 rect;\n"
+"uniform vec4 inset;\n"
+"out gl_PerVertex{\n"
+"    vec4 gl_Position;\n"
+"    float gl_PointSize;\n"
+"    float gl_ClipDistance[];\n"
+"};\n"
+"void main(void){\n"
+"	gl_Position = vec4(vertex.xy * rect.xy + rect.zw, 0.0, 1.0);\n"
+"	uv = inset.xy + (vertex.xy + vec2(1.0)) / 2.0 * inset.zw;\n"
+"}\n";
+
+size_t g_tilebudget = 256 * 1024 * 1024;
+
+void swpFreeTiledImage(swpTiledImage *tiled) {
+
+	unsigned int i;
+
+	if (tiled->storage != NULL)
+		swpReleasePixel(tiled->storage);
+	else {
+		for (i = 0; i < tiled->numlevels; i++)
+			free(tiled->levels[i].pixel);
+	}
+	free(tiled->tiles);
+	free(tiled);
+}
+
+swpTiledImage *swpCreateTiledImage(swpTextureDesc *desc) {
+
+	swpTiledImage* tiled;
+	swpTileLevel* level;
+	void* preview;
+
+	/*	Tiles are uploaded as sub-rectangles of 8-bit BGRA levels.	*/
+	if (desc->bpp != 4 || desc->imgdatatype != GL_UNSIGNED_BYTE)
+		return NULL;
+
+	tiled = calloc(1, sizeof(swpTiledImage));
+	if (tiled == NULL)
+		return NULL;
+	tiled->width = desc->width;
+	tiled->height = desc->height;
+	tiled->tilesize = SDL_min(SWP_TILE_SIZE, g_maxtexsize - 2 * SWP_TILE_GUTTER);
+	tiled->intfor = desc->intfor;
+	tiled->format = desc->format;
+	tiled->imgdatatype = desc->imgdatatype;
+	tiled->zoom = 1.0f;
+	tiled->center[0] = 0.5f;
+	tiled->center[1] = 0.5f;
+
+	/*	Pack levels are used as they are, down to the first level that fits a tile.	*/
+	if (desc->numlevels > 0) {
+		tiled->storage = desc->pixel;
+		while (tiled->numlevels < desc->numlevels && tiled->numlevels < SWP_MAX_TILE_LEVELS) {
+			const swpTextureLevel* src = &desc->levels[tiled->numlevels];
+			level = &tiled->levels[tiled->numlevels++];
+			level->width = src->width;
+			level->height = src->height;
+			level->pixel = (unsigned char *) desc->pixel + src->offset;
+			if (SDL_max(level->width, level->height) <= tiled->tilesize)
+				break;
+		}
+	} else {
+
+		/*	Level zero is the full resolution picture.	*/
+		level = &tiled->levels[0];
+		level->width = desc->width;
+		level->height = desc->height;
+		level->pixel = desc->pixel;
+		tiled->numlevels = 1;
+
+		/*	Downsample until the level fits in a single tile.	*/
+		while (SDL_max(level->width, level->height) > tiled->tilesize && tiled->numlevels < SWP_MAX_TILE_LEVELS) {
+			swpTileLevel* next = &tiled->levels[tiled->numlevels];
+
+			next->width = (level->width + 1) / 2;
+			next->height = (level->height + 1) / 2;
+			next->pixel = malloc((size_t) next->width * next->height * 4);
+			if (next->pixel == NULL) {
+				fprintf(stderr, "Failed to allocate tile level %d, %s.\n", tiled->numlevels, strerror(errno));
+				desc->pixel = NULL;
+				swpFreeTiledImage(tiled);
+				return NULL;
+			}
+			swpDownsample2x(level->pixel, level->width, level->height, next->pixel);
+
+			level = next;
+			tiled->numlevels++;
+		}
+	}
+	for (level = &tiled->levels[0]; level < &tiled->levels[tiled->numlevels]; level++) {
+		level->numtiles[0] = (level->width + tiled->tilesize - 1) / tiled->tilesize;
+		level->numtiles[1] = (level->height + tiled->tilesize - 1) / tiled->tilesize;
+	}
+
+	/*	Coarsest level is displayed during transitions.	*/
+	level = &tiled->levels[tiled->numlevels - 1];
+	preview = malloc((size_t) level->width * level->height * 4);
+	if (preview == NULL) {
+		desc->pixel = NULL;
+		swpFreeTiledImage(tiled);
+		return NULL;
+	}
+	memcpy(preview, level->pixel, (size_t) level->width * level->height * 4);
+	swpVerbosePrintf("Tiled %dx%d picture into %d levels of %d pixel tiles.\n", tiled->width, tiled->height,
+	                 tiled->numlevels, tiled->tilesize);
+
+	desc->pixel = preview;
+	desc->width = level->width;
+	desc->height = level->height;
+	desc->size = level->width * level->height * 4;
+	desc->numlevels = 0;
+	desc->tiled = tiled;
+
+	return tiled;
+}
+
+void swpReleaseTiledImage(swpRenderingState *state) {
+
+	swpTiledImage* tiled = state->tiled;
+	unsigned int i;
+
+	if (tiled == NULL)
+		return;
+
+	for (i = 0; i < tiled->numtiles; i++) {
+		if (tiled->tiles[i].tex != 0) {
+			swpTrackVRAM(SWP_VRAM_TEXTURE, tiled->tiles[i].tex, 0);
+			glDeleteTextures(1, &tiled->tiles[i].tex);
+		}
+	}
+	swpFreeTiledImage(tiled);
+	state->tiled = NULL;
+}
+
+void swpPanTiledImage(swpRenderingState *state, float dx, float dy, float zoom) {
+
+	swpTiledImage* tiled = state->tiled;
+	float half;
+
+	if (tiled == NULL)
+		return;
+
+	tiled->zoom = SDL_max(tiled->zoom * zoom, 1.0f);
+	tiled->center[0] += dx / tiled->zoom;
+	tiled->center[1] += dy / tiled->zoom;
+
+	/*	Keep the view inside the picture.	*/
+	half = 0.5f / tiled->zoom;
+	tiled->center[0] = SDL_min(SDL_max(tiled->center[0], half), 1.0f - half);
+	tiled->center[1] = SDL_min(SDL_max(tiled->center[1], half), 1.0f - half);
+}
+
+static int swpCreateTileProgram(swpRenderingData *data) {
+
+	data->tileprog = swpCreateShader(gc_tile_vertex, gc_fragment);
+	if (data->tileprog < 0) {
+		fprintf(stderr, "Failed to create tile shader.\n");
+		return 0;
+	}
+	glUseProgram(data->tileprog);
+	glUniform1iARB(glGetUniformLocationARB(data->tileprog, "tex0"), 0);
+	data->tilerectloc = glGetUniformLocationARB(data->tileprog, "rect");
+	data->tileinsetloc = glGetUniformLocationARB(data->tileprog, "inset");
+
+	return 1;
+}
+
+static unsigned int swpSelectTileLevel(const swpTiledImage *tiled) {
+
+	const float drawable = SDL_max((float) g_drawable[0] / (float) tiled->width,
+	                               (float) g_drawable[1] / (float) tiled->height) * tiled->zoom;
+	unsigned int level = 0;
+
+	/*	Coarsest level with at least one texel per pixel.	*/
+	while (level + 1 < tiled->numlevels && drawable * (float) (2u << level) <= 1.0f)
+		level++;
+	return level;
+}
+
+/**
+ *	Get the texels of the tile and of its gutter, the
+ *	border texels of the neighbouring tiles it is
+ *	uploaded with so filtering is seamless across tiles.
+ */
+static void swpGetTileTexels(const swpTiledImage *tiled, const swpTileLevel *lvl, unsigned int x, unsigned int y,
+                             unsigned int *texels, unsigned int *gutter) {
+
+	texels[0] = SDL_min(tiled->tilesize, lvl->width - x * tiled->tilesize);
+	texels[1] = SDL_min(tiled->tilesize, lvl->height - y * tiled->tilesize);
+	gutter[0] = x > 0 ? SWP_TILE_GUTTER : 0;
+	gutter[1] = y > 0 ? SWP_TILE_GUTTER : 0;
+	gutter[2] = x * tiled->tilesize + texels[0] < lvl->width ? SWP_TILE_GUTTER : 0;
+	gutter[3] = y * tiled->tilesize + texels[1] < lvl->height ? SWP_TILE_GUTTER : 0;
+}
+
+static GLuint swpGetTile(swpTiledImage *tiled, unsigned int level, unsigned int x, unsigned int y) {
+
+	const swpTileLevel* lvl = &tiled->levels[level];
+	swpTile* victim = NULL;
+	unsigned int i, width, height;
+	unsigned int texels[2], gutter[4];
+
+	/*	Look up resident tile.	*/
+	for (i = 0; i < tiled->numtiles; i++) {
+		swpTile* tile = &tiled->tiles[i];
+		if (tile->level == (int) level && tile->x == x && tile->y == y) {
+			tile->lastuse = tiled->frame;
+			return tile->tex;
+		}
+		/*	Unused slot, otherwise least recently used tile not drawn this frame.	*/
+		if (victim != NULL && victim->level < 0)
+			continue;
+		if (tile->level < 0 || (tile->lastuse != tiled->frame && (victim == NULL || tile->lastuse < victim->lastuse)))
+			victim = tile;
+	}
+	if (victim == NULL)
+		return 0;
+
+	/*	Upload tile from the level, with its gutter.	*/
+	swpGetTileTexels(tiled, lvl, x, y, texels, gutter);
+	width = gutter[0] + texels[0] + gutter[2];
+	height = gutter[1] + texels[1] + gutter[3];
+	if (victim->tex == 0) {
+		glGenTextures(1, &victim->tex);
+		glBindTexture(GL_TEXTURE_2D, victim->tex);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	glBindTexture(GL_TEXTURE_2D, victim->tex);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, lvl->width);
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS, x * tiled->tilesize - gutter[0]);
+	glPixelStorei(GL_UNPACK_SKIP_ROWS, y * tiled->tilesize - gutter[1]);
+	glTexImage2D(GL_TEXTURE_2D, 0, tiled->intfor, width, height, 0, tiled->format, tiled->imgdatatype,
+	             lvl->pixel);
+	swpTrackVRAM(SWP_VRAM_TEXTURE, victim->tex, swpGetVRAMSize(tiled->intfor, width, height, 1));
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+	glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+
+	victim->level = (int) level;
+	victim->x = x;
+	victim->y = y;
+	victim->lastuse = tiled->frame;
+
+	return victim->tex;
+}
+
+void swpRenderTiles(GLuint vao, swpRenderingState *state) {
+
+	swpTiledImage* tiled = state->tiled;
+	const swpTileLevel* lvl;
+	unsigned int level, x, y, x0, x1, y0, y1, numvisible, capacity;
+	float view[4];
+
+	if (state->data.tileprog <= 0 && !swpCreateTileProgram(&state->data))
+		return;
+
+	/*	Visible region of the picture in normalized coordinates.	*/
+	level = swpSelectTileLevel(tiled);
+	lvl = &tiled->levels[level];
+	view[0] = tiled->center[0] - 0.5f / tiled->zoom;
+	view[1] = tiled->center[1] - 0.5f / tiled->zoom;
+	view[2] = tiled->center[0] + 0.5f / tiled->zoom;
+	view[3] = tiled->center[1] + 0.5f / tiled->zoom;
+	x0 = (unsigned int) SDL_max(view[0] * lvl->width / tiled->tilesize, 0.0f);
+	y0 = (unsigned int) SDL_max(view[1] * lvl->height / tiled->tilesize, 0.0f);
+	x1 = SDL_min((unsigned int) (view[2] * lvl->width / tiled->tilesize) + 1, lvl->numtiles[0]);
+	y1 = SDL_min((unsigned int) (view[3] * lvl->height / tiled->tilesize) + 1, lvl->numtiles[1]);
+
+	/*	Grow the cache beyond the budget if the visible tiles do not fit.	*/
+	numvisible = (x1 - x0) * (y1 - y0);
+	capacity = SDL_max((unsigned int) (g_tilebudget / ((size_t) tiled->tilesize * tiled->tilesize * 4)),
+	                   numvisible);
+	if (capacity > tiled->numtiles) {
+		swpTile* tiles = realloc(tiled->tiles, capacity * sizeof(swpTile));
+		if (tiles == NULL)
+			return;
+		for (x = tiled->numtiles; x < capacity; x++) {
+			memset(&tiles[x], 0, sizeof(swpTile));
+			tiles[x].level = -1;
+		}
+		tiled->tiles = tiles;
+		tiled->numtiles = capacity;
+	}
+	tiled->frame++;
+
+	glUseProgram(state->data.tileprog);
+	glActiveTexture(GL_TEXTURE0);
+	glBindVertexArray(vao);
+	for (y = y0; y < y1; y++) {
+		for (x = x0; x < x1; x++) {
+			const float u0 = (float) (x * tiled->tilesize) / lvl->width;
+			const float v0 = (float) (y * tiled->tilesize) / lvl->height;
+			const float u1 = (float) SDL_min((x + 1) * tiled->tilesize, lvl->width) / lvl->width;
+			const float v1 = (float) SDL_min((y + 1) * tiled->tilesize, lvl->height) / lvl->height;
+			unsigned int texels[2], gutter[4];
+			float rect[4], inset[4];
+			GLuint tex = swpGetTile(tiled, level, x, y);
+
+			if (tex == 0)
+				continue;
+
+			/*	Sample the tile texels only, the gutter is reached by the filter at the edges.	*/
+			swpGetTileTexels(tiled, lvl, x, y, texels, gutter);
+			inset[2] = (float) texels[0] / (float) (gutter[0] + texels[0] + gutter[2]);
+			inset[3] = (float) texels[1] / (float) (gutter[1] + texels[1] + gutter[3]);
+			inset[0] = (float) gutter[0] / (float) (gutter[0] + texels[0] + gutter[2]);
+			inset[1] = (float) gutter[1] / (float) (gutter[1] + texels[1] + gutter[3]);
+			glUniform4fvARB(state->data.tileinsetloc, 1, inset);
+
+			/*	Map the tile from the view to clip space.	*/
+			rect[0] = (u1 - u0) * tiled->zoom;
+			rect[1] = (v1 - v0) * tiled->zoom;
+			rect[2] = (u0 + u1 - 2.0f * tiled->center[0]) * tiled->zoom;
+			rect[3] = (v0 + v1 - 2.0f * tiled->center[1]) * tiled->zoom;
+			glUniform4fvARB(state->data.tilerectloc, 1, rect);
+
+			glBindTexture(GL_TEXTURE_2D, tex);
+			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		}
+	}
+	glBindVertexArray(0);
+
+	/*	Restore the state of the single texture display.	*/
+	glBindTexture(GL_TEXTURE_2D, state->data.texs[(state->data.curtex - 1 + state->data.numtexs) %
+	                                              state->data.numtexs]);
+	glUseProgram(state->data.displayshader->prog);
+}
@@ -0,0 +1,313 @@
+/**
+    Simple wallpaper application.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "swpk.h"
+
+#include <FreeImage.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SWP_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define SWP_MAX(a, b) ((a) > (b) ? (a) : (b))
+
+/**
+ *	Level of the picture being packed.
+ */
+typedef struct swp_pack_level_t{
+	unsigned int width;             /*	*/
+	unsigned int height;            /*	*/
+	unsigned char* pixel;           /*	Bottom-up BGRA.	*/
+	void* data;                     /*	Encoded level, the pixel data if not compressed.	*/
+	size_t size;                    /*	Size of the encoded level.	*/
+	unsigned int rowpitch;          /*	*/
+}swpPackLevel;
+
+static void swpPackUsage(FILE *file, const char *name) {
+	fprintf(file, "Usage: %s [OPTION]... INPUT OUTPUT\n"
+	              "Convert a picture into a .swpk pack with pre-built mip levels.\n\n"
+	              "  -f, --format=FORMAT     bgra, bc1, bc3 or bc7 (default bgra).\n"
+	              "  -m, --max-size=SIZE     Largest texture size (default 8192). Larger pictures\n"
+	              "                          are stored as BGRA tile pyramid.\n"
+	              "  -V, --verbose           Print information of the levels.\n"
+	              "  -h, --help              Print this help.\n", name);
+}
+
+static unsigned char *swpPackLoadPicture(const char *path, unsigned int *width, unsigned int *height, int *alpha) {
+
+	FREE_IMAGE_FORMAT fif;
+	FIBITMAP* bitmap;
+	FIBITMAP* converted;
+	unsigned char* pixel;
+	unsigned int y;
+
+	fif = FreeImage_GetFileType(path, 0);
+	if (fif == FIF_UNKNOWN)
+		fif = FreeImage_GetFIFFromFilename(path);
+	if (fif == FIF_UNKNOWN) {
+		fprintf(stderr, "Unknown picture format %s.\n", path);
+		return NULL;
+	}
+	bitmap = FreeImage_Load(fif, path, 0);
+	if (bitmap == NULL) {
+		fprintf(stderr, "Failed to load %s.\n", path);
+		return NULL;
+	}
+	*alpha = FreeImage_IsTransparent(bitmap) || FreeImage_GetBPP(bitmap) == 32;
+	converted = FreeImage_ConvertTo32Bits(bitmap);
+	FreeImage_Unload(bitmap);
+	if (converted == NULL) {
+		fprintf(stderr, "Failed to convert %s to 32 bits.\n", path);
+		return NULL;
+	}
+
+	/*	FreeImage scanlines are bottom-up BGRA, matching the texture layout.	*/
+	*width = FreeImage_GetWidth(converted);
+	*height = FreeImage_GetHeight(converted);
+	pixel = malloc((size_t) *width * *height * 4);
+	if (pixel == NULL) {
+		fprintf(stderr, "Failed to allocate %ux%u picture, %s.\n", *width, *height, strerror(errno));
+		FreeImage_Unload(converted);
+		return NULL;
+	}
+	for (y = 0; y < *height; y++)
+		memcpy(&pixel[(size_t) y * *width * 4], FreeImage_GetScanLine(converted, (int) y), (size_t) *width * 4);
+	FreeImage_Unload(converted);
+
+	return pixel;
+}
+
+/**
+ *	Box filter the next level. Texture mip chains halve with
+ *	rounding down, tile pyramids round up and repeat the edge.
+ */
+static unsigned char *swpPackDownsample(const swpPackLevel *src, unsigned int width, unsigned int height) {
+
+	const size_t pitch = (size_t) src->width * 4;
+	unsigned char* dst;
+	unsigned int x, y, c;
+
+	dst = malloc((size_t) width * height * 4);
+	if (dst == NULL)
+		return NULL;
+
+	for (y = 0; y < height; y++) {
+		const unsigned char* row0 = &src->pixel[(size_t) SWP_MIN(y * 2, src->height - 1) * pitch];
+		const unsigned char* row1 = &src->pixel[(size_t) SWP_MIN(y * 2 + 1, src->height - 1) * pitch];
+		unsigned char* out = &dst[(size_t) y * width * 4];
+		for (x = 0; x < width; x++) {
+			const unsigned int x0 = SWP_MIN(x * 2, src->width - 1) * 4;
+			const unsigned int x1 = SWP_MIN(x * 2 + 1, src->width - 1) * 4;
+			for (c = 0; c < 4; c++)
+				out[x * 4 + c] = (unsigned char) ((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+		}
+	}
+	return dst;
+}
+
+static int swpPackWrite(const char *path, swpkHeader *header, const swpPackLevel *levels) {
+
+	static const unsigned char zero[SWPK_DATA_ALIGNMENT] = {0};
+	uint64_t offset = sizeof(swpkHeader);
+	FILE* file;
+	unsigned int i;
+
+	/*	Page align each level.	*/
+	for (i = 0; i < header->numlevels; i++) {
+		offset = (offset + SWPK_DATA_ALIGNMENT - 1) & ~(uint64_t) (SWPK_DATA_ALIGNMENT - 1);
+		header->levels[i].width = levels[i].width;
+		header->levels[i].height = levels[i].height;
+		header->levels[i].offset = offset;
+		header->levels[i].size = levels[i].size;
+		header->levels[i].rowpitch = levels[i].rowpitch;
+		offset += levels[i].size;
+	}
+
+	file = fopen(path, "wb");
+	if (file == NULL) {
+		fprintf(stderr, "Failed to open %s, %s.\n", path, strerror(errno));
+		return 0;
+	}
+	offset = sizeof(swpkHeader);
+	if (fwrite(header, sizeof(swpkHeader), 1, file) != 1)
+		goto error;
+	for (i = 0; i < header->numlevels; i++) {
+		if (fwrite(zero, 1, (size_t) (header->levels[i].offset - offset), file) != header->levels[i].offset - offset)
+			goto error;
+		if (fwrite(levels[i].data, 1, levels[i].size, file) != levels[i].size)
+			goto error;
+		offset = header->levels[i].offset + header->levels[i].size;
+	}
+	if (fclose(file) != 0) {
+		fprintf(stderr, "Failed to write %s, %s.\n", path, strerror(errno));
+		return 0;
+	}
+	return 1;
+
+error:
+	fprintf(stderr, "Failed to write %s, %s.\n", path, strerror(errno));
+	fclose(file);
+	return 0;
+}
+
+int main(int argc, char** argv) {
+
+	swpkHeader header;
+	swpPackLevel levels[SWPK_MAX_LEVELS] = {{0}};
+	unsigned int format = SWPK_FORMAT_BGRA8;
+	unsigned int maxsize = 8192;
+	unsigned int width, height, i;
+	int verbose = 0;
+	int alpha;
+	int status = EXIT_FAILURE;
+
+	/*	*/
+	int c;
+	int index;
+	const char* shortopt = "f:m:Vh";
+	static struct option longoption[] = {
+		{"format",      required_argument,	NULL, 'f'},	/*	Pixel format of the pack.	*/
+		{"max-size",    required_argument,	NULL, 'm'},	/*	Largest texture size.	*/
+		{"verbose",     no_argument,		NULL, 'V'},	/*	Enable verbose.	*/
+		{"help",        no_argument,		NULL, 'h'},	/*	*/
+		{NULL, 0, NULL, 0},
+	};
+
+	while ((c = getopt_long(argc, argv, shortopt, longoption, &index)) != EOF) {
+		switch (c) {
+			case 'f':
+				if (strcmp(optarg, "bgra") == 0)
+					format = SWPK_FORMAT_BGRA8;
+				else if (strcmp(optarg, "bc1") == 0)
+					format = SWPK_FORMAT_BC1;
+				else if (strcmp(optarg, "bc3") == 0)
+					format = SWPK_FORMAT_BC3;
+				else if (strcmp(optarg, "bc7") == 0)
+					format = SWPK_FORMAT_BC7;
+				else {
+					fprintf(stderr, "Invalid format %s, expected bgra, bc1, bc3 or bc7.\n", optarg);
+					return EXIT_FAILURE;
+				}
+				break;
+			case 'm':
+				maxsize = (unsigned int) strtoul(optarg, NULL, 10);
+				if (maxsize == 0) {
+					fprintf(stderr, "Invalid max size %s.\n", optarg);
+					return EXIT_FAILURE;
+				}
+				break;
+			case 'V':
+				verbose = 1;
+				break;
+			case 'h':
+				swpPackUsage(stdout, argv[0]);
+				return EXIT_SUCCESS;
+			default:
+				swpPackUsage(stderr, argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	if (argc - optind != 2) {
+		swpPackUsage(stderr, argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	FreeImage_Initialise(0);
+
+	levels[0].pixel = swpPackLoadPicture(argv[optind], &width, &height, &alpha);
+	if (levels[0].pixel == NULL)
+		goto done;
+	levels[0].width = width;
+	levels[0].height = height;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SWPK_MAGIC, 4);
+	header.version = SWPK_VERSION;
+	header.width = width;
+	header.height = height;
+	header.alignment = 4;
+	header.flags = alpha ? SWPK_FLAG_ALPHA : 0;
+
+	/*	Pictures larger than a texture are displayed as tiles, which are uploaded uncompressed.	*/
+	if (width > maxsize || height > maxsize) {
+		if (format != SWPK_FORMAT_BGRA8)
+			fprintf(stderr, "%ux%u exceeds %u, storing tile pyramid as bgra.\n", width, height, maxsize);
+		format = SWPK_FORMAT_BGRA8;
+		header.flags |= SWPK_FLAG_TILED;
+	}
+	header.format = format;
+
+	/*	Build the mip chain.	*/
+	header.numlevels = 1;
+	while (header.numlevels < SWPK_MAX_LEVELS) {
+		const swpPackLevel* prev = &levels[header.numlevels - 1];
+		swpPackLevel* next = &levels[header.numlevels];
+
+		if (prev->width == 1 && prev->height == 1)
+			break;
+		if (header.flags & SWPK_FLAG_TILED) {
+			next->width = (prev->width + 1) / 2;
+			next->height = (prev->height + 1) / 2;
+		} else {
+			next->width = SWP_MAX(prev->width / 2, 1);
+			next->height = SWP_MAX(prev->height / 2, 1);
+		}
+		next->pixel = swpPackDownsample(prev, next->width, next->height);
+		if (next->pixel == NULL) {
+			fprintf(stderr, "Failed to allocate level %u, %s.\n", header.numlevels, strerror(errno));
+			goto done;
+		}
+		header.numlevels++;
+	}
+
+	/*	Encode the levels.	*/
+	for (i = 0; i < header.numlevels; i++) {
+		swpPackLevel* level = &levels[i];
+
+		if (format == SWPK_FORMAT_BGRA8) {
+			level->data = level->pixel;
+			level->size = (size_t) level->width * level->height * 4;
+			level->rowpitch = level->width * 4;
+		} else {
+			level->size = swpGetBCSize(level->width, level->height, format);
+			level->rowpitch = ((level->width + 3) / 4) * (format == SWPK_FORMAT_BC1 ? 8 : 16);
+			level->data = malloc(level->size);
+			if (level->data == NULL) {
+				fprintf(stderr, "Failed to allocate level %u, %s.\n", i, strerror(errno));
+				goto done;
+			}
+			swpEncodeBC(level->pixel, level->width, level->height, 0, (level->height + 3) / 4, format, level->data);
+		}
+		if (verbose)
+			printf("Level %u: %ux%u, %zu bytes.\n", i, level->width, level->height, level->size);
+	}
+
+	if (swpPackWrite(argv[optind + 1], &header, levels))
+		status = EXIT_SUCCESS;
+
+done:
+	for (i = 0; i < SWPK_MAX_LEVELS; i++) {
+		if (levels[i].data != levels[i].pixel)
+			free(levels[i].data);
+		free(levels[i].pixel);
+	}
+	FreeImage_DeInitialise();
+	return status;
+}
@@ -0,0 +1,344 @@
+/**
+    Simple wallpaper application.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#define _POSIX_C_SOURCE 200809L
+#include "wallpaper.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+unsigned int g_uploadpath = SWP_UPLOAD_PATH_AUTO;
+
+/**
+ *	Version of the measurement, cached
+ *	choices of other versions are ignored.
+ */
+#define SWP_TUNE_VERSION 1
+
+/**
+ *	Number of uploads of each size, the
+ *	fastest is kept to skip the warm-up.
+ */
+#define SWP_TUNE_REPEAT 3
+
+/**
+ *	Representative picture sizes.
+ */
+static const unsigned int g_tunesizes[][2] = {
+	{1024, 1024},
+	{1920, 1080},
+	{3840, 2160},
+};
+
+static const char* const g_uploadpathnames[] = {"auto", "direct", "pbo", "persistent"};
+
+const char *swpGetUploadPathName(unsigned int path) {
+
+	return path <= SWP_UPLOAD_PATH_PERSISTENT ? g_uploadpathnames[path] : "unknown";
+}
+
+unsigned int swpGetUploadPath(const char *name) {
+
+	unsigned int i;
+
+	for (i = 0; i <= SWP_UPLOAD_PATH_PERSISTENT; i++) {
+		if (strcmp(name, g_uploadpathnames[i]) == 0)
+			return i;
+	}
+	return (unsigned int) -1;
+}
+
+/**
+ *	@Return non-zero if the context supports the upload path.
+ */
+static int swpIsUploadPathSupported(unsigned int path) {
+
+	switch (path) {
+		case SWP_UPLOAD_PATH_DIRECT:
+			return 1;
+		case SWP_UPLOAD_PATH_PBO:
+			return g_support_pbo;
+		case SWP_UPLOAD_PATH_PERSISTENT:
+			return g_support_pbo && g_support_buffer_storage && g_support_sync;
+		default:
+			return 0;
+	}
+}
+
+static int swpGetTunePath(char *path, size_t size, int create) {
+
+	const char* strings[3];
+	char name[64];
+	swpHashState state;
+	const Uint32 version = SWP_TUNE_VERSION;
+	unsigned int i;
+
+	/*	Measured for each driver.	*/
+	strings[0] = (const char *) glGetString(GL_VENDOR);
+	strings[1] = (const char *) glGetString(GL_RENDERER);
+	strings[2] = (const char *) glGetString(GL_VERSION);
+	swpHashInit(&state);
+	swpHashUpdate(&state, &version, sizeof(version));
+	for (i = 0; i < 3; i++) {
+		if (strings[i] != NULL)
+			swpHashUpdate(&state, strings[i], strlen(strings[i]) + 1);
+	}
+	snprintf(name, sizeof(name), "upload-%016llx.txt", (unsigned long long) swpHashDigest(&state));
+	return swpGetCachePath(path, size, name, create);
+}
+
+/**
+ *	@Return cached upload path of the driver, SWP_UPLOAD_PATH_AUTO if not measured.
+ */
+static unsigned int swpLoadUploadPath(void) {
+
+	char path[4096];
+	char name[32] = {0};
+	unsigned int uploadpath;
+	ssize_t len;
+	int fd;
+
+	if (!swpGetTunePath(path, sizeof(path), 0))
+		return SWP_UPLOAD_PATH_AUTO;
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return SWP_UPLOAD_PATH_AUTO;
+	len = read(fd, name, sizeof(name) - 1);
+	close(fd);
+	if (len <= 0)
+		return SWP_UPLOAD_PATH_AUTO;
+	name[strcspn(name, "\n")] = '\0';
+
+	uploadpath = swpGetUploadPath(name);
+	if (uploadpath == (unsigned int) -1 || !swpIsUploadPathSupported(uploadpath)) {
+		unlink(path);
+		return SWP_UPLOAD_PATH_AUTO;
+	}
+	return uploadpath;
+}
+
+static void swpSaveUploadPath(unsigned int uploadpath) {
+
+	char path[4096];
+	char tmppath[4096 + 32];
+	char line[32];
+	int fd, len;
+
+	if (!swpGetTunePath(path, sizeof(path), 1))
+		return;
+
+	/*	Write to a temporary file, concurrent instances never read a partial file.	*/
+	snprintf(tmppath, sizeof(tmppath), "%s.%ld", path, (long) getpid());
+	fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		return;
+	len = snprintf(line, sizeof(line), "%s\n", swpGetUploadPathName(uploadpath));
+	if (write(fd, line, (size_t) len) != len) {
+		fprintf(stderr, "Failed to write %s, %s.\n", tmppath, strerror(errno));
+		close(fd);
+		unlink(tmppath);
+		return;
+	}
+	close(fd);
+	if (rename(tmppath, path) != 0)
+		unlink(tmppath);
+}
+
+/**
+ *	Upload the picture into \tex with the upload path,
+ *	the unpack buffer \pbo is used by the pbo path.
+ *
+ *	@Return non-zero if successfully.
+ */
+static int swpTuneUpload(unsigned int uploadpath, GLuint tex, GLuint pbo, const void *pixel, unsigned int width,
+                         unsigned int height) {
+
+	const size_t size = (size_t) width * height * 4;
+	const void* data = pixel;
+	GLuint buffer = 0;
+	size_t offset = 0;
+
+	switch (uploadpath) {
+		case SWP_UPLOAD_PATH_PERSISTENT:
+			if (!swpWriteUploadRing(pixel, size, &buffer, &offset))
+				return 0;
+			glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, buffer);
+			data = (const void *) (uintptr_t) offset;
+			break;
+		case SWP_UPLOAD_PATH_PBO:
+			glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pbo);
+#if defined(GLES2) || defined(GLES3)
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, size, pixel, GL_STREAM_DRAW_ARB);
+#else
+			{
+				GLubyte *pbuf;
+
+				/*	Orphaned and copied for each picture like swpLoadTextureFromMem.	*/
+				glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, size, NULL, GL_STREAM_DRAW_ARB);
+				pbuf = (GLubyte *) glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+				if (pbuf == NULL) {
+					glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+					return 0;
+				}
+				memcpy(pbuf, pixel, size);
+				glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+			}
+#endif
+			data = NULL;
+			break;
+		default:
+			break;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, (GLsizei) width, (GLsizei) height, GL_BGRA, GL_UNSIGNED_BYTE, data);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	if (uploadpath == SWP_UPLOAD_PATH_PERSISTENT)
+		swpFenceUploadRing();
+	if (uploadpath != SWP_UPLOAD_PATH_DIRECT)
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+
+	/*	Include the transfer, not only the submission.	*/
+	glFinish();
+	return glGetError() == GL_NO_ERROR;
+}
+
+/**
+ *	Measure the upload paths supported by the context.
+ *
+ *	@Return fastest upload path.
+ */
+static unsigned int swpMeasureUploadPaths(void) {
+
+	const unsigned int numsizes = sizeof(g_tunesizes) / sizeof(g_tunesizes[0]);
+	const unsigned int maxsize = g_tunesizes[numsizes - 1][0] * g_tunesizes[numsizes - 1][1] * 4;
+	const double freq = (double) SDL_GetPerformanceFrequency();
+	unsigned int uploadpath, best = SWP_UPLOAD_PATH_DIRECT;
+	double elapsed, fastest, total, besttotal = 0.0;
+	unsigned char* pixel;
+	GLuint tex[sizeof(g_tunesizes) / sizeof(g_tunesizes[0])];
+	GLuint pbo = 0;
+	Uint64 start;
+	unsigned int i, j;
+	int failed;
+
+	/*	Content does not matter, but the pages have to be resident.	*/
+	pixel = malloc(maxsize);
+	if (pixel == NULL) {
+		fprintf(stderr, "Failed to allocate %d bytes, %s.\n", maxsize, strerror(errno));
+		return SWP_UPLOAD_PATH_AUTO;
+	}
+	for (i = 0; i < maxsize; i++)
+		pixel[i] = (unsigned char) i;
+
+	glGenTextures(numsizes, tex);
+	for (i = 0; i < numsizes; i++) {
+		glBindTexture(GL_TEXTURE_2D, tex[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, (GLsizei) g_tunesizes[i][0], (GLsizei) g_tunesizes[i][1], 0, GL_BGRA,
+		             GL_UNSIGNED_BYTE, NULL);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	if (g_support_pbo)
+		glGenBuffersARB(1, &pbo);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glGetError();
+
+	for (uploadpath = SWP_UPLOAD_PATH_DIRECT; uploadpath <= SWP_UPLOAD_PATH_PERSISTENT; uploadpath++) {
+		if (!swpIsUploadPathSupported(uploadpath))
+			continue;
+		if (uploadpath == SWP_UPLOAD_PATH_PERSISTENT && !swpCreateUploadRing(maxsize)) {
+			swpReleaseUploadRing();
+			continue;
+		}
+
+		/*	Sum of the fastest upload of each size.	*/
+		total = 0.0;
+		failed = 0;
+		for (i = 0; i < numsizes && !failed; i++) {
+			fastest = 0.0;
+			for (j = 0; j < SWP_TUNE_REPEAT; j++) {
+				start = SDL_GetPerformanceCounter();
+				if (!swpTuneUpload(uploadpath, tex[i], pbo, pixel, g_tunesizes[i][0], g_tunesizes[i][1])) {
+					failed = 1;
+					break;
+				}
+				elapsed = (double) (SDL_GetPerformanceCounter() - start) / freq;
+				if (j == 0 || elapsed < fastest)
+					fastest = elapsed;
+			}
+			total += fastest;
+		}
+		if (uploadpath == SWP_UPLOAD_PATH_PERSISTENT)
+			swpReleaseUploadRing();
+
+		if (failed) {
+			swpVerbosePrintf("Upload path %s failed.\n", swpGetUploadPathName(uploadpath));
+			continue;
+		}
+		swpVerbosePrintf("Upload path %s, %.2f ms.\n", swpGetUploadPathName(uploadpath), total * 1000.0);
+		if (besttotal == 0.0 || total < besttotal) {
+			besttotal = total;
+			best = uploadpath;
+		}
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (pbo != 0)
+		glDeleteBuffersARB(1, &pbo);
+	glDeleteTextures(numsizes, tex);
+	free(pixel);
+
+	return best;
+}
+
+void swpTuneUploadPath(void) {
+
+	unsigned int uploadpath = g_uploadpath;
+
+	/*	Forced path the context lacks, fall back to the next simpler one.	*/
+	while (uploadpath != SWP_UPLOAD_PATH_AUTO && !swpIsUploadPathSupported(uploadpath)) {
+		fprintf(stderr, "Upload path %s is not supported, using %s.\n", swpGetUploadPathName(uploadpath),
+		        swpGetUploadPathName(uploadpath - 1));
+		uploadpath--;
+	}
+
+	/*	Measured once for each driver.	*/
+	if (uploadpath == SWP_UPLOAD_PATH_AUTO) {
+		uploadpath = swpLoadUploadPath();
+		if (uploadpath == SWP_UPLOAD_PATH_AUTO) {
+			uploadpath = swpMeasureUploadPaths();
+			if (uploadpath != SWP_UPLOAD_PATH_AUTO) {
+				swpSaveUploadPath(uploadpath);
+			} else {
+				/*	Not measured, the most capable path.	*/
+				uploadpath = SWP_UPLOAD_PATH_PERSISTENT;
+				while (!swpIsUploadPathSupported(uploadpath))
+					uploadpath--;
+			}
+		}
+	}
+
+	/*	The direct path uploads from the pixel data, without pixel buffers.	*/
+	if (uploadpath == SWP_UPLOAD_PATH_DIRECT)
+		g_support_pbo = 0;
+	g_uploadpath = uploadpath;
+	swpVerbosePrintf("Using the %s upload path.\n", swpGetUploadPathName(uploadpath));
+}
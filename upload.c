@@ -0,0 +1,368 @@
+/**
+    Simple wallpaper application.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "wallpaper.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL_events.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_error.h>
+
+#define SWP_UPLOAD_SLOTS 3                      /*	Uploads in flight.	*/
+#define SWP_UPLOAD_ALIGNMENT 4096               /*	Slot offsets are page aligned.	*/
+#define SWP_UPLOAD_QUEUE 16                     /*	Pictures waiting for the upload thread.	*/
+
+/**
+ *	Region of the persistently mapped buffer
+ *	and the fence of the last upload from it.
+ */
+typedef struct swp_upload_slot_t{
+	size_t offset;                  /*	Offset in the ring buffer.	*/
+	GLsync fence;                   /*	Signaled when the GPU is done reading the slot, NULL if idle.	*/
+}swpUploadSlot;
+
+/**
+ *	Picture waiting for the upload thread and the
+ *	event to push once its texture is ready.
+ */
+typedef struct swp_upload_job_t{
+	swpTextureDesc* desc;           /*	*/
+	swpPrepareFunc prepare;         /*	Builds the pixel data of the picture first, NULL if decoded.	*/
+	SDL_Event event;                /*	*/
+}swpUploadJob;
+
+unsigned int g_uploadthread = 0;
+
+static GLuint g_uploadbuffer = 0;
+static unsigned char* g_uploadmap = NULL;      /*	Persistent coherent mapping of the ring buffer.	*/
+static size_t g_uploadslotsize = 0;
+static swpUploadSlot g_uploadslots[SWP_UPLOAD_SLOTS];
+static unsigned int g_uploadnext = 0;          /*	Next slot to fill.	*/
+static int g_uploadpending = -1;               /*	Slot acquired and not yet fenced, -1 if none.	*/
+static SDL_mutex* g_uploadringlock = NULL;     /*	Held from writing a slot until it is fenced.	*/
+static size_t g_uploadtrimmed = 0;             /*	Slot size of the ring released while idle, 0 if not released.	*/
+
+static SDL_Window* g_uploadwindow = NULL;
+static SDL_GLContext g_uploadcontext = NULL;  /*	Context shared with the render context.	*/
+static SDL_Thread* g_uploadworker = NULL;
+static SDL_mutex* g_uploadlock = NULL;         /*	Protects the queue.	*/
+static SDL_cond* g_uploadcond = NULL;          /*	Signaled when the queue changes.	*/
+static swpUploadJob g_uploadqueue[SWP_UPLOAD_QUEUE];
+static unsigned int g_uploadhead = 0;
+static unsigned int g_uploadcount = 0;
+static SDL_atomic_t g_uploadalive;
+
+static void swpWaitUploadSlot(swpUploadSlot *slot) {
+
+	GLenum status;
+
+	if (slot->fence == NULL)
+		return;
+
+	/*	Only blocks if the GPU is still reading the upload issued SWP_UPLOAD_SLOTS pictures ago.	*/
+	do {
+		status = glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+	} while (status == GL_TIMEOUT_EXPIRED);
+	if (status == GL_WAIT_FAILED)
+		fprintf(stderr, "Failed to wait for upload fence, %d.\n", glGetError());
+
+	glDeleteSync(slot->fence);
+	slot->fence = NULL;
+}
+
+static void swpDestroyUploadBuffer(void) {
+
+	unsigned int i;
+
+	for (i = 0; i < SWP_UPLOAD_SLOTS; i++)
+		swpWaitUploadSlot(&g_uploadslots[i]);
+	if (g_uploadbuffer != 0) {
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, g_uploadbuffer);
+		glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+		swpTrackVRAM(SWP_VRAM_BUFFER, g_uploadbuffer, 0);
+		glDeleteBuffersARB(1, &g_uploadbuffer);
+	}
+	g_uploadbuffer = 0;
+	g_uploadmap = NULL;
+	g_uploadslotsize = 0;
+	g_uploadpending = -1;
+}
+
+static int swpCreateUploadBuffer(size_t slotsize) {
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	unsigned int i;
+
+	slotsize = (slotsize + SWP_UPLOAD_ALIGNMENT - 1) & ~((size_t) SWP_UPLOAD_ALIGNMENT - 1);
+
+	/*	Pop any existing error.	*/
+	glGetError();
+
+	/*	Immutable storage, mapped once for the lifetime of the buffer.	*/
+	glGenBuffersARB(1, &g_uploadbuffer);
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, g_uploadbuffer);
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER_ARB, (GLsizeiptr) (slotsize * SWP_UPLOAD_SLOTS), NULL, flags);
+	if (glGetError() == GL_NO_ERROR)
+		g_uploadmap = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER_ARB, 0, (GLsizeiptr) (slotsize * SWP_UPLOAD_SLOTS),
+		                               flags);
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+
+	if (g_uploadmap == NULL) {
+		fprintf(stderr, "Failed to create %zu MB upload ring, %d.\n", slotsize * SWP_UPLOAD_SLOTS / (1024 * 1024),
+		        glGetError());
+		glDeleteBuffersARB(1, &g_uploadbuffer);
+		g_uploadbuffer = 0;
+		return 0;
+	}
+	swpTrackVRAM(SWP_VRAM_BUFFER, g_uploadbuffer, slotsize * SWP_UPLOAD_SLOTS);
+
+	g_uploadslotsize = slotsize;
+	for (i = 0; i < SWP_UPLOAD_SLOTS; i++)
+		g_uploadslots[i].offset = i * slotsize;
+	swpVerbosePrintf("Upload ring of %d slots, %zu MB each.\n", SWP_UPLOAD_SLOTS, slotsize / (1024 * 1024));
+
+	return 1;
+}
+
+int swpCreateUploadRing(size_t slotsize) {
+
+	if (!g_support_pbo || !g_support_buffer_storage || !g_support_sync)
+		return 0;
+	g_uploadringlock = SDL_CreateMutex();
+	return swpCreateUploadBuffer(slotsize);
+}
+
+int swpWriteUploadRing(const void *pixel, size_t size, GLuint *buffer, size_t *offset) {
+
+	swpUploadSlot* slot;
+
+	if (g_uploadringlock == NULL)
+		return 0;
+
+	/*	The render and upload thread share the ring.	*/
+	SDL_LockMutex(g_uploadringlock);
+
+	/*	Ring released while idle is created again on the next picture.	*/
+	if (g_uploadmap == NULL && g_uploadtrimmed > 0) {
+		const size_t slotsize = SDL_max(size, g_uploadtrimmed);
+		g_uploadtrimmed = 0;
+		swpCreateUploadBuffer(slotsize);
+	}
+	if (g_uploadmap == NULL) {
+		SDL_UnlockMutex(g_uploadringlock);
+		return 0;
+	}
+
+	/*	Recreate the ring for pictures larger than the slots.	*/
+	if (size > g_uploadslotsize) {
+		const size_t slotsize = SDL_max(size, g_uploadslotsize * 2);
+		swpDestroyUploadBuffer();
+		if (!swpCreateUploadBuffer(slotsize)) {
+			SDL_UnlockMutex(g_uploadringlock);
+			return 0;
+		}
+	}
+
+	slot = &g_uploadslots[g_uploadnext];
+	swpWaitUploadSlot(slot);
+
+	/*	Copied on the calling thread, the task pool may be busy with the jobs of the reader
+	 *	thread for a long time. The mapping is coherent and needs no flush.	*/
+	memcpy(&g_uploadmap[slot->offset], pixel, size);
+
+	*buffer = g_uploadbuffer;
+	*offset = slot->offset;
+	g_uploadpending = (int) g_uploadnext;
+	g_uploadnext = (g_uploadnext + 1) % SWP_UPLOAD_SLOTS;
+
+	return 1;
+}
+
+void swpFenceUploadRing(void) {
+
+	if (g_uploadpending < 0)
+		return;
+
+	/*	Slot is reused once the commands reading it have completed.	*/
+	g_uploadslots[g_uploadpending].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	g_uploadpending = -1;
+	SDL_UnlockMutex(g_uploadringlock);
+}
+
+void swpTrimUploadRing(void) {
+
+	if (g_uploadringlock == NULL)
+		return;
+
+	SDL_LockMutex(g_uploadringlock);
+	if (g_uploadmap != NULL) {
+		g_uploadtrimmed = g_uploadslotsize;
+		swpDestroyUploadBuffer();
+	}
+	SDL_UnlockMutex(g_uploadringlock);
+}
+
+void swpReleaseUploadRing(void) {
+
+	swpDestroyUploadBuffer();
+	SDL_DestroyMutex(g_uploadringlock);
+	g_uploadringlock = NULL;
+}
+
+static void swpFinishUpload(void) {
+
+	GLsync fence;
+	GLenum status;
+
+	/*	Wait on the upload thread, the render thread only ever binds completed textures.	*/
+	if (!g_support_sync) {
+		glFinish();
+		return;
+	}
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	do {
+		status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+	} while (status == GL_TIMEOUT_EXPIRED);
+	glDeleteSync(fence);
+}
+
+static int swpUploadWorker(void *userdata) {
+
+	swpUploadJob job;
+	GLuint pbo = 0;
+
+	if (SDL_GL_MakeCurrent(g_uploadwindow, g_uploadcontext) < 0) {
+		fprintf(stderr, "Failed to set upload context current, %s.\n", SDL_GetError());
+		return 0;
+	}
+	if (g_support_pbo)
+		glGenBuffersARB(1, &pbo);
+
+	SDL_LockMutex(g_uploadlock);
+	while (SDL_AtomicGet(&g_uploadalive)) {
+		if (g_uploadcount == 0) {
+			SDL_CondWait(g_uploadcond, g_uploadlock);
+			continue;
+		}
+		job = g_uploadqueue[g_uploadhead];
+		g_uploadhead = (g_uploadhead + 1) % SWP_UPLOAD_QUEUE;
+		g_uploadcount--;
+		SDL_CondSignal(g_uploadcond);
+		SDL_UnlockMutex(g_uploadlock);
+
+		/*	Upload and generate the mipmaps off the render thread.	*/
+		if (job.prepare != NULL)
+			job.prepare(job.desc);
+		if (job.desc->pixel != NULL && job.desc->texture == 0 &&
+		    swpLoadTextureFromMem(&job.desc->texture, pbo, job.desc)) {
+			job.desc->pixel = NULL;
+			swpFinishUpload();
+		}
+		SDL_PushEvent(&job.event);
+
+		SDL_LockMutex(g_uploadlock);
+	}
+	SDL_UnlockMutex(g_uploadlock);
+
+	if (pbo != 0) {
+		swpTrackVRAM(SWP_VRAM_BUFFER, pbo, 0);
+		glDeleteBuffersARB(1, &pbo);
+	}
+	SDL_GL_MakeCurrent(g_uploadwindow, NULL);
+
+	return 0;
+}
+
+int swpCreateUploadThread(SDL_Window *window, SDL_GLContext context) {
+
+	/*	Objects are shared with the context current on the calling thread.	*/
+	SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+	g_uploadcontext = SDL_GL_CreateContext(window);
+	SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+	if (g_uploadcontext == NULL) {
+		fprintf(stderr, "Failed to create shared upload context, %s.\n", SDL_GetError());
+		return 0;
+	}
+	if (SDL_GL_MakeCurrent(window, context) < 0) {
+		fprintf(stderr, "Failed to set OpenGL context current, %s.\n", SDL_GetError());
+		SDL_GL_DeleteContext(g_uploadcontext);
+		g_uploadcontext = NULL;
+		return 0;
+	}
+	g_uploadwindow = window;
+
+	g_uploadlock = SDL_CreateMutex();
+	g_uploadcond = SDL_CreateCond();
+	SDL_AtomicSet(&g_uploadalive, 1);
+	g_uploadworker = SDL_CreateThread(swpUploadWorker, "upload", NULL);
+	if (g_uploadworker == NULL) {
+		fprintf(stderr, "Failed to create thread, %s.\n", SDL_GetError());
+		swpReleaseUploadThread();
+		return 0;
+	}
+	swpVerbosePrintf("Created upload thread with a shared context.\n");
+
+	return 1;
+}
+
+void swpSubmitUpload(swpTextureDesc *desc, const SDL_Event *event) {
+	swpSubmitPreparedUpload(desc, NULL, event);
+}
+
+void swpSubmitPreparedUpload(swpTextureDesc *desc, swpPrepareFunc prepare, const SDL_Event *event) {
+
+	/*	Without the upload thread the render thread uploads on the event.	*/
+	if (!SDL_AtomicGet(&g_uploadalive) || (desc->pixel == NULL && prepare == NULL)) {
+		if (prepare != NULL)
+			prepare(desc);
+		SDL_PushEvent((SDL_Event *) event);
+		return;
+	}
+
+	SDL_LockMutex(g_uploadlock);
+	while (g_uploadcount == SWP_UPLOAD_QUEUE && SDL_AtomicGet(&g_uploadalive))
+		SDL_CondWait(g_uploadcond, g_uploadlock);
+	g_uploadqueue[(g_uploadhead + g_uploadcount) % SWP_UPLOAD_QUEUE].desc = desc;
+	g_uploadqueue[(g_uploadhead + g_uploadcount) % SWP_UPLOAD_QUEUE].prepare = prepare;
+	g_uploadqueue[(g_uploadhead + g_uploadcount) % SWP_UPLOAD_QUEUE].event = *event;
+	g_uploadcount++;
+	SDL_CondBroadcast(g_uploadcond);
+	SDL_UnlockMutex(g_uploadlock);
+}
+
+void swpReleaseUploadThread(void) {
+
+	if (g_uploadlock != NULL) {
+		SDL_LockMutex(g_uploadlock);
+		SDL_AtomicSet(&g_uploadalive, 0);
+		SDL_CondBroadcast(g_uploadcond);
+		SDL_UnlockMutex(g_uploadlock);
+		SDL_WaitThread(g_uploadworker, NULL);
+		SDL_DestroyCond(g_uploadcond);
+		SDL_DestroyMutex(g_uploadlock);
+	}
+	if (g_uploadcontext != NULL)
+		SDL_GL_DeleteContext(g_uploadcontext);
+	g_uploadworker = NULL;
+	g_uploadcond = NULL;
+	g_uploadlock = NULL;
+	g_uploadcontext = NULL;
+}
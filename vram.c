@@ -0,0 +1,269 @@
+/**
+    Simple wallpaper application.
+    Copyright (C) 2016  Valdemar Lindberg
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include "wallpaper.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/**
+ *	Tracked texture or buffer object.
+ */
+typedef struct swp_vram_entry_t{
+	GLuint name;                    /*	*/
+	unsigned int kind;              /*	SWP_VRAM_TEXTURE or SWP_VRAM_BUFFER.	*/
+	size_t size;                    /*	Estimated size in bytes.	*/
+}swpVRAMEntry;
+
+size_t g_vrambudget = 0;
+
+static SDL_SpinLock g_vramlock = 0;
+static swpVRAMEntry* g_vramentries = NULL;
+static unsigned int g_numvramentries = 0;
+static unsigned int g_vramfallbacks = 0;
+
+size_t swpGetVRAMSize(GLenum intfor, unsigned int width, unsigned int height, unsigned int numlevels) {
+
+	size_t size = 0;
+	unsigned int i, w, h;
+
+	for (i = 0; i < SDL_max(numlevels, 1); i++) {
+		w = SDL_max(width >> i, 1);
+		h = SDL_max(height >> i, 1);
+		switch (intfor) {
+			case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+			case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+				size += (size_t) ((w + 3) / 4) * ((h + 3) / 4) * 8;
+				break;
+			case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+			case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+			case GL_COMPRESSED_RGBA_BPTC_UNORM:
+				size += (size_t) ((w + 3) / 4) * ((h + 3) / 4) * 16;
+				break;
+			case GL_COMPRESSED_RGB:
+			case GL_COMPRESSED_RGBA:
+			case GL_R8:
+			case GL_LUMINANCE8:
+				size += (size_t) w * h;
+				break;
+			case GL_RGB565:
+			case GL_RGB5:
+			case GL_RGB5_A1:
+				size += (size_t) w * h * 2;
+				break;
+			default:
+				/*	Drivers pad 24-bit texels to 32 bits.	*/
+				size += (size_t) w * h * 4;
+				break;
+		}
+	}
+	return size;
+}
+
+void swpTrackVRAM(unsigned int kind, GLuint name, size_t size) {
+
+	swpVRAMEntry* entries;
+	unsigned int i;
+
+	if (name == 0)
+		return;
+
+	SDL_AtomicLock(&g_vramlock);
+	for (i = 0; i < g_numvramentries; i++) {
+		if (g_vramentries[i].name == name && g_vramentries[i].kind == kind)
+			break;
+	}
+
+	if (size == 0) {
+		/*	Released.	*/
+		if (i < g_numvramentries)
+			g_vramentries[i] = g_vramentries[--g_numvramentries];
+	} else if (i < g_numvramentries) {
+		g_vramentries[i].size = size;
+	} else {
+		entries = realloc(g_vramentries, (g_numvramentries + 1) * sizeof(swpVRAMEntry));
+		if (entries != NULL) {
+			g_vramentries = entries;
+			g_vramentries[g_numvramentries].name = name;
+			g_vramentries[g_numvramentries].kind = kind;
+			g_vramentries[g_numvramentries].size = size;
+			g_numvramentries++;
+		}
+	}
+	SDL_AtomicUnlock(&g_vramlock);
+}
+
+size_t swpGetTrackedVRAM(unsigned int kind, GLuint name) {
+
+	size_t size = 0;
+	unsigned int i;
+
+	SDL_AtomicLock(&g_vramlock);
+	for (i = 0; i < g_numvramentries; i++) {
+		if (g_vramentries[i].name == name && g_vramentries[i].kind == kind) {
+			size = g_vramentries[i].size;
+			break;
+		}
+	}
+	SDL_AtomicUnlock(&g_vramlock);
+	return size;
+}
+
+size_t swpGetVRAMUsage(void) {
+
+	size_t size = 0;
+	unsigned int i;
+
+	SDL_AtomicLock(&g_vramlock);
+	for (i = 0; i < g_numvramentries; i++)
+		size += g_vramentries[i].size;
+	SDL_AtomicUnlock(&g_vramlock);
+	return size;
+}
+
+/**
+ *	Halve the base level of \fitted on the CPU.
+ *
+ *	@Return non-zero if successfully.
+ */
+static int swpHalveBaseLevel(swpTextureDesc *fitted, const void *original) {
+
+	const unsigned char* src = (const unsigned char *) fitted->pixel + fitted->levels[0].offset;
+	const unsigned int width = (fitted->width + 1) / 2;
+	const unsigned int height = (fitted->height + 1) / 2;
+	void* pixel;
+
+	pixel = malloc((size_t) width * height * 4);
+	if (pixel == NULL) {
+		fprintf(stderr, "Failed to allocate %dx%d fallback level, %s.\n", width, height, strerror(errno));
+		return 0;
+	}
+	swpDownsample2x(src, fitted->width, fitted->height, pixel);
+	if (fitted->pixel != original)
+		free(fitted->pixel);
+
+	fitted->pixel = pixel;
+	fitted->width = width;
+	fitted->height = height;
+	fitted->size = width * height * 4;
+	fitted->numlevels = 1;
+	fitted->alignment = 4;
+	fitted->levels[0].width = width;
+	fitted->levels[0].height = height;
+	fitted->levels[0].offset = 0;
+	fitted->levels[0].size = fitted->size;
+	return 1;
+}
+
+int swpFitVRAMBudget(const swpTextureDesc *desc, swpTextureDesc *fitted, size_t replaced) {
+
+	size_t used, size;
+	unsigned int numlevels;
+
+	if (g_vrambudget == 0 || desc->pixel == NULL)
+		return 0;
+
+	/*	Memory of the texture being replaced is released by the upload.	*/
+	used = swpGetVRAMUsage();
+	used = used > replaced ? used - replaced : 0;
+	numlevels = desc->numlevels > 0 ? desc->numlevels
+	          : desc->animation != NULL ? 1 : swpGetMipLevelCount(desc->width, desc->height);
+	size = swpGetVRAMSize(desc->intfor, desc->width, desc->height, numlevels);
+	if (used + size <= g_vrambudget)
+		return 0;
+
+	/*	16-bit texels.	*/
+	*fitted = *desc;
+	if (!desc->compressed && desc->bpp == 4 && desc->imgdatatype == GL_UNSIGNED_BYTE &&
+	    (desc->intfor == GL_RGB || desc->intfor == GL_RGBA)) {
+		if (desc->intfor == GL_RGB)
+			fitted->intfor = g_glversion >= 41 ? GL_RGB565 : GL_RGB5;
+		else
+			fitted->intfor = GL_RGB5_A1;
+		size = swpGetVRAMSize(fitted->intfor, fitted->width, fitted->height, numlevels);
+	}
+
+	/*	Reduced resolution from the pre-built levels.	*/
+	while (used + size > g_vrambudget && fitted->numlevels > 1) {
+		memmove(&fitted->levels[0], &fitted->levels[1], sizeof(fitted->levels[0]) * (fitted->numlevels - 1));
+		fitted->numlevels--;
+		fitted->width = fitted->levels[0].width;
+		fitted->height = fitted->levels[0].height;
+		size = swpGetVRAMSize(fitted->intfor, fitted->width, fitted->height, fitted->numlevels);
+	}
+
+	/*	No generated mipmaps.	*/
+	if (used + size > g_vrambudget && fitted->numlevels == 0) {
+		fitted->numlevels = 1;
+		fitted->alignment = 4;
+		fitted->levels[0].width = fitted->width;
+		fitted->levels[0].height = fitted->height;
+		fitted->levels[0].offset = 0;
+		fitted->levels[0].size = fitted->size;
+		size = swpGetVRAMSize(fitted->intfor, fitted->width, fitted->height, 1);
+	}
+
+	/*	Reduced resolution of the base level.	*/
+	while (used + size > g_vrambudget && !fitted->compressed && fitted->bpp == 4 &&
+	       fitted->imgdatatype == GL_UNSIGNED_BYTE && (fitted->width > 1 || fitted->height > 1)) {
+		if (!swpHalveBaseLevel(fitted, desc->pixel))
+			break;
+		size = swpGetVRAMSize(fitted->intfor, fitted->width, fitted->height, 1);
+	}
+
+	SDL_AtomicLock(&g_vramlock);
+	g_vramfallbacks++;
+	SDL_AtomicUnlock(&g_vramlock);
+	if (used + size > g_vrambudget)
+		fprintf(stderr, "Picture %dx%d exceeds the VRAM budget by %zu KB.\n", fitted->width, fitted->height,
+		        (used + size - g_vrambudget) / 1024);
+	swpVerbosePrintf("VRAM budget fallback %dx%d to %dx%d, format 0x%x, %d levels, %zu KB.\n", desc->width,
+	                 desc->height, fitted->width, fitted->height, fitted->intfor, fitted->numlevels, size / 1024);
+	return 1;
+}
+
+void swpPrintStats(void) {
+
+	size_t used[2] = {0, 0};
+	unsigned int count[2] = {0, 0};
+	unsigned int i;
+
+	SDL_AtomicLock(&g_vramlock);
+	for (i = 0; i < g_numvramentries; i++) {
+		used[g_vramentries[i].kind] += g_vramentries[i].size;
+		count[g_vramentries[i].kind]++;
+	}
+	SDL_AtomicUnlock(&g_vramlock);
+
+	fprintf(stderr, "VRAM %.1f MB", (double) (used[SWP_VRAM_TEXTURE] + used[SWP_VRAM_BUFFER]) / (1024.0 * 1024.0));
+	if (g_vrambudget > 0)
+		fprintf(stderr, " of %zu MB budget", g_vrambudget / (1024 * 1024));
+	fprintf(stderr, ", textures %.1f MB (%d), buffers %.1f MB (%d), %d fallbacks.\n",
+	        (double) used[SWP_VRAM_TEXTURE] / (1024.0 * 1024.0), count[SWP_VRAM_TEXTURE],
+	        (double) used[SWP_VRAM_BUFFER] / (1024.0 * 1024.0), count[SWP_VRAM_BUFFER], g_vramfallbacks);
+}
+
+void swpReleaseVRAMTracking(void) {
+
+	SDL_AtomicLock(&g_vramlock);
+	free(g_vramentries);
+	g_vramentries = NULL;
+	g_numvramentries = 0;
+	SDL_AtomicUnlock(&g_vramlock);
+}
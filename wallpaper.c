@@ -1,4 +1,5 @@
 #include "wallpaper.h"
+#include "swpk.h"
 
 #include <fcntl.h>
 #include <FreeImage.h>
@@ -15,6 +16,7 @@
 #include <SDL2/SDL_events.h>
 #include <SDL2/SDL_syswm.h>
 #include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_timer.h>
 #include <unistd.h>
 
 /*	*/
@@ -39,6 +41,11 @@ PFNGLMAPBUFFERPROC glMapBufferARB = NULL;
 PFNGLUNMAPBUFFERPROC glUnmapBufferARB = NULL;
 PFNGLBINDBUFFERARBPROC glBindBufferARB = NULL;
 PFNGLBUFFERDATAARBPROC glBufferDataARB = NULL;
+PFNGLBUFFERSTORAGEPROC glBufferStorage = NULL;
+PFNGLMAPBUFFERRANGEPROC glMapBufferRange = NULL;
+PFNGLFENCESYNCPROC glFenceSync = NULL;
+PFNGLCLIENTWAITSYNCPROC glClientWaitSync = NULL;
+PFNGLDELETESYNCPROC glDeleteSync = NULL;
 PFNGLDEBUGMESSAGECALLBACKARBPROC glDebugMessageCallbackARB = NULL;
 PFNGLDEBUGMESSAGECALLBACKAMDPROC glDebugMessageCallbackAMD = NULL;
 
@@ -58,14 +65,33 @@ PFNGLDETACHSHADERPROC glDetachShader = NULL;
 PFNGLDELETESHADERPROC glDeleteShader = NULL;
 PFNGLBINDFRAGDATALOCATIONPROC glBindFragDataLocation = NULL;
 PFNGLGETPROGRAMINFOLOGPROC glGetProgramInfoLog = NULL;
+PFNGLGETPROGRAMBINARYPROC glGetProgramBinary = NULL;
+PFNGLPROGRAMBINARYPROC glProgramBinary = NULL;
+PFNGLPROGRAMPARAMETERIPROC glProgramParameteri = NULL;
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glMaxShaderCompilerThreadsKHR = NULL;
+PFNGLDELETEPROGRAMPROC glDeleteProgram = NULL;
 
 
 PFNGLGENERATEMIPMAPPROC glGenerateMipmap = NULL;
+PFNGLCOMPRESSEDTEXIMAGE2DARBPROC glCompressedTexImage2DARB = NULL;
+PFNGLCOMPRESSEDTEXSUBIMAGE2DARBPROC glCompressedTexSubImage2DARB = NULL;
+PFNGLTEXSTORAGE2DPROC glTexStorage2D = NULL;
+PFNGLCREATETEXTURESPROC glCreateTextures = NULL;
+PFNGLTEXTURESTORAGE2DPROC glTextureStorage2D = NULL;
+PFNGLTEXTURESUBIMAGE2DPROC glTextureSubImage2D = NULL;
+PFNGLCOMPRESSEDTEXTURESUBIMAGE2DPROC glCompressedTextureSubImage2D = NULL;
+PFNGLTEXTUREPARAMETERIPROC glTextureParameteri = NULL;
+PFNGLGENERATETEXTUREMIPMAPPROC glGenerateTextureMipmap = NULL;
+PFNGLGETTEXTUREPARAMETERIVPROC glGetTextureParameteriv = NULL;
+PFNGLGETTEXTURELEVELPARAMETERIVPROC glGetTextureLevelParameteriv = NULL;
 PFNGLUSEPROGRAMPROC glUseProgram = NULL;
 PFNGLGETUNIFORMLOCATIONARBPROC glGetUniformLocationARB = NULL;
 PFNGLUNIFORM1IARBPROC glUniform1iARB = NULL;
 PFNGLUNIFORM1FARBPROC glUniform1fARB = NULL;
 PFNGLUNIFORM1FVARBPROC glUniform1fvARB = NULL;
+PFNGLUNIFORM3FVARBPROC glUniform3fvARB = NULL;
+PFNGLUNIFORM4FVARBPROC glUniform4fvARB = NULL;
+PFNGLUNIFORMMATRIX3FVARBPROC glUniformMatrix3fvARB = NULL;
 PFNGLPROGRAMUNIFORM1IPROC glProgramUniform1i = NULL;
 PFNGLPROGRAMUNIFORM1FPROC glProgramUniform1f = NULL;
 
@@ -82,6 +108,7 @@ const char* gc_vertex = ""
 "#else\n"
 "varying vec2 uv;\n"
 "#endif\n"
+"uniform float flipv;\n"
 "out gl_PerVertex{\n"
 "    vec4 gl_Position;\n"
 "    float gl_PointSize;\n"
@@ -90,6 +117,7 @@ const char* gc_vertex = ""
 "void main(void){\n"
 "	gl_Position = vec4(vertex,1.0);\n"
 "	uv = (vertex.xy + vec2(1.0)) / 2.0;"
+"	uv.y = mix(uv.y, 1.0 - uv.y, flipv);\n"
 "}\n";
 
 /*	Default fragment shader.	*/
@@ -164,7 +192,7 @@ const float gc_quad[4][3] = {
 
 /*	global.	*/
 int g_alive = 1;						/*	*/
-unsigned int g_compression = 0;			/*	Use compression.	*/
+unsigned int g_compression = SWP_COMPRESSION_NONE;	/*	Compression mode.	*/
 unsigned int g_wallpaper = 0;			/*	Wallpaper mode.	*/
 unsigned int g_fullscreen = 0;			/*	Fullscreen mode.	*/
 unsigned int g_borderless = 0;			/*	Borderless mode.	*/
@@ -176,7 +204,11 @@ int g_winres[2] = {-1,-1};				/*	Window resolution.	*/
 int g_winpos[2] = {-1,-1};				/*	Window position.	*/
 int g_maxtexsize;
 int g_support_pbo = 0;
+int g_support_s3tc = 0;
+int g_support_progbinary = 0;
+int g_support_parallel_compile = 0;
 unsigned int g_core_profile = 1;
+size_t g_framebudget = 64 * 1024 * 1024;
 
 
 int swpVerbosePrintf(const char *format, ...) {
@@ -322,6 +354,11 @@ void swpLoadGLFunc(void) {
 	glMapBufferARB = SDL_GL_GetProcAddress("glMapBufferARB");
 	glUnmapBufferARB = SDL_GL_GetProcAddress("glUnmapBufferARB");
 	glBufferDataARB = SDL_GL_GetProcAddress("glBufferDataARB");
+	glBufferStorage = SDL_GL_GetProcAddress("glBufferStorage");
+	glMapBufferRange = SDL_GL_GetProcAddress("glMapBufferRange");
+	glFenceSync = SDL_GL_GetProcAddress("glFenceSync");
+	glClientWaitSync = SDL_GL_GetProcAddress("glClientWaitSync");
+	glDeleteSync = SDL_GL_GetProcAddress("glDeleteSync");
 
 	/*	*/
 	glEnableVertexAttribArrayARB = SDL_GL_GetProcAddress("glEnableVertexAttribArrayARB");
@@ -342,14 +379,35 @@ void swpLoadGLFunc(void) {
 	glDeleteShader = SDL_GL_GetProcAddress("glDeleteShader");
 	glBindFragDataLocation = SDL_GL_GetProcAddress("glBindFragDataLocation");
 	glGetProgramInfoLog = SDL_GL_GetProcAddress("glGetProgramInfoLog");
+	glGetProgramBinary = SDL_GL_GetProcAddress("glGetProgramBinary");
+	glProgramBinary = SDL_GL_GetProcAddress("glProgramBinary");
+	glProgramParameteri = SDL_GL_GetProcAddress("glProgramParameteri");
+	glMaxShaderCompilerThreadsKHR = SDL_GL_GetProcAddress("glMaxShaderCompilerThreadsKHR");
+	if (glMaxShaderCompilerThreadsKHR == NULL)
+		glMaxShaderCompilerThreadsKHR = SDL_GL_GetProcAddress("glMaxShaderCompilerThreadsARB");
+	glDeleteProgram = SDL_GL_GetProcAddress("glDeleteProgram");
 
 	/*	*/
 	glGenerateMipmap = SDL_GL_GetProcAddress("glGenerateMipmap");
+	glCompressedTexImage2DARB = SDL_GL_GetProcAddress("glCompressedTexImage2DARB");
+	glCompressedTexSubImage2DARB = SDL_GL_GetProcAddress("glCompressedTexSubImage2DARB");
+	glTexStorage2D = SDL_GL_GetProcAddress("glTexStorage2D");
+	glCreateTextures = SDL_GL_GetProcAddress("glCreateTextures");
+	glTextureStorage2D = SDL_GL_GetProcAddress("glTextureStorage2D");
+	glTextureSubImage2D = SDL_GL_GetProcAddress("glTextureSubImage2D");
+	glCompressedTextureSubImage2D = SDL_GL_GetProcAddress("glCompressedTextureSubImage2D");
+	glTextureParameteri = SDL_GL_GetProcAddress("glTextureParameteri");
+	glGenerateTextureMipmap = SDL_GL_GetProcAddress("glGenerateTextureMipmap");
+	glGetTextureParameteriv = SDL_GL_GetProcAddress("glGetTextureParameteriv");
+	glGetTextureLevelParameteriv = SDL_GL_GetProcAddress("glGetTextureLevelParameteriv");
 	glUseProgram = SDL_GL_GetProcAddress("glUseProgram");
 	glGetUniformLocationARB = SDL_GL_GetProcAddress("glGetUniformLocationARB");
 	glUniform1iARB = SDL_GL_GetProcAddress("glUniform1iARB");
 	glUniform1fARB = SDL_GL_GetProcAddress("glUniform1fARB");
 	glUniform1fvARB = SDL_GL_GetProcAddress("glUniform1fvARB");
+	glUniform3fvARB = SDL_GL_GetProcAddress("glUniform3fvARB");
+	glUniform4fvARB = SDL_GL_GetProcAddress("glUniform4fvARB");
+	glUniformMatrix3fvARB = SDL_GL_GetProcAddress("glUniformMatrix3fvARB");
 
 	glProgramUniform1i = SDL_GL_GetProcAddress("glProgramUniform1i");
 	glProgramUniform1f = SDL_GL_GetProcAddress("glProgramUniform1f");
@@ -482,49 +540,20 @@ unsigned int swpGetGLSLVersion(void) {
 	}
 }
 
-unsigned int swpCheckExtensionSupported(const char *extension) {
+int swpCompileShader(const char *vshader, const char *fshader, swpShaderBuild *build) {
 
-	int i;
-	GLint k;
-	PFNGLGETSTRINGIPROC glGetStringi = NULL;
-
-	/*	*/
-	glGetStringi = (PFNGLGETSTRINGIPROC) SDL_GL_GetProcAddress("glGetStringi");
-
-	/*	*/
-	if (glGetStringi) {
-
-		/*	*/
-		glGetIntegerv(GL_NUM_EXTENSIONS, &k);
-
-		/*	Iterate each extensions.	*/
-		for (i = 0; i < k; i++) {
-			const GLubyte *nextension = glGetStringi(GL_EXTENSIONS, i);
-			if (nextension) {
-				if (strstr((const char *) nextension, extension))
-					return 1;
-			}
-		}
-	} else
-		return (strstr((const char *) glGetString(GL_EXTENSIONS), extension) != NULL);
-
-	return 0;
-}
-
-
-GLint swpCreateShader(const char *vshader, const char *fshader) {
-
-	GLuint vs, fs;
 	GLuint prog;
-	GLuint vstatus, lstatus;
 	const char *vsources[2];
 	const char *fsources[2];
 	char glversion[32];
 
 	const char *strcore;
+	swpHashState hashstate;
 
 	/*	*/
 	swpVerbosePrintf("Loading shader program.\n");
+	memset(build, 0, sizeof(*build));
+	build->start = SDL_GetPerformanceCounter();
 
 	/*	Check if core.	*/
 	strcore = "";
@@ -536,27 +565,70 @@ GLint swpCreateShader(const char *vshader, const char *fshader) {
 
 	/*	*/
 	prog = glCreateProgram();
+	if (prog == 0)
+		return 0;
+	build->prog = prog;
+
+	/*	Use the program binary linked by a previous run, if the driver still accepts it.	*/
+	if (g_support_progbinary) {
+		swpHashInit(&hashstate);
+		swpHashUpdate(&hashstate, glversion, strlen(glversion) + 1);
+		if (vshader != NULL)
+			swpHashUpdate(&hashstate, vshader, strlen(vshader) + 1);
+		if (fshader != NULL)
+			swpHashUpdate(&hashstate, fshader, strlen(fshader) + 1);
+		build->hash = swpHashDigest(&hashstate);
+		if (swpLoadProgramBinary(prog, build->hash)) {
+			build->cached = 1;
+			return 1;
+		}
+		glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
 
 	if (vshader != NULL) {
 		vsources[1] = vshader;
-		vs = glCreateShader(GL_VERTEX_SHADER_ARB);
-		glShaderSourceARB(vs, 2, vsources, NULL);
-		glCompileShaderARB(vs);
-		glAttachShader(prog, vs);
+		build->vs = glCreateShader(GL_VERTEX_SHADER_ARB);
+		glShaderSourceARB(build->vs, 2, vsources, NULL);
+		glCompileShaderARB(build->vs);
+		glAttachShader(prog, build->vs);
 	}
 	if (fshader != NULL) {
 		fsources[1] = fshader;
-		fs = glCreateShader(GL_FRAGMENT_SHADER_ARB);
-		glShaderSourceARB(fs, 2, fsources, NULL);
-		glCompileShaderARB(fs);
-		glAttachShader(prog, fs);
+		build->fs = glCreateShader(GL_FRAGMENT_SHADER_ARB);
+		glShaderSourceARB(build->fs, 2, fsources, NULL);
+		glCompileShaderARB(build->fs);
+		glAttachShader(prog, build->fs);
 	}
 
-	/*	Link shader.	*/
+	/*	Link shader, the status is not queried so the driver may compile on its own threads.	*/
 	glLinkProgram(prog);
-	glValidateProgram(prog);
+
+	return 1;
+}
+
+int swpIsShaderLinked(const swpShaderBuild *build) {
+
+	GLint status = GL_TRUE;
+
+	if (g_support_parallel_compile && !build->cached)
+		glGetProgramiv(build->prog, GL_COMPLETION_STATUS_KHR, &status);
+	return status != GL_FALSE;
+}
+
+GLint swpLinkShader(swpShaderBuild *build) {
+
+	const GLuint prog = build->prog;
+	GLint vstatus, lstatus;
+
+	if (build->cached) {
+		swpVerbosePrintf("Loaded cached program binary in %.2f ms.\n",
+		                 (double) (SDL_GetPerformanceCounter() - build->start) * 1000.0 /
+		                 (double) SDL_GetPerformanceFrequency());
+		return prog;
+	}
 
 	/*	Check status of linking and validate.	*/
+	glValidateProgram(prog);
 	glGetProgramiv(prog, GL_LINK_STATUS, &lstatus);
 	glGetProgramiv(prog, GL_VALIDATE_STATUS, &vstatus);
 
@@ -565,6 +637,9 @@ GLint swpCreateShader(const char *vshader, const char *fshader) {
 		char info[4096];
 		glGetProgramInfoLog(prog, sizeof(info), NULL, &info[0]);
 		fprintf(stderr, "%s\n", info);
+		glDeleteShader(build->vs);
+		glDeleteShader(build->fs);
+		glDeleteProgram(prog);
 		return -1;
 	}
 	if (vstatus == GL_FALSE) {
@@ -578,14 +653,69 @@ GLint swpCreateShader(const char *vshader, const char *fshader) {
 	glBindFragDataLocation(prog, 0, "fragColor");
 
 	/*	Detach shaderer object and release their resources.	*/
-	glDetachShader(prog, vs);
-	glDetachShader(prog, fs);
-	glDeleteShader(vs);
-	glDeleteShader(fs);
+	glDetachShader(prog, build->vs);
+	glDetachShader(prog, build->fs);
+	glDeleteShader(build->vs);
+	glDeleteShader(build->fs);
+
+	if (g_support_progbinary)
+		swpSaveProgramBinary(prog, build->hash);
+	swpVerbosePrintf("Compiled program from source in %.2f ms.\n",
+	                 (double) (SDL_GetPerformanceCounter() - build->start) * 1000.0 /
+	                 (double) SDL_GetPerformanceFrequency());
 
 	return prog;
 }
 
+GLint swpCreateShader(const char *vshader, const char *fshader) {
+
+	swpShaderBuild build;
+
+	if (!swpCompileShader(vshader, fshader, &build))
+		return -1;
+	return swpLinkShader(&build);
+}
+
+static swpTransitionShader *swpAddTransitionShader(swpRenderingState *state) {
+
+	swpTransitionShader *trans;
+
+	/*	Allocate shader object.	*/
+	state->data.numshaders++;
+	state->data.shaders = realloc(state->data.shaders, state->data.numshaders * sizeof(swpTransitionShader));
+	assert(state->data.shaders);
+
+	/*	Display shader moved with the array.	*/
+	state->data.displayshader = &state->data.shaders[0];
+
+	trans = &state->data.shaders[state->data.numshaders - 1];
+	memset(trans, 0, sizeof(*trans));
+	return trans;
+}
+
+static void swpSetupTransitionShader(swpTransitionShader *trans) {
+
+	GLint prog;
+
+	/*	Default elapse time for transition shader.	*/
+	trans->elapse = 1.120f;
+
+	/*	Cache uniform variable memory index.	*/
+	trans->normalizedurloc = glGetUniformLocationARB(trans->prog, "normalizedur");
+	trans->texloc0 = glGetUniformLocationARB(trans->prog, "tex0");
+	trans->texloc1 = glGetUniformLocationARB(trans->prog, "tex1");
+	trans->fliploc = glGetUniformLocationARB(trans->prog, "flipv");
+
+	/*	Assign default transition shader values.	*/
+	glGetIntegerv(GL_CURRENT_PROGRAM, &prog);
+	glUseProgram(trans->prog);
+	glUniform1iARB(trans->texloc0, 0);
+	glUniform1iARB(trans->texloc1, 1);
+	glUniform1fARB(trans->normalizedurloc, 0.0f);
+	glUseProgram((GLuint) prog);
+	trans->status = SWP_SHADER_LINKED;
+}
+
 void swpLoadTransitionShaders(swpRenderingState *__restrict__ state,
                               unsigned int count, const char **__restrict__ filepaths) {
 
@@ -593,26 +723,24 @@ void swpLoadTransitionShaders(swpRenderingState *__restrict__ state,
 
 	swpVerbosePrintf("Loading %d number of transition shaders.\n", count);
 
+	/*	Let the driver compile on multiple threads.	*/
+	if (g_support_parallel_compile)
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+
 	/*	Iterate through each shader.	*/
 	for (x = 0; x < count; x++) {
 		void *fragdata = NULL;
 		const char *fsource = filepaths[x];
-
-		/*	Get new shader object index.	*/
-		const int index = state->data.numshaders;
 		swpTransitionShader *trans;
 
-		/*	Allocate shader object.	*/
-		state->data.numshaders++;
-		state->data.shaders = realloc(state->data.shaders, state->data.numshaders * sizeof(swpTransitionShader));
-		assert(state->data.shaders);
-		trans = &state->data.shaders[index];
-
-		/*	Load shader.	*/
+		/*	Issue the compile, swpUpdateTransitionShaders completes it when idle.	*/
 		swpVerbosePrintf("Loading %s.\n", fsource);
-		if (swpLoadFile(fsource, &fragdata) > 0) {
-			swpCreateTransitionShaders(trans, fragdata);
+		if (swpLoadString(fsource, &fragdata) > 0) {
+			trans = swpAddTransitionShader(state);
+			if (swpCompileShader(gc_vertex, fragdata, &trans->build))
+				trans->status = SWP_SHADER_COMPILING;
 		}
+		free(fragdata);
 	}
 }
 
@@ -626,20 +754,7 @@ int swpCreateTransitionShaders(swpTransitionShader *__restrict__ trans,
 	if (prog < 0)
 		return 0;
 	trans->prog = prog;
-
-	/*	Default elapse time for transition shader.	*/
-	trans->elapse = 1.120f;
-
-	/*	Cache uniform variable memory index.	*/
-	trans->normalizedurloc = glGetUniformLocationARB(trans->prog, "normalizedur");
-	trans->texloc0 = glGetUniformLocationARB(trans->prog, "tex0");
-	trans->texloc1 = glGetUniformLocationARB(trans->prog, "tex1");
-
-	/*	Assign default transition shader values.	*/
-	glUseProgram(trans->prog);
-	glUniform1iARB(trans->texloc0, 0);
-	glUniform1iARB(trans->texloc1, 1);
-	glUniform1fARB(trans->normalizedurloc, 0.0f);
+	swpSetupTransitionShader(trans);
 
 	/*	Success.	*/
 	return 1;
@@ -650,14 +765,7 @@ swpTransitionShader *swpCreateDefaultTransitionShader(swpRenderingState *__restr
 	swpTransitionShader *trans;
 
 	/*	Create default transition shader.	*/
-	state->data.numshaders++;
-	state->data.shaders = realloc(state->data.shaders, state->data.numshaders * sizeof(swpTransitionShader));
-
-	/*	*/
-	assert(state->data.shaders);
-
-	/*	*/
-	trans = &state->data.shaders[state->data.numshaders - 1];
+	trans = swpAddTransitionShader(state);
 
 	/*	Load shader.	*/
 	swpCreateTransitionShaders(trans, gc_fade_transition_fragment);
@@ -665,6 +773,71 @@ swpTransitionShader *swpCreateDefaultTransitionShader(swpRenderingState *__restr
 	return trans;
 }
 
+int swpUpdateTransitionShaders(swpRenderingState *state, GLuint vao) {
+
+	unsigned int i;
+	GLint prog;
+
+	for (i = 1; i < state->data.numshaders; i++) {
+		swpTransitionShader *trans = &state->data.shaders[i];
+
+		switch (trans->status) {
+			case SWP_SHADER_COMPILING:
+
+				/*	Complete the link once the driver is done, without blocking on it.	*/
+				if (!swpIsShaderLinked(&trans->build))
+					break;
+				prog = swpLinkShader(&trans->build);
+				if (prog < 0) {
+					trans->status = SWP_SHADER_NONE;
+					break;
+				}
+				trans->prog = (GLuint) prog;
+				swpSetupTransitionShader(trans);
+				return 1;
+			case SWP_SHADER_LINKED:
+
+				/*	Off-screen draw of a single pixel, so the driver finishes the program before
+				 *	the first transition. The next frame redraws the whole back buffer.	*/
+				glGetIntegerv(GL_CURRENT_PROGRAM, &prog);
+				glUseProgram(trans->prog);
+				glEnable(GL_SCISSOR_TEST);
+				glScissor(0, 0, 1, 1);
+				glBindVertexArray(vao);
+				glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+				glBindVertexArray(0);
+				glDisable(GL_SCISSOR_TEST);
+				glUseProgram((GLuint) prog);
+				glFlush();
+				trans->status = SWP_SHADER_READY;
+				swpVerbosePrintf("Warmed up transition shader %d.\n", i);
+				return 1;
+			default:
+				break;
+		}
+	}
+
+	/*	Remaining shaders are still being compiled by the driver.	*/
+	for (i = 1; i < state->data.numshaders; i++) {
+		if (state->data.shaders[i].status == SWP_SHADER_COMPILING)
+			return 1;
+	}
+	return 0;
+}
+
+swpTransitionShader *swpGetTransitionShader(swpRenderingState *state) {
+
+	unsigned int i;
+
+	/*	Last transition shader that has been linked.	*/
+	for (i = state->data.numshaders; i > 1; i--) {
+		if (state->data.shaders[i - 1].status == SWP_SHADER_LINKED ||
+		    state->data.shaders[i - 1].status == SWP_SHADER_READY)
+			return &state->data.shaders[i - 1];
+	}
+	return NULL;
+}
+
 GLuint swpGetGLTextureFormat(unsigned int ffpic) {
 
 	switch (ffpic) {
@@ -708,6 +881,7 @@ ssize_t swpReadPicFromfd(int fd, swpTextureDesc *desc) {
 	FIBITMAP *firsbitmap;               /**/
 	FIBITMAP *bitmap;                   /**/
 	void *pixel;                        /**/
+	swpHashState hash;                  /**/
 
 	/*	*/
 	unsigned int width;
@@ -725,6 +899,7 @@ ssize_t swpReadPicFromfd(int fd, swpTextureDesc *desc) {
 
 
 	/*	Read from file stream.	*/
+	swpHashInit(&hash);
 	while ((len = read(fd, inbuf, sizeof(inbuf))) > 0) {
 		if (len < 0) {
 			fprintf(stderr, "Error reading image, %s.\n", strerror(errno));
@@ -732,7 +907,46 @@ ssize_t swpReadPicFromfd(int fd, swpTextureDesc *desc) {
 			return 0;
 		}
 
+		/*	Pre-processed pack is uploaded without decoding.	*/
+		if (totallen == 0 && len >= 4 && memcmp(inbuf, SWPK_MAGIC, 4) == 0) {
+			FreeImage_CloseMemory(stream);
+			swpWaitStartupReady(SWP_STARTUP_GL);
+			desc->animation = NULL;
+			desc->source = NULL;
+			desc->tiled = NULL;
+			desc->hash = 0;
+			desc->topdown = 0;
+			return swpReadPackFromfd(fd, inbuf, (size_t) len, desc);
+		}
+
+		/*	DDS, KTX and KTX2 textures are uploaded with their pre-built levels.	*/
+		if (totallen == 0 && swpIsTextureContainer(inbuf, (size_t) len)) {
+			FreeImage_CloseMemory(stream);
+			swpWaitStartupReady(SWP_STARTUP_GL);
+			desc->animation = NULL;
+			desc->source = NULL;
+			desc->tiled = NULL;
+			desc->hash = 0;
+			return swpReadContainerFromfd(fd, inbuf, (size_t) len, desc);
+		}
+
+		/*	Changed rectangles of the displayed picture.	*/
+		if (totallen == 0 && len >= 4 && memcmp(inbuf, "SWPD", 4) == 0) {
+			FreeImage_CloseMemory(stream);
+			swpReadDirtyFromfd(fd, inbuf, (size_t) len);
+			return 0;
+		}
+
+		/*	Continuous YUV4MPEG2 stream is displayed frame by frame.	*/
+		if (totallen == 0 && len >= 10 && memcmp(inbuf, "YUV4MPEG2 ", 10) == 0) {
+			FreeImage_CloseMemory(stream);
+			swpWaitStartupReady(SWP_STARTUP_GL);
+			swpReadY4MStream(fd, inbuf, len);
+			return 0;
+		}
+
 		FreeImage_WriteMemory(inbuf, 1, len, stream);
+		swpHashUpdate(&hash, inbuf, (size_t) len);
 		totallen += len;
 	}
 
@@ -741,10 +955,52 @@ ssize_t swpReadPicFromfd(int fd, swpTextureDesc *desc) {
 	FreeImage_SeekMemory(stream, 0, SEEK_SET);
 	swpVerbosePrintf("Image file size %ld\n", totallen);
 
+	/*	Read during startup, decoding depends on the drawable size and texture limits.	*/
+	swpWaitStartupReady(SWP_STARTUP_GL | SWP_STARTUP_FREEIMAGE);
+
+
+	/*	Repeated pictures are fetched from the cache.	*/
+	desc->animation = NULL;
+	desc->source = NULL;
+	desc->tiled = NULL;
+	desc->hash = 0;
+	desc->numlevels = 0;
+	desc->compressed = 0;
+	desc->topdown = 0;
+	switch (swpCacheLookup(swpHashDigest(&hash), desc)) {
+		case 1:
+			swpVerbosePrintf("Cached texture %dx%d.\n", desc->width, desc->height);
+			FreeImage_CloseMemory(stream);
+			return totallen;
+		case 2:
+			swpVerbosePrintf("Cached picture %dx%d.\n", desc->width, desc->height);
+			FreeImage_CloseMemory(stream);
+			swpPrescaleTexture(desc);
+			swpBuildMipmaps(desc);
+			swpCompressTexture(desc);
+			return totallen;
+		default:
+			break;
+	}
+
+	/*	Picture decoded by another process.	*/
+	if (swpSharedLookup(swpHashDigest(&hash), desc)) {
+		swpVerbosePrintf("Shared picture %dx%d.\n", desc->width, desc->height);
+		FreeImage_CloseMemory(stream);
+		swpPrescaleTexture(desc);
+		swpBuildMipmaps(desc);
+		swpCompressTexture(desc);
+		return totallen;
+	}
 
 	/*	Load image from */
 	imgtype = FreeImage_GetFileTypeFromMemory(stream, totallen);
 	FreeImage_SeekMemory(stream, 0, SEEK_SET);
+
+	/*	Multi frame pictures are played back as an animation, which owns the stream.	*/
+	if (swpCreateAnimation(imgtype, stream, desc) != NULL) {
+		return totallen;
+	}
 	firsbitmap = FreeImage_LoadFromMemory(imgtype, stream, 0);
 	if (firsbitmap == NULL) {
 		fprintf(stderr, "Failed to create free-image from memory.\n");
@@ -807,15 +1063,6 @@ ssize_t swpReadPicFromfd(int fd, swpTextureDesc *desc) {
 	size = width * height * bpp;
 	swpVerbosePrintf("%d kb, %d %dx%d\n", (size / 1024), imgtype, width, height);
 
-	/*	Check size is supported by opengl driver.	*/
-	if (width > g_maxtexsize || height > g_maxtexsize) {
-		fprintf(stderr, "Texture to big(limit %d), %dx%d.\n", g_maxtexsize, width, height);
-		FreeImage_Unload(firsbitmap);
-		FreeImage_Unload(bitmap);
-		FreeImage_CloseMemory(stream);
-		return -1;
-	}
-
 	/*	Check error and release resources.	*/
 	if (pixel == NULL || size == 0) {
 		fprintf(stderr, "Failed getting pixel data from FreeImage.\n");
@@ -844,28 +1091,195 @@ ssize_t swpReadPicFromfd(int fd, swpTextureDesc *desc) {
 	FreeImage_Unload(firsbitmap);
 	FreeImage_CloseMemory(stream);
 
+	/*	Scale down to the target resolution on the worker threads.	*/
+	desc->source = NULL;
+	swpPrescaleTexture(desc);
+
+	/*	Pictures larger than supported by opengl driver are displayed as tiles.	*/
+	if (desc->width > g_maxtexsize || desc->height > g_maxtexsize) {
+		free(desc->source);
+		desc->source = NULL;
+		if (swpCreateTiledImage(desc) == NULL) {
+			fprintf(stderr, "Texture to big(limit %d), %dx%d.\n", g_maxtexsize, desc->width, desc->height);
+			free(desc->pixel);
+			return -1;
+		}
+	}
+
+	/*	Still pictures that fit a texture are cached for when they are sent again.	*/
+	if (desc->tiled == NULL) {
+		desc->hash = swpHashDigest(&hash);
+		swpSharedPublish(desc->hash, desc);
+		swpCacheInsert(desc->hash, desc);
+	}
+
+	/*	Mipmaps and block compression on the reader thread, the cache keeps the base level.	*/
+	swpBuildMipmaps(desc);
+	swpCompressTexture(desc);
+
 	return totallen;
 }
 
+GLenum swpGetStorageFormat(GLenum intfor) {
+
+	switch (intfor) {
+		case GL_RGB:
+			return GL_RGB8;
+		case GL_RGBA:
+			return GL_RGBA8;
+		case GL_RGB565:
+		case GL_RGB5:
+		case GL_RGB5_A1:
+			return intfor;
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+		case GL_COMPRESSED_RGBA_BPTC_UNORM:
+			return intfor;
+		default:
+			return 0;
+	}
+}
+
+/**
+ *	Check if the immutable storage of \tex has the
+ *	size, format and number of levels of the picture.
+ */
+static int swpIsStorageReusable(GLuint tex, GLenum intfor, unsigned int width, unsigned int height,
+                                unsigned int numlevels) {
+
+	GLint immutable = 0, maxlevel = 0, texwidth = 0, texheight = 0, texfor = 0;
+
+	if (glIsTexture(tex) == GL_FALSE)
+		return 0;
+
+	if (g_support_dsa) {
+		glGetTextureParameteriv(tex, GL_TEXTURE_IMMUTABLE_FORMAT, &immutable);
+		glGetTextureParameteriv(tex, GL_TEXTURE_MAX_LEVEL, &maxlevel);
+		glGetTextureLevelParameteriv(tex, 0, GL_TEXTURE_WIDTH, &texwidth);
+		glGetTextureLevelParameteriv(tex, 0, GL_TEXTURE_HEIGHT, &texheight);
+		glGetTextureLevelParameteriv(tex, 0, GL_TEXTURE_INTERNAL_FORMAT, &texfor);
+	} else {
+		glBindTexture(GL_TEXTURE_2D, tex);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_IMMUTABLE_FORMAT, &immutable);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxlevel);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &texwidth);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &texheight);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &texfor);
+	}
+
+	return immutable == GL_TRUE && (unsigned int) texwidth == width && (unsigned int) texheight == height &&
+	       (GLenum) texfor == intfor && (unsigned int) maxlevel + 1 == numlevels;
+}
+
+/**
+ *	@Return non-zero if the texture has immutable storage, which can not be respecified.
+ */
+static int swpIsTextureImmutable(GLuint tex) {
+
+	GLint immutable = 0;
+
+	if (!g_support_texture_storage || glIsTexture(tex) == GL_FALSE)
+		return 0;
+
+	if (g_support_dsa) {
+		glGetTextureParameteriv(tex, GL_TEXTURE_IMMUTABLE_FORMAT, &immutable);
+	} else {
+		glBindTexture(GL_TEXTURE_2D, tex);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_IMMUTABLE_FORMAT, &immutable);
+	}
+	return immutable == GL_TRUE;
+}
+
+GLuint swpCreateTextureStorage(GLenum intfor, unsigned int width, unsigned int height, unsigned int numlevels) {
+
+	GLuint tex = 0;
+
+	if (g_support_dsa) {
+		glCreateTextures(GL_TEXTURE_2D, 1, &tex);
+		glTextureStorage2D(tex, (GLsizei) numlevels, intfor, (GLsizei) width, (GLsizei) height);
+		glTextureParameteri(tex, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, numlevels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTextureParameteri(tex, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(tex, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(tex, GL_TEXTURE_MAX_LEVEL, (GLint) numlevels - 1);
+	} else {
+		glGenTextures(1, &tex);
+		glBindTexture(GL_TEXTURE_2D, tex);
+		glTexStorage2D(GL_TEXTURE_2D, (GLsizei) numlevels, intfor, (GLsizei) width, (GLsizei) height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, numlevels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint) numlevels - 1);
+	}
+	swpVerbosePrintf("Allocated %dx%d texture storage with %d levels.\n", width, height, numlevels);
+
+	return tex;
+}
+
+/**
+ *	Replace the content of level \level of the immutable texture \tex.
+ */
+static void swpTextureSubImage(GLuint tex, const swpTextureDesc *desc, unsigned int level, unsigned int width,
+                               unsigned int height, size_t size, const void *pixel) {
+
+	if (g_support_dsa) {
+		if (desc->compressed)
+			glCompressedTextureSubImage2D(tex, (GLint) level, 0, 0, (GLsizei) width, (GLsizei) height,
+			                              desc->intfor, (GLsizei) size, pixel);
+		else
+			glTextureSubImage2D(tex, (GLint) level, 0, 0, (GLsizei) width, (GLsizei) height, desc->format,
+			                    desc->imgdatatype, pixel);
+	} else {
+		if (desc->compressed)
+			glCompressedTexSubImage2DARB(GL_TEXTURE_2D, (GLint) level, 0, 0, (GLsizei) width, (GLsizei) height,
+			                             desc->intfor, (GLsizei) size, pixel);
+		else
+			glTexSubImage2D(GL_TEXTURE_2D, (GLint) level, 0, 0, (GLsizei) width, (GLsizei) height, desc->format,
+			                desc->imgdatatype, pixel);
+	}
+}
+
 int swpLoadTextureFromMem(GLuint *tex, GLuint pbo, const swpTextureDesc *desc) {
 
-	GLuint intfor = desc->intfor;           /*	*/
-	GLuint format = desc->format;           /*	*/
-	GLuint imgdatatype = desc->imgdatatype; /*	*/
+	const swpTextureDesc *source = desc;    /*	Picture of the caller.	*/
+	swpTextureDesc fitted;                  /*	Picture with cheaper storage if over the VRAM budget.	*/
+	GLuint intfor;                          /*	*/
+	GLuint format;                          /*	*/
+	GLuint imgdatatype;                     /*	*/
 	GLboolean status;                       /*	*/
 	GLenum err = 0;                         /*	*/
 	GLubyte *pbuf = NULL;                   /*	*/
+	size_t pboffset = 0;                    /*	Offset of the pixel data in the PBO.	*/
+	int ringed = 0;                         /*	Pixel data is in the upload ring.	*/
+	GLenum storagefor = 0;                  /*	Sized format, 0 if the storage is mutable.	*/
+	unsigned int numlevels;                 /*	*/
+	unsigned int i;                         /*	*/
 
 	/*	*/
-	const void *pixel = desc->pixel;
-	const unsigned int width = desc->width;
-	const unsigned int height = desc->height;
-	const unsigned int size = desc->size;
+	const void *pixel;
+	unsigned int width;
+	unsigned int height;
+	unsigned int size;
 
 	swpVerbosePrintf("Loading texture from pixel data.\n");
 
-	/*	Get compression.	*/
-	if (g_compression) {
+	/*	Fall back to cheaper storage instead of exceeding the VRAM budget.	*/
+	if (swpFitVRAMBudget(desc, &fitted, swpGetTrackedVRAM(SWP_VRAM_TEXTURE, *tex)))
+		desc = &fitted;
+	intfor = desc->intfor;
+	format = desc->format;
+	imgdatatype = desc->imgdatatype;
+	pixel = desc->pixel;
+	width = desc->width;
+	height = desc->height;
+	size = desc->size;
+
+	/*	Let the driver compress if the picture was not encoded by swpCompressTexture,
+	 *	except animations, which are updated one changed rectangle at the time.	*/
+	if (g_compression != SWP_COMPRESSION_NONE && !g_support_s3tc && desc->animation == NULL) {
 		switch (intfor) {
 			case GL_RGB:
 				intfor = GL_COMPRESSED_RGB;
@@ -879,7 +1293,11 @@ int swpLoadTextureFromMem(GLuint *tex, GLuint pbo, const swpTextureDesc *desc) {
 	}
 
 
-	if (g_support_pbo) {
+	/*	Persistently mapped ring, fenced instead of reallocated for each picture.	*/
+	if (g_support_pbo && swpWriteUploadRing(pixel, size, &pbo, &pboffset)) {
+		ringed = 1;
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, pbo);
+	} else if (g_support_pbo) {
 
 		/*  Pop any existing error. */
 		glGetError();
@@ -894,14 +1312,19 @@ int swpLoadTextureFromMem(GLuint *tex, GLuint pbo, const swpTextureDesc *desc) {
 		err = glGetError();
 		if (err != GL_NO_ERROR) {
 			fprintf(stderr, "Error on glBufferData %d.\n", err);
+			if (desc->pixel != source->pixel)
+				swpReleasePixel(desc->pixel);
 			return 0;
 		}
+		swpTrackVRAM(SWP_VRAM_BUFFER, pbo, size);
 		pbuf = (GLubyte *) glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB,
 		                                  GL_WRITE_ONLY_ARB);
 
 		if (pbuf == NULL) {
 			err = glGetError();
 			fprintf(stderr, "Bad pointer %i\n", err);
+			if (desc->pixel != source->pixel)
+				swpReleasePixel(desc->pixel);
 			return 0;
 		}
 		swpVerbosePrintf("Copying %d bytes to PBO (%d MB).\n", size, size / (1024 * 1024));
@@ -913,40 +1336,116 @@ int swpLoadTextureFromMem(GLuint *tex, GLuint pbo, const swpTextureDesc *desc) {
 #endif
 	}
 
-	/*	Create texture.	*/
-	if (glIsTexture(*tex) == GL_FALSE) {
-		glGenTextures(1, tex);
-		glBindTexture(GL_TEXTURE_2D, *tex);
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	/*	Pre-built levels, or the levels of the mipmap policy generated from the first level.
+	 *	Animation frames only update the first level, mipmaps would keep the first frame.	*/
+	numlevels = desc->numlevels;
+	if (numlevels == 0)
+		numlevels = desc->animation != NULL ? 1 : swpGetMipLevelCount(width, height);
+	if (g_support_texture_storage)
+		storagefor = swpGetStorageFormat(intfor);
+
+	if (storagefor != 0) {
+		const GLubyte *base = g_support_pbo ? (const GLubyte *) (uintptr_t) pboffset : (const GLubyte *) pixel;
+
+		/*	Storage is only reallocated when the size or format changes.	*/
+		if (!swpIsStorageReusable(*tex, storagefor, width, height, numlevels)) {
+			if (glIsTexture(*tex) == GL_TRUE) {
+				swpTrackVRAM(SWP_VRAM_TEXTURE, *tex, 0);
+				glDeleteTextures(1, tex);
+			}
+			*tex = swpCreateTextureStorage(storagefor, width, height, numlevels);
+		}
+		if (!g_support_dsa)
+			glBindTexture(GL_TEXTURE_2D, *tex);
+
+		/*	Transfer the levels, offsets are relative to the PBO or pixel data.	*/
+		if (desc->numlevels > 0) {
+			glPixelStorei(GL_UNPACK_ALIGNMENT, desc->alignment > 0 ? desc->alignment : 4);
+			for (i = 0; i < desc->numlevels; i++) {
+				const swpTextureLevel *level = &desc->levels[i];
+				swpTextureSubImage(*tex, desc, i, level->width, level->height, level->size, base + level->offset);
+			}
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		} else {
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			swpTextureSubImage(*tex, desc, 0, width, height, size, base);
+			if (numlevels > 1 && g_support_dsa)
+				glGenerateTextureMipmap(*tex);
+			else if (numlevels > 1)
+				glGenerateMipmap(GL_TEXTURE_2D);
+		}
+	} else {
+		/*	Immutable storage of a previous picture, such as an animation, can not be respecified.	*/
+		if (swpIsTextureImmutable(*tex)) {
+			swpTrackVRAM(SWP_VRAM_TEXTURE, *tex, 0);
+			glDeleteTextures(1, tex);
+			*tex = 0;
+		}
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP);
+		/*	Create texture.	*/
+		if (glIsTexture(*tex) == GL_FALSE) {
+			glGenTextures(1, tex);
+			glBindTexture(GL_TEXTURE_2D, *tex);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glPixelStorei(GL_PACK_ALIGNMENT, 4);
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 3);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP);
 
-	}
-	glBindTexture(GL_TEXTURE_2D, *tex);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 3);
 
-	/*	Transfer pixel data.	*/
-	if (g_support_pbo)
-		glTexImage2D(GL_TEXTURE_2D, 0, intfor, width, height, 0, format, imgdatatype, (const void *) NULL);
-	else
-		glTexImage2D(GL_TEXTURE_2D, 0, intfor, width, height, 0, format, imgdatatype, (const void *) pixel);
+		}
+		glBindTexture(GL_TEXTURE_2D, *tex);
 
-	/*	*/
-	glGenerateMipmap(GL_TEXTURE_2D);
+		/*	Transfer pre-built levels, offsets are relative to the PBO or pixel data.	*/
+		if (desc->numlevels > 0) {
+			const GLubyte *base = g_support_pbo ? (const GLubyte *) (uintptr_t) pboffset : (const GLubyte *) pixel;
+
+			glPixelStorei(GL_UNPACK_ALIGNMENT, desc->alignment > 0 ? desc->alignment : 4);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, desc->numlevels - 1);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, desc->numlevels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+			for (i = 0; i < desc->numlevels; i++) {
+				const swpTextureLevel *level = &desc->levels[i];
+				if (desc->compressed)
+					glCompressedTexImage2DARB(GL_TEXTURE_2D, i, desc->intfor, level->width, level->height, 0,
+					                          level->size, base + level->offset);
+				else
+					glTexImage2D(GL_TEXTURE_2D, i, intfor, level->width, level->height, 0, format, imgdatatype,
+					             base + level->offset);
+			}
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		} else {
+
+			/*	Transfer pixel data.	*/
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numlevels - 1);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, numlevels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+			if (g_support_pbo)
+				glTexImage2D(GL_TEXTURE_2D, 0, intfor, width, height, 0, format, imgdatatype,
+				             (const void *) (uintptr_t) pboffset);
+			else
+				glTexImage2D(GL_TEXTURE_2D, 0, intfor, width, height, 0, format, imgdatatype, (const void *) pixel);
+
+			/*	*/
+			if (numlevels > 1)
+				glGenerateMipmap(GL_TEXTURE_2D);
+		}
+	}
 
 	/*	*/
 	glBindTexture(GL_TEXTURE_2D, 0);
+	swpTrackVRAM(SWP_VRAM_TEXTURE, *tex, swpGetVRAMSize(storagefor != 0 ? storagefor : intfor, width, height, numlevels));
+	if (ringed)
+		swpFenceUploadRing();
 	if (g_support_pbo)
 		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
 
-	/*	Release pixel data.	*/
-	free(desc->pixel);
+	/*	Release pixel data, and the fallback levels of the VRAM budget.	*/
+	if (desc->pixel != source->pixel)
+		swpReleasePixel(desc->pixel);
+	swpReleasePixel(source->pixel);
 
 	return glIsTexture(*tex) == SDL_TRUE;
 }
@@ -1046,7 +1545,7 @@ void *swpCatchPipedTexture(void *phandle) {
 					event.user.code = SWP_EVENT_UPDATE_IMAGE;
 					event.type = SDL_USEREVENT;
 					event.user.data1 = &desc[curdesc];
-					SDL_PushEvent(&event);
+					swpSubmitUpload(&desc[curdesc], &event);
 				}
 				curdesc = (curdesc + 1) % numdesc;
 
@@ -1063,6 +1562,33 @@ void *swpCatchPipedTexture(void *phandle) {
 	return NULL;
 }
 
+void *swpCatchStartupTexture(void *phandle) {
+
+	const int *fds = (const int *) phandle;
+	static swpTextureDesc desc[4] = {{0}};
+	SDL_Event event = {0};
+	int i;
+
+	/*	Registering the plugins is off the critical path of the window and context creation.	*/
+	FreeImage_Initialise(0);
+	swpVerbosePrintf("FreeImage version %s.\n", FreeImage_GetVersion());
+	swpSetStartupReady(SWP_STARTUP_FREEIMAGE);
+	swpStartupMark("freeimage initialized");
+
+	/*	Load each picture in the same order as passed at startup.	*/
+	for (i = 0; fds[i] >= 0 && i < 4; i++) {
+		if (swpReadPicFromfd(fds[i], &desc[i]) > 0) {
+			swpStartupMark("startup picture decoded");
+			event.user.code = SWP_EVENT_UPDATE_IMAGE;
+			event.type = SDL_USEREVENT;
+			event.user.data1 = &desc[i];
+			swpSubmitUpload(&desc[i], &event);
+		}
+	}
+
+	return NULL;
+}
+
 void swpCatchSignal(int sig) {
 
 	SDL_Event event = {0};
@@ -1076,6 +1602,12 @@ void swpCatchSignal(int sig) {
 		case SIGPIPE:
 			fprintf(stderr, "Sigpipe.\n");
 			break;
+		case SIGUSR1:
+			/*	Printed by the main thread.	*/
+			event.type = SDL_USEREVENT;
+			event.user.code = SWP_EVENT_PRINT_STATS;
+			SDL_PushEvent(&event);
+			break;
 		case SIGTERM:
 		case SIGINT:
 			/*	Send event to main thread SDL event handler to quit.	*/
@@ -1091,43 +1623,50 @@ void swpCatchSignal(int sig) {
 void swpRender(GLuint vao, SDL_Window *__restrict__ window,
                swpRenderingState *__restrict__ state) {
 
-	/*	*/
-	if (state->inTransition != 0) {
+	/*	Top-down block compressed pictures are flipped by the vertex shader.	*/
+	const unsigned int slot = (state->data.curtex - 1 + state->data.numtexs) % state->data.numtexs;
+	const float flipv = state->data.topdown[slot] ? 1.0f : 0.0f;
+
+	/*	Stream frames are converted from planar YUV.	*/
+	if (state->data.planes[0] != 0) {
+		glUseProgram(state->data.yuvprog);
+	} else if (state->inTransition != 0 && swpGetTransitionShader(state) != NULL) {
 
 		/*	*/
 		const swpTransitionShader *trashader;
-		int glprindex = state->data.numshaders - 1;
 		float normalelapse;
 
 		swpVerbosePrintf("Render Transition view.\n");
 
 		/*	*/
-		assert(state->data.numshaders > 1);
-
-		/*	*/
-		trashader = &state->data.shaders[glprindex];
+		trashader = swpGetTransitionShader(state);
 
 		/*	*/
 		glUseProgram(trashader->prog);
+		glUniform1fARB(trashader->fliploc, flipv);
 
 		/*	Update normalize elapse time.	*/
-		normalelapse = (state->elapseTransition / state->data.shaders[glprindex].elapse);
+		normalelapse = (state->elapseTransition / trashader->elapse);
 		glUniform1fvARB(trashader->normalizedurloc, 1, &normalelapse);
 
 		/*	Check if transition has ended.	*/
-		if (state->elapseTransition > state->data.shaders[glprindex].elapse) {
+		if (state->elapseTransition > trashader->elapse) {
 			/*	Disable transition.	*/
 			state->inTransition = 0;
 			glUseProgram(state->data.shaders[0].prog);
+			glUniform1fARB(state->data.shaders[0].fliploc, flipv);
 		}
+	} else if (state->tiled != NULL) {
 
-		/*	Update.	*/
-		SDL_Event event = {0};
-		event.type = SDL_USEREVENT;
-		event.user.code = SWP_EVENT_UPDATE_TRANSITION;
-		SDL_PushEvent(&event);
-	} else
+		/*	Picture larger than the max texture size.	*/
+		swpRenderTiles(vao, state);
+		SDL_GL_SwapWindow(window);
+		return;
+	} else {
 		swpVerbosePrintf("Render Non-Transition View.\n");
+		glUseProgram(state->data.displayshader->prog);
+		glUniform1fARB(state->data.displayshader->fliploc, flipv);
+	}
 
 	/*	Draw quad.	*/
 	glBindVertexArray(vao);
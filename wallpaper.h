@@ -23,18 +23,25 @@
 #include <stdio.h>
 #include <SDL2/SDL_stdinc.h>
 #include <SDL2/SDL_video.h>
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_atomic.h>
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_events.h>
+#include <SDL2/SDL_timer.h>
 
 
 /*	Read only.	*/
 extern const char* gc_vertex;			/*	Default vertex glsl shader.	*/
 extern const char* gc_fragment;			/*	Default fragment glsl shader.	*/
 extern const char* gc_fade_transition_fragment;
+extern const char* gc_yuv_fragment;		/*	Planar YUV to RGB fragment shader.	*/
+extern const char* gc_tile_vertex;		/*	Tile quad vertex shader.	*/
 extern const float gc_quad[4][3];		/*	Display quad vertices.	*/
 
 
 /*	Global.	*/
 extern int g_alive;                     /*	Determine if application should continue be alive or not.*/
-extern unsigned int g_compression;      /*	Use compression.	*/
+extern unsigned int g_compression;      /*	Compression mode, SWP_COMPRESSION_*.	*/
 extern unsigned int g_wallpaper;        /*	Wallpaper mode.	*/
 extern unsigned int g_fullscreen;       /*	Fullscreen mode.	*/
 extern unsigned int g_borderless;       /*	Borderless mode.	*/
@@ -46,7 +53,39 @@ extern int g_winres[2];                 /*	Window resolution.	*/
 extern int g_winpos[2];                 /*	Window position.	*/
 extern int g_maxtexsize;                /*	OpenGL max texture size, (Check texture proxy later)*/
 extern int g_support_pbo;               /*	Pixel buffer object for fast image transfer.	*/
+extern int g_support_s3tc;              /*	S3TC block compressed textures.	*/
+extern int g_support_bptc;              /*	BPTC (BC7) block compressed textures.	*/
+extern int g_support_progbinary;        /*	Retrieve and load linked program binaries.	*/
+extern int g_support_parallel_compile;  /*	Non-blocking shader compile status.	*/
+extern int g_support_buffer_storage;    /*	Immutable, persistently mappable buffers.	*/
+extern int g_support_texture_storage;   /*	Immutable texture storage.	*/
+extern int g_support_dsa;               /*	Direct state access.	*/
+extern int g_support_timer_query;       /*	GPU timestamps.	*/
+extern int g_support_sync;              /*	Fence sync objects.	*/
+extern int g_glversion;                 /*	Context version, major * 10 + minor.	*/
 extern unsigned int g_core_profile;     /*  */
+extern size_t g_framebudget;            /*	Memory budget in bytes for pre-decoded animation frames.	*/
+extern unsigned int g_numworkers;       /*	Number of threads in the task pool, 0 for the CPU count.	*/
+extern unsigned int g_prescale;         /*	Prescale filter, SWP_FILTER_NONE if disabled.	*/
+extern int g_prescalecap[2];            /*	Maximum prescaled resolution, overrides the drawable size.	*/
+extern int g_drawable[2];               /*	Drawable size of the window.	*/
+extern unsigned int g_mipmap;           /*	Mipmap policy, SWP_MIPMAP_*.	*/
+extern size_t g_vrambudget;             /*	GPU memory budget in bytes, 0 if unlimited.	*/
+extern unsigned int g_idlereclaim;      /*	Seconds without ingest before idle resources are released, 0 if never.	*/
+extern unsigned int g_idletrim;         /*	Trim the heap when idle.	*/
+extern unsigned int g_fpscap;           /*	Frames per second of transitions, 0 if paced by vsync.	*/
+extern unsigned int g_slicebudget;      /*	Milliseconds of sliced uploads each frame, 0 if disabled.	*/
+extern size_t g_tilebudget;             /*	Memory budget in bytes for tile textures.	*/
+extern size_t g_cachehost;              /*	Memory budget in bytes for cached decoded pictures.	*/
+extern size_t g_cachegpu;               /*	Memory budget in bytes for cached textures.	*/
+extern size_t g_sharedcache;            /*	Memory budget in bytes for the cross-process picture cache, 0 if disabled.	*/
+extern unsigned int g_startupreport;    /*	Print the startup timeline.	*/
+extern char* g_playlistpath;            /*	Path of the playlist file, NULL if disabled.	*/
+extern unsigned int g_playlistinterval; /*	Seconds each playlist picture is displayed.	*/
+extern unsigned int g_playlistshuffle;  /*	Play the playlist in random order.	*/
+extern unsigned int g_playlistprefetch; /*	Number of playlist pictures decoded ahead.	*/
+extern unsigned int g_uploadthread;     /*	Upload pictures on a thread with a shared context.	*/
+extern unsigned int g_uploadpath;       /*	Upload path, SWP_UPLOAD_PATH_*.	*/
 
 
 /*	OpenGL ARB function pointers.	*/
@@ -62,6 +101,11 @@ extern PFNGLMAPBUFFERPROC glMapBufferARB;
 extern PFNGLUNMAPBUFFERPROC glUnmapBufferARB;
 extern PFNGLBINDBUFFERARBPROC glBindBufferARB;
 extern PFNGLBUFFERDATAARBPROC glBufferDataARB;
+extern PFNGLBUFFERSTORAGEPROC glBufferStorage;
+extern PFNGLMAPBUFFERRANGEPROC glMapBufferRange;
+extern PFNGLFENCESYNCPROC glFenceSync;
+extern PFNGLCLIENTWAITSYNCPROC glClientWaitSync;
+extern PFNGLDELETESYNCPROC glDeleteSync;
 extern PFNGLDEBUGMESSAGECALLBACKARBPROC glDebugMessageCallbackARB;
 extern PFNGLDEBUGMESSAGECALLBACKAMDPROC glDebugMessageCallbackAMD;
 
@@ -82,14 +126,33 @@ extern PFNGLDETACHSHADERPROC glDetachShader;
 extern PFNGLDELETESHADERPROC glDeleteShader;
 extern PFNGLBINDFRAGDATALOCATIONPROC glBindFragDataLocation;
 extern PFNGLGETPROGRAMINFOLOGPROC glGetProgramInfoLog;
+extern PFNGLGETPROGRAMBINARYPROC glGetProgramBinary;
+extern PFNGLPROGRAMBINARYPROC glProgramBinary;
+extern PFNGLPROGRAMPARAMETERIPROC glProgramParameteri;
+extern PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glMaxShaderCompilerThreadsKHR;
+extern PFNGLDELETEPROGRAMPROC glDeleteProgram;
 
 extern PFNGLGENERATEMIPMAPPROC glGenerateMipmap;
+extern PFNGLCOMPRESSEDTEXIMAGE2DARBPROC glCompressedTexImage2DARB;
+extern PFNGLCOMPRESSEDTEXSUBIMAGE2DARBPROC glCompressedTexSubImage2DARB;
+extern PFNGLTEXSTORAGE2DPROC glTexStorage2D;
+extern PFNGLCREATETEXTURESPROC glCreateTextures;
+extern PFNGLTEXTURESTORAGE2DPROC glTextureStorage2D;
+extern PFNGLTEXTURESUBIMAGE2DPROC glTextureSubImage2D;
+extern PFNGLCOMPRESSEDTEXTURESUBIMAGE2DPROC glCompressedTextureSubImage2D;
+extern PFNGLTEXTUREPARAMETERIPROC glTextureParameteri;
+extern PFNGLGENERATETEXTUREMIPMAPPROC glGenerateTextureMipmap;
+extern PFNGLGETTEXTUREPARAMETERIVPROC glGetTextureParameteriv;
+extern PFNGLGETTEXTURELEVELPARAMETERIVPROC glGetTextureLevelParameteriv;
 
 extern PFNGLUSEPROGRAMPROC glUseProgram;
 extern PFNGLGETUNIFORMLOCATIONARBPROC glGetUniformLocationARB;
 extern PFNGLUNIFORM1IARBPROC glUniform1iARB;
 extern PFNGLUNIFORM1FARBPROC glUniform1fARB;
 extern PFNGLUNIFORM1FVARBPROC glUniform1fvARB;
+extern PFNGLUNIFORM3FVARBPROC glUniform3fvARB;
+extern PFNGLUNIFORM4FVARBPROC glUniform4fvARB;
+extern PFNGLUNIFORMMATRIX3FVARBPROC glUniformMatrix3fvARB;
 extern PFNGLPROGRAMUNIFORM1IPROC glProgramUniform1i;
 extern PFNGLPROGRAMUNIFORM1FPROC glProgramUniform1f;
 
@@ -99,7 +162,94 @@ extern PFNGLPROGRAMUNIFORM1FPROC glProgramUniform1f;
  * User event code.
  */
 #define SWP_EVENT_UPDATE_IMAGE      0
-#define SWP_EVENT_UPDATE_TRANSITION 1
+#define SWP_EVENT_UPDATE_STREAM     1	/*	Stream started (data1) or ended (data2).	*/
+#define SWP_EVENT_STREAM_FRAME      2	/*	New frame available in the stream queue.	*/
+#define SWP_EVENT_ANIMATION_FRAME   3	/*	Next animation frame is due.	*/
+#define SWP_EVENT_PLAYLIST_DECODED  4	/*	Playlist entry (data1) has been decoded.	*/
+#define SWP_EVENT_PLAYLIST_NEXT     5	/*	Next playlist picture is due.	*/
+#define SWP_EVENT_DIRTY_UPDATE      6	/*	Changed rectangles (data1) of the displayed picture.	*/
+#define SWP_EVENT_PRINT_STATS       7	/*	Print the resource usage, on SIGUSR1.	*/
+#define SWP_EVENT_RESCALED          8	/*	Rescale (data1) of the displayed picture has been uploaded.	*/
+
+/**
+ *	Kinds of tracked GPU memory.
+ */
+#define SWP_VRAM_TEXTURE 0
+#define SWP_VRAM_BUFFER  1
+
+/**
+ *	Startup phases that pictures
+ *	can not be loaded before.
+ */
+#define SWP_STARTUP_GL        0x1   /*	Context created, OpenGL limits and extensions known.	*/
+#define SWP_STARTUP_FREEIMAGE 0x2   /*	FreeImage plugins initialized.	*/
+
+/**
+ *	Wake up interval in milliseconds while
+ *	there is work left for idle time.
+ */
+#define SWP_IDLE_INTERVAL 16
+
+/**
+ *	Number of frame slots in the stream queue.
+ */
+#define SWP_NUM_STREAM_FRAMES 3
+
+/**
+ *	Prescale filters.
+ */
+#define SWP_FILTER_NONE     0
+#define SWP_FILTER_LANCZOS3 1
+#define SWP_FILTER_MITCHELL 2
+
+/**
+ *	Texture compression modes.
+ */
+#define SWP_COMPRESSION_NONE 0
+#define SWP_COMPRESSION_AUTO 1  /*	BC1 if opaque, otherwise BC7 if supported, else BC3.	*/
+#define SWP_COMPRESSION_BC3  2  /*	BC1 if opaque, otherwise BC3.	*/
+
+/**
+ *	Upload paths of the pixel data.
+ */
+#define SWP_UPLOAD_PATH_AUTO       0    /*	Fastest path measured for the driver.	*/
+#define SWP_UPLOAD_PATH_DIRECT     1    /*	From the pixel data, without pixel buffers.	*/
+#define SWP_UPLOAD_PATH_PBO        2    /*	Pixel buffer orphaned and copied for each picture.	*/
+#define SWP_UPLOAD_PATH_PERSISTENT 3    /*	Persistently mapped upload ring.	*/
+
+/**
+ *	Mipmap policies.
+ */
+#define SWP_MIPMAP_NONE 0       /*	Base level only.	*/
+#define SWP_MIPMAP_AUTO 1       /*	Levels down to the drawable size.	*/
+#define SWP_MIPMAP_FULL 2       /*	Full chain down to 1x1.	*/
+
+/**
+ *	Task function invoked by the task pool
+ *	for each index.
+ */
+typedef void (*swpTaskFunc)(void* userdata, unsigned int index);
+
+/**
+ *	Shader program being compiled and linked
+ *	by the driver.
+ */
+typedef struct swp_shader_build_t{
+	GLuint prog;                /*	*/
+	GLuint vs;                  /*	Vertex shader, 0 if loaded from the program binary.	*/
+	GLuint fs;                  /*	Fragment shader, 0 if loaded from the program binary.	*/
+	Uint64 hash;                /*	Source hash of the program binary.	*/
+	Uint64 start;               /*	Performance counter when the compile was issued.	*/
+	unsigned int cached;        /*	Loaded from the program binary cache.	*/
+}swpShaderBuild;
+
+/**
+ *	Transition shader compile status.
+ */
+#define SWP_SHADER_NONE      0  /*	Failed or not created.	*/
+#define SWP_SHADER_COMPILING 1  /*	Compiled and linked by the driver.	*/
+#define SWP_SHADER_LINKED    2  /*	Usable, not yet drawn with.	*/
+#define SWP_SHADER_READY     3  /*	Warmed up with an off-screen draw.	*/
 
 /**
  *	Transition shader and associated
@@ -111,6 +261,9 @@ typedef struct swp_transition_shader_t{
 	GLint normalizedurloc;      /*						*/
 	GLint texloc0;              /*	Texture location.	*/
 	GLint texloc1;              /*	Texture location.	*/
+	GLint fliploc;              /*	Vertical texture coordinate flip location.	*/
+	unsigned int status;        /*	Compile status, SWP_SHADER_NONE if it failed.	*/
+	swpShaderBuild build;       /*	Program being compiled.	*/
 }swpTransitionShader;
 
 /**
@@ -130,22 +283,186 @@ typedef struct swp_rendering_s_t{
 	GLuint texs[SWP_NUM_TEXTURES];  /*	texture*/
 	GLint curtex;                   /*	Current texture displayed.	*/
 	GLuint pbo[SWP_NUM_TEXTURES];   /*	Pixel buffer object.*/
+	Uint64 texhash[SWP_NUM_TEXTURES];   /*	Content hash of textures shared with the cache, otherwise 0.	*/
+	unsigned int topdown[SWP_NUM_TEXTURES]; /*	Texture rows are top-down, drawn flipped.	*/
 
 	GLint texloc;                   /*	*/
 	GLint loc;                      /*	*/
+
+	GLint yuvprog;                  /*	Planar YUV display shader program.	*/
+	GLint yuvmatloc;                /*	YUV to RGB matrix uniform location.	*/
+	GLint yuvoffloc;                /*	YUV offset uniform location.	*/
+	GLuint planes[3];               /*	Y, U and V plane textures of the stream.	*/
+	GLint tileprog;                 /*	Tile display shader program.	*/
+	GLint tilerectloc;              /*	Tile scale and offset uniform location.	*/
+	GLint tileinsetloc;             /*	Tile texture coordinate inset uniform location.	*/
 }swpRenderingData;
 
 /**
- *	Rendering state of the program.
+ *	Per frame information stored alongside
+ *	each slot of the frame queue.
  */
-typedef struct swp_rendering_state_t{
-	unsigned int inTransition;      /*	*/
-	unsigned int fromTexIndex;      /*	*/
-	unsigned int toTexIndex;        /*	*/
-	float elapseTransition;         /*	*/
-	swpRenderingData data;          /*	*/
-	unsigned int timeout;           /*	*/
-}swpRenderingState;
+typedef struct swp_frame_info_t{
+	double pts;                     /*	Presentation time in seconds.	*/
+	float delay;                    /*	Display duration in seconds.	*/
+	unsigned int x;                 /*	Changed sub-rectangle relative to the previous frame.	*/
+	unsigned int y;                 /*	*/
+	unsigned int width;             /*	*/
+	unsigned int height;            /*	*/
+}swpFrameInfo;
+
+/**
+ *	Fixed size frame queue for passing frames
+ *	from a producer thread to the main thread
+ *	without any memory allocation per frame.
+ */
+typedef struct swp_frame_queue_t{
+	unsigned int numslots;          /*	Number of frame slots.	*/
+	unsigned int slotsize;          /*	Size in bytes of each slot.	*/
+	unsigned int head;              /*	Next slot to be read.	*/
+	unsigned int count;             /*	Number of committed frames.	*/
+	unsigned int closed;            /*	No more frames will be produced.	*/
+	unsigned char* data;            /*	Slot memory, numslots * slotsize bytes.	*/
+	swpFrameInfo* info;             /*	Per slot frame information.	*/
+	SDL_mutex* lock;                /*	*/
+	SDL_cond* cond;                 /*	*/
+}swpFrameQueue;
+
+/**
+ *	Continuous YUV4MPEG2 stream. The header
+ *	is parsed once and all the frames have the
+ *	same fixed size planar layout.
+ */
+typedef struct swp_yuv_stream_t{
+	unsigned int width;             /*	Luma plane width.	*/
+	unsigned int height;            /*	Luma plane height.	*/
+	unsigned int chromawidth;       /*	Chroma plane width, zero if monochrome.	*/
+	unsigned int chromaheight;      /*	Chroma plane height, zero if monochrome.	*/
+	unsigned int fpsnum;            /*	Frame rate numerator.	*/
+	unsigned int fpsden;            /*	Frame rate denominator.	*/
+	unsigned int fullrange;         /*	Full range (JPEG) or limited range samples.	*/
+	unsigned int framesize;         /*	Size in bytes of all planes of a frame.	*/
+	unsigned int numframes;         /*	Number of frames read.	*/
+	unsigned int numdropped;        /*	Number of frames dropped by the main thread.	*/
+	SDL_atomic_t pending;           /*	Non-zero if a frame event is in the event queue.	*/
+	swpFrameQueue queue;            /*	Frames waiting to be displayed.	*/
+}swpYUVStream;
+
+struct FIMEMORY;
+struct FIMULTIBITMAP;
+
+/**
+ *	Animated picture. Frames are decoded and composited
+ *	ahead of display on a worker thread. Each frame only
+ *	holds the sub-rectangle that changed since the previous
+ *	frame, which is all that is uploaded.
+ */
+typedef struct swp_animation_t{
+	unsigned int width;             /*	Canvas width.	*/
+	unsigned int height;            /*	Canvas height.	*/
+	unsigned int numframes;         /*	Number of frames in the animation.	*/
+	unsigned int framesize;         /*	Size in bytes of a canvas.	*/
+	unsigned int resident;          /*	All frames fit in the frame budget and are decoded once.	*/
+	unsigned int current;           /*	Index of the displayed frame, resident mode.	*/
+	swpFrameInfo loopinfo;          /*	Change from the last frame back to the first frame.	*/
+	SDL_atomic_t decoded;           /*	Number of decoded frames, resident mode.	*/
+	SDL_atomic_t alive;             /*	Worker runs while non-zero.	*/
+	GLuint tex;                     /*	Texture displaying the animation.	*/
+	int timer;                      /*	Timer of the next frame.	*/
+	unsigned char* frames;          /*	Decoded frames, resident mode.	*/
+	swpFrameInfo* info;             /*	Decoded frame information, resident mode.	*/
+	swpFrameQueue queue;            /*	Decoded frames, streaming mode.	*/
+
+	/*	Worker compositing state.	*/
+	unsigned char* canvas;          /*	Composited canvas.	*/
+	unsigned char* restore;         /*	Canvas backup for 'restore to previous' disposal.	*/
+	unsigned int prevrect[4];       /*	Rectangle of the previous frame.	*/
+	unsigned int prevdisposal;      /*	Disposal method of the previous frame.	*/
+	unsigned int nextpage;          /*	Next page to decode.	*/
+	struct FIMULTIBITMAP* multibitmap;  /*	*/
+	struct FIMEMORY* memory;        /*	Encoded data, owned by the animation.	*/
+	SDL_Thread* thread;             /*	Decoding worker.	*/
+}swpAnimation;
+
+/**
+ *	Incremental 64-bit content hash state (XXH64).
+ */
+typedef struct swp_hash_state_t{
+	Uint64 v[4];                    /*	Stripe accumulators.	*/
+	Uint64 total;                   /*	Number of bytes hashed.	*/
+	unsigned char mem[32];          /*	Partial stripe.	*/
+	unsigned int memsize;           /*	Number of bytes in the partial stripe.	*/
+}swpHashState;
+
+/**
+ *	Maximum number of levels in the tile pyramid.
+ */
+#define SWP_MAX_TILE_LEVELS 24
+
+/**
+ *	Tile size in pixels, limited by the max texture size.
+ */
+#define SWP_TILE_SIZE 1024
+#define SWP_TILE_GUTTER 1       /*	Texels of the neighbouring tiles around each tile.	*/
+
+/**
+ *	Level of the tile pyramid, each level
+ *	is half the size of the previous.
+ */
+typedef struct swp_tile_level_t{
+	unsigned int width;             /*	Level width in pixels.	*/
+	unsigned int height;            /*	Level height in pixels.	*/
+	unsigned int numtiles[2];       /*	Number of tiles in each direction.	*/
+	unsigned char* pixel;           /*	BGRA pixel data.	*/
+}swpTileLevel;
+
+/**
+ *	Tile texture resident in the tile cache.
+ */
+typedef struct swp_tile_t{
+	GLuint tex;                     /*	Texture, 0 if the slot is unused.	*/
+	int level;                      /*	Pyramid level, -1 if the slot is unused.	*/
+	unsigned int x;                 /*	Tile column.	*/
+	unsigned int y;                 /*	Tile row.	*/
+	unsigned int lastuse;           /*	Frame the tile was last drawn.	*/
+}swpTile;
+
+/**
+ *	Picture larger than the max texture size, displayed
+ *	as a grid of tiles from a pyramid of levels.
+ */
+typedef struct swp_tiled_image_t{
+	unsigned int width;             /*	Full resolution width.	*/
+	unsigned int height;            /*	Full resolution height.	*/
+	unsigned int tilesize;          /*	Tile size in pixels.	*/
+	unsigned int numlevels;         /*	Number of pyramid levels.	*/
+	GLuint intfor;                  /*	Texture internal format.	*/
+	GLuint format;                  /*	Texture input format.	*/
+	GLuint imgdatatype;             /*	Texture input data type.	*/
+	swpTileLevel levels[SWP_MAX_TILE_LEVELS];   /*	*/
+	void* storage;                  /*	Pixel data of all levels if loaded from a pack, otherwise NULL.	*/
+	swpTile* tiles;                 /*	Tile cache.	*/
+	unsigned int numtiles;          /*	Number of tile cache slots.	*/
+	unsigned int frame;             /*	Frame counter for the LRU.	*/
+	float zoom;                     /*	Zoom, 1.0 shows the whole picture.	*/
+	float center[2];                /*	Normalized view center.	*/
+}swpTiledImage;
+
+/**
+ *	Maximum number of texture levels in
+ *	a texture description.
+ */
+#define SWP_MAX_TEXTURE_LEVELS 16
+
+/**
+ *	Pre-built texture level.
+ */
+typedef struct swp_texture_level_t{
+	unsigned int width;     /*	Level width.	*/
+	unsigned int height;    /*	Level height.	*/
+	size_t offset;          /*	Offset in bytes from the pixel data.	*/
+	size_t size;            /*	Size in bytes.	*/
+}swpTextureLevel;
 
 /**
  *	Texture description used for passing the
@@ -163,8 +480,158 @@ typedef struct swp_texture_desc_t{
 	GLuint format;          /*	Texture input format.*/
 	GLuint imgdatatype;     /*	Texture input data type.	*/
 	void* pixel;            /*	Remark : free it.	*/
+	swpAnimation* animation;    /*	Animation the picture is the first frame of, NULL if still.	*/
+	void* source;           /*	Full resolution picture if prescaled, otherwise NULL.	*/
+	swpTiledImage* tiled;   /*	Tiled picture the pixel data is a preview of, NULL if not tiled.	*/
+	Uint64 hash;            /*	Content hash of the picture file, 0 if not cached.	*/
+	unsigned int numlevels; /*	Number of pre-built levels, 0 if the mipmaps are generated.	*/
+	unsigned int compressed;    /*	Levels are block compressed.	*/
+	unsigned int alignment; /*	Row alignment of the levels.	*/
+	swpTextureLevel levels[SWP_MAX_TEXTURE_LEVELS];    /*	*/
+	unsigned int srcwidth;  /*	Full resolution width.	*/
+	unsigned int srcheight; /*	Full resolution height.	*/
+	GLuint texture;         /*	Texture uploaded ahead of the event, 0 if uploaded by the render thread.	*/
+	unsigned int topdown;   /*	Block compressed levels stored top-down, flipped when drawn.	*/
 }swpTextureDesc;
 
+/**
+ *	Function building the pixel data of a
+ *	picture on the upload thread before its upload.
+ */
+typedef void (*swpPrepareFunc)(swpTextureDesc* desc);
+
+/**
+ *	Changed rectangle of the displayed picture.
+ */
+typedef struct swp_dirty_rect_t{
+	unsigned int x;                 /*	Picture coordinates, origin at the top left.	*/
+	unsigned int y;                 /*	*/
+	unsigned int width;             /*	*/
+	unsigned int height;            /*	*/
+	unsigned char* pixel;           /*	Bottom-up BGRA pixels.	*/
+}swpDirtyRect;
+
+/**
+ *	Partial update of the displayed picture.
+ */
+typedef struct swp_dirty_update_t{
+	Uint64 frameid;                 /*	Content hash of the picture to update, 0 for the displayed picture.	*/
+	unsigned int numrects;          /*	*/
+	swpDirtyRect* rects;            /*	*/
+}swpDirtyUpdate;
+
+/**
+ *	Playlist entry states.
+ */
+#define SWP_PLAYLIST_FREE      0	/*	Entry can be decoded into.	*/
+#define SWP_PLAYLIST_DECODING  1	/*	Picture is being read by the decode thread.	*/
+#define SWP_PLAYLIST_DECODED   2	/*	Picture decoded, waiting for the upload.	*/
+#define SWP_PLAYLIST_READY     3	/*	Picture can be displayed.	*/
+
+#define SWP_PLAYLIST_MAX_PREFETCH 8
+
+/**
+ *	Picture of the playlist decoded ahead.
+ */
+typedef struct swp_playlist_entry_t{
+	swpTextureDesc desc;            /*	Decoded picture, pixel is NULL once uploaded.	*/
+	unsigned int status;            /*	SWP_PLAYLIST_* state.	*/
+}swpPlaylistEntry;
+
+/**
+ *	Slideshow of pictures listed in a file, decoded
+ *	and uploaded ahead of the time they are displayed.
+ */
+typedef struct swp_playlist_t{
+	char** paths;                   /*	Picture paths.	*/
+	unsigned int numpaths;          /*	*/
+	unsigned int* order;            /*	Play order of the paths.	*/
+	unsigned int position;          /*	Next position in the order to decode.	*/
+	swpPlaylistEntry entries[SWP_PLAYLIST_MAX_PREFETCH];    /*	Ring of prefetched pictures.	*/
+	unsigned int head;              /*	Next entry to display.	*/
+	unsigned int tail;              /*	Next entry to decode into.	*/
+	unsigned int due;               /*	Next picture is due, displayed as soon as it is ready.	*/
+	unsigned int alive;             /*	*/
+	GLuint pbo;                     /*	Pixel buffer of the uploads ahead.	*/
+	SDL_mutex* lock;                /*	*/
+	SDL_cond* cond;                 /*	Signaled when an entry has been freed.	*/
+	SDL_Thread* thread;             /*	Decode thread.	*/
+	SDL_TimerID timer;              /*	Interval timer.	*/
+}swpPlaylist;
+
+/**
+ *	Picture uploaded in bands over several
+ *	frames before it is displayed.
+ */
+typedef struct swp_sliced_upload_t{
+	swpTextureDesc* desc;           /*	Picture of the event, promoted once complete.	*/
+	swpTextureDesc upload;          /*	Levels to upload, within the VRAM budget.	*/
+	GLuint texture;                 /*	Immutable storage receiving the bands.	*/
+	unsigned int level;             /*	Level of the next band.	*/
+	unsigned int row;               /*	First row of the next band, block row if compressed.	*/
+}swpSlicedUpload;
+
+/**
+ *	Rescale of the displayed picture, scaled
+ *	and uploaded on the upload thread.
+ */
+typedef struct swp_rescale_t{
+	swpTextureDesc desc;            /*	Rescaled picture, uploaded to desc.texture. First member, passed to the prepare function.	*/
+	const void* source;             /*	Full resolution picture, owned by the rescale once superseded.	*/
+	unsigned int srcwidth;          /*	*/
+	unsigned int srcheight;         /*	*/
+}swpRescale;
+
+/**
+ *	Frame time statistics.
+ */
+typedef struct swp_frame_stats_t{
+	unsigned int numframes;         /*	Rendered frames.	*/
+	unsigned int numlate;           /*	Frames longer than one and a half frame interval.	*/
+	Uint64 sum;                     /*	Sum of the frame times in counter ticks.	*/
+	Uint64 max;                     /*	Longest frame time in counter ticks.	*/
+}swpFrameStats;
+
+/**
+ *	Monotonic clock scheduling the transition frames.
+ */
+typedef struct swp_frame_clock_t{
+	Uint64 start;                   /*	Counter of the start of the transition.	*/
+	Uint64 last;                    /*	Counter of the last frame.	*/
+	Uint64 next;                    /*	Counter the next frame is due.	*/
+	Uint64 interval;                /*	Counter ticks between capped frames, 0 if paced by the swap.	*/
+	Uint64 vsync;                   /*	Counter ticks of a display refresh, 0 if unknown.	*/
+	swpFrameStats transition;       /*	Frames of the current or last transition.	*/
+	swpFrameStats total;            /*	Frames of all transitions.	*/
+}swpFrameClock;
+
+/**
+ *	Rendering state of the program.
+ */
+typedef struct swp_rendering_state_t{
+	unsigned int inTransition;      /*	*/
+	unsigned int fromTexIndex;      /*	*/
+	unsigned int toTexIndex;        /*	*/
+	float elapseTransition;         /*	*/
+	swpRenderingData data;          /*	*/
+	unsigned int timeout;           /*	*/
+	swpYUVStream* stream;           /*	Current YUV stream, NULL if displaying images.	*/
+	swpAnimation* animation;        /*	Current animation, NULL if still image.	*/
+	swpTextureDesc source;          /*	Full resolution picture of the prescaled texture.	*/
+	swpTiledImage* tiled;           /*	Current tiled picture, NULL if it fits a texture.	*/
+	unsigned int prescaled[2];      /*	Size of the prescaled texture.	*/
+	swpPlaylist* playlist;          /*	Current playlist, NULL if disabled.	*/
+	Uint64 framehash;               /*	Content hash of the displayed picture, 0 if unknown.	*/
+	unsigned int picsize[2];        /*	Size of the displayed picture, the texture may be smaller.	*/
+	unsigned int mipdirty;          /*	Displayed texture changed since the mipmaps were generated.	*/
+	Uint32 lastingest;              /*	Ticks of the last picture, frame or update.	*/
+	unsigned int reclaimed;         /*	Idle resources have been released.	*/
+	swpSlicedUpload* sliced;        /*	Picture being uploaded in bands, NULL if none.	*/
+	swpFrameClock clock;            /*	Schedules the transition frames.	*/
+	swpRescale* rescale;            /*	Rescale of the displayed picture in flight, NULL if none.	*/
+	unsigned int rescaledue;        /*	Drawable size changed again while rescaling.	*/
+}swpRenderingState;
+
 
 /**
  *	Verbose stdout print. Using the
@@ -191,6 +658,18 @@ extern void swpEnableDebug(void);
  */
 extern void swpLoadGLFunc(void);
 
+/**
+ *	Load function pointers, enumerate the extensions
+ *	and query the limits of the current context once,
+ *	setting g_support_* to the fast paths to use.
+ */
+extern void swpProbeCapabilities(void);
+
+/**
+ *	Release the extension set.
+ */
+extern void swpReleaseCapabilities(void);
+
 /**
  *	Parse.
  *	TODO rename to a more generic name.
@@ -228,10 +707,11 @@ extern void swpGenerateQuad(GLuint* vao, GLuint* vbo);
 extern unsigned int swpGetGLSLVersion(void);
 
 /**
- *	Check if OpenGL extension is supported on current
- *	OpenGL context.
+ *	Check if extension is supported by the
+ *	current context, in the extension set
+ *	enumerated on first use.
  *
- *	@Return non-zero if supported, zero otherwise.
+ *	@Return non-zero if supported.
  */
 extern unsigned int swpCheckExtensionSupported(const char* extension);
 
@@ -247,6 +727,27 @@ extern unsigned int swpCheckExtensionSupported(const char* extension);
  */
 extern GLint swpCreateShader(const char* vshader, const char* fshader);
 
+/**
+ *	Issue the compile and link of shader program,
+ *	without waiting for the driver to complete it.
+ *
+ *	@Return non-zero if successfully.
+ */
+extern int swpCompileShader(const char* vshader, const char* fshader, swpShaderBuild* build);
+
+/**
+ *	@Return non-zero if the driver has completed
+ *	linking, querying the link status will not block.
+ */
+extern int swpIsShaderLinked(const swpShaderBuild* build);
+
+/**
+ *	Complete shader program issued with swpCompileShader.
+ *
+ *	@Return non-negative if successfully.
+ */
+extern GLint swpLinkShader(swpShaderBuild* build);
+
 /**
  *	Load transition shaders from file paths.
  *	It will create transition shader for each
@@ -277,6 +778,20 @@ extern int swpCreateTransitionShaders(swpTransitionShader* __restrict__ trans,
  */
 extern swpTransitionShader* swpCreateDefaultTransitionShader(swpRenderingState* __restrict__ state);
 
+/**
+ *	Complete the next transition shader linked by the
+ *	driver, or warm up the next linked shader with an
+ *	off-screen draw. Called when idle.
+ *
+ *	@Return non-zero if shaders remain to be completed.
+ */
+extern int swpUpdateTransitionShaders(swpRenderingState* state, GLuint vao);
+
+/**
+ *	@Return transition shader to use, NULL if none is linked.
+ */
+extern swpTransitionShader* swpGetTransitionShader(swpRenderingState* state);
+
 /**
  *	Get texture format from freeeimage color space data type.
  *
@@ -291,6 +806,146 @@ extern GLuint swpGetGLTextureFormat(unsigned int ffpic);
  */
 ssize_t swpReadPicFromfd(int fd, swpTextureDesc* desc);
 
+/**
+ *	Read a continuous YUV4MPEG2 stream from file
+ *	descriptor until end of file. The frames are
+ *	paced to the stream frame rate and passed to
+ *	the main thread with the SWP_EVENT_STREAM_FRAME event.
+ *
+ *	\prefix bytes already read from the file descriptor.
+ *
+ *	@Return number of bytes read.
+ */
+extern ssize_t swpReadY4MStream(int fd, const void* __restrict__ prefix, size_t prefixlen);
+
+/**
+ *	Read a dirty update message from file descriptor and
+ *	pass it to the main thread with the SWP_EVENT_DIRTY_UPDATE event.
+ *
+ *	\prefix bytes already read from the file descriptor.
+ *
+ *	@Return number of bytes read, -1 if the message is invalid.
+ */
+extern ssize_t swpReadDirtyFromfd(int fd, const void* __restrict__ prefix, size_t prefixlen);
+
+/**
+ *	Upload the changed rectangles of \update to the displayed
+ *	texture and release \update. A texture shared with the cache
+ *	is first replaced by a copy of its own.
+ *
+ *	@Return non-zero if the displayed picture changed.
+ */
+extern int swpApplyDirtyUpdate(swpRenderingState* __restrict__ state, swpDirtyUpdate* __restrict__ update);
+
+/**
+ *	Regenerate the mipmaps of the displayed texture
+ *	if dirty updates have been applied since.
+ */
+extern void swpUpdateDirtyMipmaps(swpRenderingState* state);
+
+/**
+ *	Create frame queue with a fixed number of slots.
+ *
+ *	@Return non-zero if successfully.
+ */
+extern int swpCreateFrameQueue(swpFrameQueue* queue, unsigned int numslots, unsigned int slotsize);
+
+/**
+ *	Release all resources associated with the frame queue.
+ */
+extern void swpReleaseFrameQueue(swpFrameQueue* queue);
+
+/**
+ *	Get next free slot for writing. Blocks until
+ *	a slot is available.
+ *
+ *	@Return slot memory, NULL if the queue is closed.
+ */
+extern void* swpFrameQueueBeginWrite(swpFrameQueue* queue);
+
+/**
+ *	Commit the slot acquired by swpFrameQueueBeginWrite.
+ */
+extern void swpFrameQueueEndWrite(swpFrameQueue* queue, const swpFrameInfo* info);
+
+/**
+ *	Get the oldest committed frame without blocking.
+ *
+ *	@Return slot memory, NULL if no frame is available.
+ */
+extern void* swpFrameQueuePeek(swpFrameQueue* queue, swpFrameInfo* info);
+
+/**
+ *	Release the oldest committed frame.
+ */
+extern void swpFrameQueuePop(swpFrameQueue* queue);
+
+/**
+ *	Close the queue and wake up any blocked producer.
+ */
+extern void swpFrameQueueClose(swpFrameQueue* queue);
+
+/**
+ *	Create the plane textures and the YUV shader for the stream.
+ *	Invoked once by the main thread when a stream starts.
+ *
+ *	@Return non-zero if successfully.
+ */
+extern int swpBeginStream(swpRenderingState* __restrict__ state, swpYUVStream* __restrict__ stream);
+
+/**
+ *	Upload the newest due frame of the stream with glTexSubImage2D,
+ *	older frames are dropped if the main thread has fallen behind.
+ *
+ *	@Return non-zero if a new frame was uploaded.
+ */
+extern int swpUpdateStream(swpRenderingState* state);
+
+/**
+ *	Release the stream once its producer has ended. The
+ *	plane textures are kept for displaying the last frame.
+ */
+extern void swpEndStream(swpRenderingState* __restrict__ state, swpYUVStream* __restrict__ stream);
+
+/**
+ *	Create animation from a multi page picture. The first
+ *	frame is decoded into the texture description and the
+ *	worker thread starts decoding the following frames.
+ *
+ *	\fif FreeImage format of the picture.
+ *
+ *	\memory encoded data, owned by the animation if successfully.
+ *
+ *	@Return animation, NULL if the picture only has a single frame.
+ */
+extern swpAnimation* swpCreateAnimation(int fif, struct FIMEMORY* __restrict__ memory,
+		swpTextureDesc* __restrict__ desc);
+
+/**
+ *	Start playback of the animation displayed by the texture.
+ *	The first frame must have been uploaded to the texture.
+ */
+extern void swpBeginAnimation(swpRenderingState* __restrict__ state, swpAnimation* __restrict__ animation,
+		GLuint tex);
+
+/**
+ *	Upload the changed sub-rectangle of the next frame
+ *	and schedule the following frame.
+ *
+ *	@Return non-zero if a new frame was uploaded.
+ */
+extern int swpUpdateAnimation(swpRenderingState* state);
+
+/**
+ *	Stop playback and release the current animation.
+ */
+extern void swpReleaseAnimation(swpRenderingState* state);
+
+/**
+ *	Free an animation that has not been played.
+ */
+extern void swpFreeAnimation(swpAnimation* anim);
+
 /**
  *	Load texture from texture description to
  *	OpenGL texture object with help of PBO
@@ -309,6 +964,19 @@ ssize_t swpReadPicFromfd(int fd, swpTextureDesc* desc);
 extern int swpLoadTextureFromMem(GLuint* __restrict__ tex, GLuint pbo,
 		const swpTextureDesc* __restrict__ desc);
 
+/**
+ *	@Return sized internal format for immutable storage,
+ *	0 if the format can only be specified with glTexImage2D.
+ */
+extern GLenum swpGetStorageFormat(GLenum intfor);
+
+/**
+ *	Create immutable storage of \numlevels levels
+ *	and the sampling state of the display texture.
+ */
+extern GLuint swpCreateTextureStorage(GLenum intfor, unsigned int width, unsigned int height,
+		unsigned int numlevels);
+
 /**
  *	Set window as wallpaper. (Not supported yet)
  *	This will make the program renderer
@@ -330,6 +998,562 @@ extern void swpSetFullscreen(SDL_Window* window, Uint32 fullscreen);
  */
 extern void* swpCatchPipedTexture(void* phandle);
 
+/**
+ *	Startup thread function for loading the pictures
+ *	from the file descriptors passed at startup, the -f
+ *	file and the piped STDIN.
+ *
+ *	\phandle array of file descriptors terminated with -1.
+ *
+ *	@Return NULL when terminating the function.
+ */
+extern void* swpCatchStartupTexture(void* phandle);
+
+/**
+ *	Invoke \func for each index in [0, \count) on
+ *	the task pool. The calling thread takes part in the
+ *	work and the function returns when all tasks are done.
+ */
+extern void swpParallelFor(unsigned int count, swpTaskFunc func, void* userdata);
+
+/**
+ *	Terminate the task pool threads.
+ */
+extern void swpReleaseTaskPool(void);
+
+/**
+ *	Scale BGRA picture with separable filter.
+ *
+ *	@Return non-zero if successfully.
+ */
+extern int swpScaleImage(const void* __restrict__ src, unsigned int srcwidth, unsigned int srcheight,
+		void* __restrict__ dst, unsigned int dstwidth, unsigned int dstheight, unsigned int filter);
+
+/**
+ *	Downsample BGRA picture by two with a box
+ *	filter. The destination is (width + 1) / 2
+ *	by (height + 1) / 2 pixels.
+ */
+extern void swpDownsample2x(const void* __restrict__ src, unsigned int width, unsigned int height,
+		void* __restrict__ dst);
+
+/**
+ *	Compute the prescaled size of a picture
+ *	for the current drawable size or cap.
+ */
+extern void swpGetPrescaleSize(unsigned int width, unsigned int height,
+		unsigned int* dstwidth, unsigned int* dstheight);
+
+/**
+ *	Scale down the texture description pixel
+ *	data to the target resolution. The full
+ *	resolution picture is kept in desc->source.
+ *
+ *	@Return non-zero if the picture was scaled.
+ */
+extern int swpPrescaleTexture(swpTextureDesc* desc);
+
+/**
+ *	Take ownership of the full resolution
+ *	picture of \desc, releasing the previous.
+ */
+extern void swpSetPrescaleSource(swpRenderingState* __restrict__ state,
+		swpTextureDesc* __restrict__ desc);
+
+/**
+ *	Rescale the displayed texture from the full resolution
+ *	picture after the drawable size changed. The picture is
+ *	scaled and uploaded on the upload thread, the current
+ *	texture is displayed until SWP_EVENT_RESCALED.
+ *
+ *	@Return non-zero if a rescale was queued.
+ */
+extern int swpRescaleTexture(swpRenderingState* state);
+
+/**
+ *	Display the texture of \rescale on SWP_EVENT_RESCALED,
+ *	unless a newer picture is displayed, and release it.
+ *
+ *	@Return non-zero if texture was updated.
+ */
+extern int swpFinishRescale(swpRenderingState* __restrict__ state, swpRescale* __restrict__ rescale);
+
+/**
+ *	@Return number of texture levels of a picture
+ *	according to the mipmap policy, including the base.
+ */
+extern unsigned int swpGetMipLevelCount(unsigned int width, unsigned int height);
+
+/**
+ *	Filter the mip levels of the texture description
+ *	pixel data on the task pool, replacing the pixel
+ *	data with the pre-built levels.
+ *
+ *	@Return non-zero if the levels were built.
+ */
+extern int swpBuildMipmaps(swpTextureDesc* desc);
+
+/**
+ *	Encode the texture description pixel data, or its
+ *	pre-built levels, to BC1, BC3 or BC7 on the task pool,
+ *	replacing the pixel data with the compressed levels.
+ *
+ *	@Return non-zero if the picture was compressed.
+ */
+extern int swpCompressTexture(swpTextureDesc* desc);
+
+/**
+ *	Initialize hash state.
+ */
+extern void swpHashInit(swpHashState* state);
+
+/**
+ *	Hash the next \len bytes of the content.
+ */
+extern void swpHashUpdate(swpHashState* state, const void* data, size_t len);
+
+/**
+ *	@Return 64-bit hash of the content hashed so far.
+ */
+extern Uint64 swpHashDigest(const swpHashState* state);
+
+/**
+ *	Look up decoded picture by its content hash. A
+ *	resident texture is pinned until released with
+ *	swpCacheReleaseTexture and \desc has no pixel data.
+ *
+ *	@Return 0 if not cached, 1 if the texture is resident,
+ *	2 if \desc has a copy of the full resolution picture.
+ */
+extern int swpCacheLookup(Uint64 hash, swpTextureDesc* desc);
+
+/**
+ *	Add a copy of the decoded picture to the cache,
+ *	bounded by the host memory budget.
+ */
+extern void swpCacheInsert(Uint64 hash, const swpTextureDesc* desc);
+
+/**
+ *	Share the texture uploaded from \desc with the
+ *	cache, bounded by the GPU memory budget.
+ *
+ *	@Return non-zero if the cache references the texture,
+ *	which has to be released with swpCacheReleaseTexture.
+ */
+extern int swpCacheSetTexture(Uint64 hash, GLuint tex, const swpTextureDesc* desc);
+
+/**
+ *	@Return resident texture of a pinned entry.
+ */
+extern GLuint swpCacheGetTexture(Uint64 hash);
+
+/**
+ *	Release reference of the cached texture.
+ */
+extern void swpCacheReleaseTexture(Uint64 hash);
+
+/**
+ *	Release all cached pictures and textures.
+ */
+extern void swpReleaseCache(void);
+
+/**
+ *	Read pre-processed picture pack, written by
+ *	swp-pack, of which \prefix has already been read.
+ *	Regular files are mapped instead of read.
+ *
+ *	@Return number of bytes, -1 on failure.
+ */
+extern ssize_t swpReadPackFromfd(int fd, const void* prefix, size_t prefixlen, swpTextureDesc* desc);
+
+/**
+ *	@Return non-zero if \prefix is the beginning
+ *	of a DDS, KTX or KTX2 texture container.
+ */
+extern int swpIsTextureContainer(const void* prefix, size_t len);
+
+/**
+ *	Read DDS, KTX or KTX2 texture container of which
+ *	\prefix has already been read. The block compressed
+ *	or uncompressed levels are passed through without
+ *	decoding. Top-down uncompressed levels are flipped to
+ *	bottom-up rows, block compressed levels are left as
+ *	they are and the picture is flipped when drawn.
+ *
+ *	@Return number of bytes, -1 on failure.
+ */
+extern ssize_t swpReadContainerFromfd(int fd, const void* prefix, size_t prefixlen, swpTextureDesc* desc);
+
+/**
+ *	Look up decoded picture published by any swp
+ *	process. The pixel data of \desc is mapped read-only
+ *	and has to be released with swpReleasePixel.
+ *
+ *	@Return non-zero if found.
+ */
+extern int swpSharedLookup(Uint64 hash, swpTextureDesc* desc);
+
+/**
+ *	Publish the full resolution decoded picture
+ *	for the other swp processes.
+ */
+extern void swpSharedPublish(Uint64 hash, const swpTextureDesc* desc);
+
+/**
+ *	Register pixel data mapped with mmap, so
+ *	that swpReleasePixel unmaps it.
+ *
+ *	@Return non-zero if successfully.
+ */
+extern int swpAddPixelMapping(void* pixel, size_t size);
+
+/**
+ *	Release pixel data, either allocated or
+ *	mapped from the cross-process cache.
+ */
+extern void swpReleasePixel(void* pixel);
+
+/**
+ *	Create tile pyramid of the texture description
+ *	pixel data, which it takes the ownership of. The
+ *	pixel data is replaced by a preview that fits
+ *	in a single texture.
+ *
+ *	@Return non-null if successfully.
+ */
+extern swpTiledImage* swpCreateTiledImage(swpTextureDesc* desc);
+
+/**
+ *	Release the current tiled picture and
+ *	its tile textures.
+ */
+extern void swpReleaseTiledImage(swpRenderingState* state);
+
+/**
+ *	Free a tiled picture that has not been displayed.
+ */
+extern void swpFreeTiledImage(swpTiledImage* tiled);
+
+/**
+ *	Draw the visible tiles of the current tiled
+ *	picture, uploading missing tiles to the cache.
+ */
+extern void swpRenderTiles(GLuint vao, swpRenderingState* state);
+
+/**
+ *	Pan the view of the tiled picture by \dx and \dy
+ *	of the visible region and multiply the zoom by \zoom.
+ *	A zoom of zero resets the view to the whole picture.
+ */
+extern void swpPanTiledImage(swpRenderingState* state, float dx, float dy, float zoom);
+
+/**
+ *	Path of file \name in the swp cache directory,
+ *	$XDG_CACHE_HOME/swp. The directory is created
+ *	if \create is non-zero.
+ *
+ *	@Return non-zero if successfully.
+ */
+extern int swpGetCachePath(char* path, size_t size, const char* name, int create);
+
+/**
+ *	Create program from the binary cached for the
+ *	source hash \hash and the current driver.
+ *
+ *	@Return non-zero if the driver accepted the binary.
+ */
+extern int swpLoadProgramBinary(GLuint prog, Uint64 hash);
+
+/**
+ *	Store the binary of the linked program \prog.
+ */
+extern void swpSaveProgramBinary(GLuint prog, Uint64 hash);
+
+/**
+ *	Restore the snapshot of the last displayed picture,
+ *	scaled to the drawable, into the next texture slot.
+ *
+ *	@Return non-zero if a snapshot was restored.
+ */
+extern int swpLoadSnapshot(swpRenderingState* state);
+
+/**
+ *	Request a snapshot of the displayed picture, read
+ *	back by swpUpdateSnapshot on a later idle pass.
+ */
+extern void swpSaveSnapshot(void);
+
+/**
+ *	Read back the displayed texture into a pixel pack buffer
+ *	once the picture has settled, and write it as snapshot in
+ *	$XDG_CACHE_HOME on a separate thread once the read back
+ *	has completed.
+ *
+ *	@Return non-zero while a read back is in flight.
+ */
+extern int swpUpdateSnapshot(const swpRenderingState* state);
+
+/**
+ *	Finish writing the pending snapshot.
+ */
+extern void swpReleaseSnapshot(void);
+
+/**
+ *	Create the ring of persistently mapped pixel
+ *	buffer slots of \slotsize bytes, if the context
+ *	supports buffer storage and fence sync objects.
+ *
+ *	@Return non-zero if successfully.
+ */
+extern int swpCreateUploadRing(size_t slotsize);
+
+/**
+ *	Copy \size bytes of \pixel into the next slot of the
+ *	upload ring, waiting on its fence only if the GPU is
+ *	still reading it. The slot is bound at \offset of \buffer
+ *	until swpFenceUploadRing is called after the upload.
+ *
+ *	@Return non-zero if successfully, zero if the ring is not available.
+ */
+extern int swpWriteUploadRing(const void* __restrict__ pixel, size_t size, GLuint* __restrict__ buffer,
+                              size_t* __restrict__ offset);
+
+/**
+ *	Fence the slot written last, after the commands reading it.
+ */
+extern void swpFenceUploadRing(void);
+
+/**
+ *	Release the ring while idle, it is created
+ *	again with the same size on the next write.
+ */
+extern void swpTrimUploadRing(void);
+
+/**
+ *	Wait for the uploads in flight and release the ring.
+ */
+extern void swpReleaseUploadRing(void);
+
+/**
+ *	Create the upload thread with a context shared
+ *	with \context, which is current on the calling thread.
+ *
+ *	@Return non-zero if successfully.
+ */
+extern int swpCreateUploadThread(SDL_Window* window, SDL_GLContext context);
+
+/**
+ *	Upload the picture of \desc to desc->texture on the
+ *	upload thread and push \event once the texture is
+ *	complete. The event is pushed directly if there
+ *	is no upload thread or nothing to upload.
+ */
+extern void swpSubmitUpload(swpTextureDesc* __restrict__ desc, const SDL_Event* __restrict__ event);
+
+/**
+ *	Same as swpSubmitUpload, the pixel data of \desc is
+ *	first built by \prepare on the upload thread, or on
+ *	the calling thread if there is no upload thread.
+ */
+extern void swpSubmitPreparedUpload(swpTextureDesc* __restrict__ desc, swpPrepareFunc prepare,
+                                    const SDL_Event* __restrict__ event);
+
+/**
+ *	Stop the upload thread and delete its context.
+ */
+extern void swpReleaseUploadThread(void);
+
+/**
+ *	Read the playlist g_playlistpath and start decoding
+ *	the first pictures and the interval timer.
+ *
+ *	@Return non-zero if successfully.
+ */
+extern int swpCreatePlaylist(swpRenderingState* state);
+
+/**
+ *	Upload the decoded picture of \entry ahead of
+ *	time, on the SWP_EVENT_PLAYLIST_DECODED event.
+ */
+extern void swpUploadPlaylistEntry(swpRenderingState* __restrict__ state, swpPlaylistEntry* __restrict__ entry);
+
+/**
+ *	Get the next picture of the playlist on the SWP_EVENT_PLAYLIST_NEXT event.
+ *
+ *	@Return entry, NULL if it is not loaded yet, in which case
+ *	SWP_EVENT_PLAYLIST_NEXT is pushed again once it is.
+ */
+extern swpPlaylistEntry* swpNextPlaylistEntry(swpRenderingState* state);
+
+/**
+ *	Hand the picture of \entry over to the display
+ *	and let the next picture be decoded into it.
+ */
+extern void swpConsumePlaylistEntry(swpRenderingState* __restrict__ state, swpPlaylistEntry* __restrict__ entry);
+
+/**
+ *	Stop the decode thread and release the prefetched pictures.
+ */
+extern void swpReleasePlaylist(swpRenderingState* state);
+
+/**
+ *	Initialize the startup synchronization and the
+ *	timeline base. Called first in the main function.
+ */
+extern void swpInitStartup(void);
+
+/**
+ *	Mark startup phases \flags as completed,
+ *	waking up threads waiting for them.
+ */
+extern void swpSetStartupReady(unsigned int flags);
+
+/**
+ *	Block until startup phases \flags have completed.
+ */
+extern void swpWaitStartupReady(unsigned int flags);
+
+/**
+ *	Record the completion of startup phase \phase
+ *	in the timeline, if the startup report is enabled.
+ */
+extern void swpStartupMark(const char* phase);
+
+/**
+ *	Print the startup timeline once, ending with \reason.
+ */
+extern void swpPrintStartupReport(const char* reason);
+
+/**
+ *	@Return estimated size in bytes of a texture
+ *	with \numlevels levels of format \intfor.
+ */
+extern size_t swpGetVRAMSize(GLenum intfor, unsigned int width, unsigned int height, unsigned int numlevels);
+
+/**
+ *	Set the size of texture or buffer object \name
+ *	of \kind, SWP_VRAM_*, a size of 0 if released.
+ */
+extern void swpTrackVRAM(unsigned int kind, GLuint name, size_t size);
+
+/**
+ *	@Return tracked size in bytes of object \name, 0 if not tracked.
+ */
+extern size_t swpGetTrackedVRAM(unsigned int kind, GLuint name);
+
+/**
+ *	@Return total size in bytes of the tracked objects.
+ */
+extern size_t swpGetVRAMUsage(void);
+
+/**
+ *	Fit the picture \desc into the VRAM budget, where \replaced
+ *	bytes are released by the upload. Falls back to 16-bit
+ *	texels, then drops levels and halves the resolution.
+ *	The pixel data of \desc is left to the caller, \fitted
+ *	may own new pixel data that the caller releases as well.
+ *
+ *	@Return non-zero if \fitted should be uploaded instead.
+ */
+extern int swpFitVRAMBudget(const swpTextureDesc* desc, swpTextureDesc* fitted, size_t replaced);
+
+/**
+ *	Print the GPU memory usage.
+ */
+extern void swpPrintStats(void);
+
+/**
+ *	Release the tracking table.
+ */
+extern void swpReleaseVRAMTracking(void);
+
+/**
+ *	Record ingest activity, restarting the idle period.
+ */
+extern void swpMarkActive(swpRenderingState* state);
+
+/**
+ *	@Return milliseconds to wait for events before
+ *	the idle resources are due to be released.
+ */
+extern unsigned int swpGetIdleTimeout(const swpRenderingState* state);
+
+/**
+ *	Release the pixel buffers, upload ring and slot
+ *	textures not displayed, once idle long enough.
+ */
+extern void swpReclaimIdle(swpRenderingState* state);
+
+/**
+ *	Read the refresh rate of the display of the window
+ *	and derive the interval of capped frames.
+ */
+extern void swpInitFrameClock(swpFrameClock* clock, SDL_Window* window);
+
+/**
+ *	Start timing a transition.
+ */
+extern void swpStartFrameClock(swpFrameClock* clock);
+
+/**
+ *	@Return non-zero if the next frame is due.
+ */
+extern int swpIsFrameDue(const swpFrameClock* clock);
+
+/**
+ *	@Return milliseconds until the next frame is due.
+ */
+extern unsigned int swpGetFrameTimeout(const swpFrameClock* clock);
+
+/**
+ *	Record the frame and schedule the next.
+ *
+ *	@Return seconds elapsed since the start of the transition.
+ */
+extern float swpTickFrameClock(swpFrameClock* clock);
+
+/**
+ *	Print the frame time statistics of the transitions.
+ */
+extern void swpPrintFrameStats(const swpFrameClock* clock);
+
+/**
+ *	Choose the upload path, measuring the paths supported by
+ *	the driver unless forced or cached for the renderer.
+ */
+extern void swpTuneUploadPath(void);
+
+/**
+ *	@Return name of the upload path.
+ */
+extern const char* swpGetUploadPathName(unsigned int path);
+
+/**
+ *	@Return upload path of the name, -1 if unknown.
+ */
+extern unsigned int swpGetUploadPath(const char* name);
+
+/**
+ *	Start uploading the picture in bands instead of at
+ *	once if a transition is running or it is large.
+ *	The event of the picture is pushed again once
+ *	the texture is complete.
+ *
+ *	@Return non-zero if the upload is sliced.
+ */
+extern int swpBeginSlicedUpload(swpRenderingState* state, swpTextureDesc* desc);
+
+/**
+ *	Upload the bands of the sliced picture
+ *	within the budget of a frame.
+ */
+extern void swpStepSlicedUpload(swpRenderingState* state);
+
+/**
+ *	Abandon the sliced upload.
+ */
+extern void swpReleaseSlicedUpload(swpRenderingState* state);
+
 /**
  *	Catch software interrupt signals.
  */